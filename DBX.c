@@ -2,28 +2,46 @@
 #include "DB.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <assert.h>
 
-// From Jason, with 1 change
-static char* Load_Read_Data(HITS_DB *db) {
-  FILE  *bases  = (FILE*) db->bases;
+static char Fwd4[256][4];   // Packed byte to its 4 bases, forward and reverse-complemented
+static char Rev4[256][4];
+static int  Tables_Ready = 0;
+
+static void Init_Decode_Tables();
+static char *Cached_Read(HITS_DBX *dbx, int i, int comp);
+
+// Map the .bps read-only and shared, rather than reading it into private memory, so that any
+//   number of processes on a node share one copy of it through the page cache.  The pages
+//   are read ahead in the background, so opening does not wait for the whole file.
+static char* Load_Read_Data(HITS_DB *db, int64 *size) {
   struct stat sbuf;
-  char  *data;
-
-  bases = fopen(Catenate(db->path,"","",".bps"),"r");
-  if (bases == NULL) EXIT(1);
-  stat(Catenate(db->path,"","",".bps"), &sbuf);
-  data = (char *) malloc(sbuf.st_size);
-  if (data == NULL) return NULL; // was EXIT(1), but we can proceed
-  fread(data, sbuf.st_size, 1, bases);
-  fclose(bases);
-  return(data);
+  void  *data;
+  int    fd;
+
+  fd = open(Catenate(db->path,"","",".bps"),O_RDONLY);
+  if (fd < 0) EXIT(1);
+  if (fstat(fd, &sbuf) != 0 || sbuf.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  data = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return NULL; // we can proceed reading from the file
+  madvise(data, sbuf.st_size, MADV_WILLNEED);
+  *size = sbuf.st_size;
+  return (char *) data;
 }
 
 // Wrapper
 int Open_DBX(char *path, HITS_DBX *dbx, bool preload) {
   dbx->data = NULL;
+  dbx->size = 0;
+  dbx->cache = NULL;
   int rc = Open_DB(path, &dbx->db);
   switch (rc) {
     case -1:
@@ -38,7 +56,10 @@ int Open_DBX(char *path, HITS_DBX *dbx, bool preload) {
       abort();
   }
   if (preload) {
-    dbx->data = Load_Read_Data(&dbx->db);
+    dbx->data = Load_Read_Data(&dbx->db, &dbx->size);
+  }
+  if (!Tables_Ready) {
+    Init_Decode_Tables();
   }
   return 0;
 }
@@ -54,7 +75,7 @@ static int Load_Read_From_RAM(HITS_DB *db, char *data, int i, char *read, int as
   off = r[i].boff;
   len = r[i].rlen;
   clen = COMPRESSED_LEN(len);
-  if (clen > 0) { memcpy(read, data + off, clen); } //fread(read,clen,1,bases)
+  if (clen > 0) { memcpy(read, data + off, clen); } // from the mapping of the .bps
   Uncompress_Read(len, read);
   if (ascii == 1)
     { Lower_Read(read);
@@ -71,6 +92,14 @@ static int Load_Read_From_RAM(HITS_DB *db, char *data, int i, char *read, int as
 
 // Wrapper
 int Load_ReadX(HITS_DBX *dbx, int i, char *read, int ascii) {
+  if (dbx->cache && ascii == 2 && i >= 0 && i < dbx->db.nreads) {
+    char *s = Cached_Read(dbx, i, 0);
+    if (s != NULL) {
+      memcpy(read, s, dbx->db.reads[i].rlen + 1);
+      read[-1] = '\0';
+      return (0);
+    }
+  }
   if (dbx->data) {
     return Load_Read_From_RAM(&dbx->db, dbx->data, i, read, ascii);
   } else {
@@ -78,8 +107,297 @@ int Load_ReadX(HITS_DBX *dbx, int i, char *read, int ascii) {
   }
 }
 
+// Each packed byte holds 4 bases, the first in its high bits.  Bytes are decoded a whole
+//   byte, i.e. 4 bases, at a time through a table, forward or reverse-complemented.
+
+static void Init_Decode_Tables() {   // Called by Open_DBX, i.e. before any threads
+  static const char fwd[4] = { 'A', 'C', 'G', 'T' };
+  static const char rev[4] = { 'T', 'G', 'C', 'A' };
+  int b, k;
+
+  for (b = 0; b < 256; b++)
+    for (k = 0; k < 4; k++)
+      { Fwd4[b][k]   = fwd[(b >> (6-2*k)) & 0x3];
+        Rev4[b][3-k] = rev[(b >> (6-2*k)) & 0x3];
+      }
+  Tables_Ready = 1;
+}
+
+// Decode the bases [ob,oe) of a read whose packed byte holding base ob is at pk into seq,
+//   or if comp into seq[0..oe-ob) from the end backwards, complemented
+
+static void Decode_Packed(uint8 *pk, int ob, int oe, int comp, char *seq) {
+  static const char fwd[4] = { 'A', 'C', 'G', 'T' };
+  static const char rev[4] = { 'T', 'G', 'C', 'A' };
+  int   m = ob;
+  char *o;
+
+  if (comp)
+    { o = seq + (oe-ob);
+      for ( ; m < oe && (m & 0x3) != 0; m++)
+        *--o = rev[(*pk >> (6-2*(m & 0x3))) & 0x3];
+      if ((ob & 0x3) != 0 && (m & 0x3) == 0)
+        pk += 1;
+      for ( ; m+4 <= oe; m += 4)
+        { o -= 4;
+          memcpy(o,Rev4[*pk++],4);
+        }
+      for ( ; m < oe; m++)
+        *--o = rev[(*pk >> (6-2*(m & 0x3))) & 0x3];
+    }
+  else
+    { o = seq;
+      for ( ; m < oe && (m & 0x3) != 0; m++)
+        *o++ = fwd[(*pk >> (6-2*(m & 0x3))) & 0x3];
+      if ((ob & 0x3) != 0 && (m & 0x3) == 0)
+        pk += 1;
+      for ( ; m+4 <= oe; m += 4)
+        { memcpy(o,Fwd4[*pk++],4);
+          o += 4;
+        }
+      for ( ; m < oe; m++)
+        *o++ = fwd[(*pk >> (6-2*(m & 0x3))) & 0x3];
+    }
+}
+
+#define SUBREAD_CHUNK 4096   // Packed bytes read from the .bps at a time
+
+static int Decode_SubreadX(HITS_DBX *dbx, int i, int beg, int end, int comp, char *seq) {
+  HITS_DB   *db = &dbx->db;
+  HITS_READ *r  = db->reads + i;
+  int        ob, oe, len;
+
+  if (i < 0 || i >= db->nreads || beg < 0 || end > r->rlen)
+    return (1);
+  if (end <= beg)
+    { seq[0] = '\0';
+      return (0);
+    }
+  len = r->rlen;
+  if (comp)
+    { ob = len - end;
+      oe = len - beg;
+    }
+  else
+    { ob = beg;
+      oe = end;
+    }
+
+  if (dbx->data != NULL)
+    Decode_Packed((uint8 *) dbx->data + r->boff + (ob >> 2),ob,oe,comp,seq);
+
+  else if (db->loaded)   // All the reads are in memory, one base (0-3) per byte
+    { static const char fwd[4] = { 'A', 'C', 'G', 'T' };
+      char *b = ((char *) db->bases) + r->boff;
+      int   n = oe-ob;
+      int   k;
+
+      if (comp)
+        for (k = 0; k < n; k++)
+          seq[k] = fwd[3-b[oe-1-k]];
+      else
+        for (k = 0; k < n; k++)
+          seq[k] = fwd[(int) b[ob+k]];
+    }
+
+  else
+    { uint8  pk[SUBREAD_CHUNK];
+      FILE  *bases = (FILE *) db->bases;
+      int    cb, ce, nb;
+
+      if (bases == NULL)
+        { bases = Fopen(Catenate(db->path,"","",".bps"),"r");
+          if (bases == NULL)
+            EXIT(1);
+          db->bases = (void *) bases;
+        }
+      if (fseeko(bases,r->boff + (ob >> 2),SEEK_SET) != 0)
+        SYSTEM_ERROR
+      for (cb = ob; cb < oe; cb = ce)
+        { ce = ((cb >> 2) + SUBREAD_CHUNK) << 2;
+          if (ce > oe)
+            ce = oe;
+          nb = ((ce-1) >> 2) - (cb >> 2) + 1;
+          if (fread(pk,1,nb,bases) != (size_t) nb)
+            SYSTEM_ERROR
+          if (comp)
+            Decode_Packed(pk,cb,ce,1,seq + (oe-ce));
+          else
+            Decode_Packed(pk,cb,ce,0,seq + (cb-ob));
+        }
+    }
+
+  seq[oe-ob] = '\0';
+  return (0);
+}
+
+// Cache of decoded reads: the entries are on a list from the most to the least recently used,
+//   and are found through a hash table on the key 2*read+comp
+
+typedef struct Cache_Entry {
+  struct Cache_Entry *next, *prev;   // LRU list
+  struct Cache_Entry *link;          // Hash chain
+  int64               key;
+  int64               bytes;         // Bytes it occupies
+  char               *seq;           // The read, upper-case in the orientation of key
+} Cache_Entry;
+
+typedef struct {
+  int64         budget, used;
+  int64         hits, misses;
+  int64         mask;
+  Cache_Entry **hash;
+  Cache_Entry  *head, *tail;
+} Read_Cache;
+
+void Cache_DBX(HITS_DBX *dbx, int64 bytes) {
+  Read_Cache *cache;
+  int64       nhash;
+
+  Uncache_DBX(dbx);
+  if (bytes <= 0)
+    return;
+
+  nhash = 1024;
+  while (nhash < 2*((int64) dbx->db.nreads) && nhash < (1 << 24))
+    nhash <<= 1;
+  cache = (Read_Cache *) Malloc(sizeof(Read_Cache),"Allocating read cache");
+  if (cache == NULL) EXIT(1);
+  cache->hash = (Cache_Entry **) calloc(nhash,sizeof(Cache_Entry *));
+  if (cache->hash == NULL) {
+    fprintf(stderr,"%s: Out of memory (Allocating read cache)\n",Prog_Name);
+    EXIT(1);
+  }
+  cache->mask   = nhash-1;
+  cache->budget = bytes;
+  cache->used   = 0;
+  cache->hits   = 0;
+  cache->misses = 0;
+  cache->head   = NULL;
+  cache->tail   = NULL;
+  dbx->cache = cache;
+}
+
+void Cache_Stats_DBX(HITS_DBX *dbx, int64 *hits, int64 *misses) {
+  Read_Cache *cache = (Read_Cache *) dbx->cache;
+
+  if (cache == NULL)
+    *hits = *misses = 0;
+  else {
+    *hits   = cache->hits;
+    *misses = cache->misses;
+  }
+}
+
+void Uncache_DBX(HITS_DBX *dbx) {
+  Read_Cache  *cache = (Read_Cache *) dbx->cache;
+  Cache_Entry *e, *n;
+
+  if (cache == NULL)
+    return;
+  for (e = cache->head; e != NULL; e = n) {
+    n = e->next;
+    free(e->seq);
+    free(e);
+  }
+  free(cache->hash);
+  free(cache);
+  dbx->cache = NULL;
+}
+
+// Return read i, reverse-complemented if comp, from the cache, decoding it into the cache
+//   (evicting the least recently used reads to make room) if it is not there.  Return NULL
+//   if the read alone exceeds the cache's budget.
+
+static char *Cached_Read(HITS_DBX *dbx, int i, int comp) {
+  Read_Cache   *cache = (Read_Cache *) dbx->cache;
+  Cache_Entry **bucket, *e;
+  int64         key, bytes;
+  int           len;
+
+  key    = 2*((int64) i) + (comp != 0);
+  bucket = cache->hash + (key & cache->mask);
+  for (e = *bucket; e != NULL; e = e->link)
+    if (e->key == key)
+      break;
+
+  if (e != NULL) {
+    cache->hits += 1;
+    if (e != cache->head) {       // Move to the front of the LRU list
+      e->prev->next = e->next;
+      if (e->next != NULL)
+        e->next->prev = e->prev;
+      else
+        cache->tail = e->prev;
+      e->prev = NULL;
+      e->next = cache->head;
+      cache->head->prev = e;
+      cache->head = e;
+    }
+    return (e->seq);
+  }
+
+  cache->misses += 1;
+  len   = dbx->db.reads[i].rlen;
+  bytes = len + 1 + sizeof(Cache_Entry);
+  if (bytes > cache->budget)
+    return (NULL);
+
+  while (cache->used + bytes > cache->budget) {   // Evict the least recently used
+    Cache_Entry **b, *t = cache->tail;
+
+    cache->tail = t->prev;
+    if (t->prev != NULL)
+      t->prev->next = NULL;
+    else
+      cache->head = NULL;
+    for (b = cache->hash + (t->key & cache->mask); *b != t; b = &((*b)->link))
+      ;
+    *b = t->link;
+    cache->used -= t->bytes;
+    free(t->seq);
+    free(t);
+  }
+
+  e = (Cache_Entry *) Malloc(sizeof(Cache_Entry),"Allocating cache entry");
+  if (e == NULL) EXIT(1);
+  e->seq = (char *) Malloc(len+1,"Allocating cache entry");
+  if (e->seq == NULL) EXIT(1);
+  Decode_SubreadX(dbx, i, 0, len, comp, e->seq);
+  e->key   = key;
+  e->bytes = bytes;
+  e->link  = *bucket;
+  *bucket  = e;
+  e->prev  = NULL;
+  e->next  = cache->head;
+  if (cache->head != NULL)
+    cache->head->prev = e;
+  else
+    cache->tail = e;
+  cache->head = e;
+  cache->used += bytes;
+  return (e->seq);
+}
+
+// Wrapper
+int Load_SubreadX(HITS_DBX *dbx, int i, int beg, int end, int comp, char *seq) {
+  char *s;
+
+  if (dbx->cache != NULL && i >= 0 && i < dbx->db.nreads && beg >= 0 && beg < end &&
+      end <= dbx->db.reads[i].rlen) {
+    s = Cached_Read(dbx, i, comp);
+    if (s != NULL) {
+      memcpy(seq, s + beg, end - beg);
+      seq[end - beg] = '\0';
+      return (0);
+    }
+  }
+  return Decode_SubreadX(dbx, i, beg, end, comp, seq);
+}
+
 // Wrapper
 void Close_DBX(HITS_DBX *dbx) {
   Close_DB(&dbx->db);
-  if (dbx->data) free(dbx->data);
+  if (dbx->data) munmap(dbx->data, dbx->size);
+  Uncache_DBX(dbx);
 }
@@ -10,15 +10,38 @@
 typedef struct {
 	HITS_DB db;
 /*
- * When "data" is non-null, it stores the entire DB
- * in memory, so we can avoid random-access disk operations.
+ * When "data" is non-null, it is a read-only shared mapping
+ * of the entire .bps ("size" bytes), so we can avoid random-access
+ * disk operations, and concurrent processes share one copy.
  * But if null, then wrappers simply delegate.
  */
 	char* data;
+	int64 size;
+/*
+ * When "cache" is non-null, decoded reads are kept in an LRU cache (see Cache_DBX).
+ */
+	void* cache;
 } HITS_DBX;
 
 int Open_DBX(char *path, HITS_DBX *dbx, bool preload);
 int  Load_ReadX(HITS_DBX *dbx, int i, char *read, int ascii);
+/*
+ * Decode just the bases [beg,end) of read i into seq as an upper-case, '\0'-terminated
+ * string, straight from the 2-bit packed data.  If comp is set the interval is of the
+ * reverse complement of the read and that is what is decoded.  seq must hold end-beg+1
+ * bytes.  Returns 0, or 1 if the interval is not within the read.
+ */
+int  Load_SubreadX(HITS_DBX *dbx, int i, int beg, int end, int comp, char *seq);
+/*
+ * Keep up to "bytes" of decoded reads, upper-case and in the orientation asked for, in a
+ * least-recently-used cache, so that a read asked for again by Load_SubreadX, or by
+ * Load_ReadX with ascii == 2, is copied instead of decoded.  The hits and misses are
+ * counted.  Uncache_DBX frees the cache, as does Close_DBX.  A cache is not thread-safe,
+ * so each thread needs a HITS_DBX with its own cache.
+ */
+void Cache_DBX(HITS_DBX *dbx, int64 bytes);
+void Cache_Stats_DBX(HITS_DBX *dbx, int64 *hits, int64 *misses);
+void Uncache_DBX(HITS_DBX *dbx);
 //void Trim_DB(HITS_DBX *dbx);
 void Close_DBX(HITS_DBX *dbx);
 
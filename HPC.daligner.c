@@ -23,7 +23,7 @@
 #undef  LSF  //  define if want a directly executable LSF script
 
 static char *Usage[] =
-  { "[-vbad] [-t<int>] [-w<int(6)>] [-l<int(1000)>] [-s<int(100)]",
+  { "[-vbadOL] [-t<int>] [-w<int(6)>] [-l<int(1000)>] [-s<int(100)]",
     "        [-M<int>] [-B<int(4)>] [-D<int( 250)>] [-T<int(4)>] [-f<name>]",
     "      ( [-k<int(14)>] [-h<int(35)>] [-e<double(.70)>] [-AI] [-H<int>] |",
     "        [-k<int(20)>] [-h<int(50)>] [-e<double(.85)>]  <ref:db|dam>   )",
@@ -33,7 +33,7 @@ static char *Usage[] =
   //  Command Options
 
 static int    DUNIT, BUNIT;
-static int    VON, BON, AON, ION, CON, DON;
+static int    VON, BON, AON, ION, CON, DON, OON, LON;
 static int    WINT, TINT, HGAP, HINT, KINT, SINT, LINT, MINT;
 static int    NTHREADS;
 static double EREL;
@@ -60,6 +60,7 @@ void daligner_script(int argc, char *argv[])
   FILE *out;
   char  name[100];
   char *pwd, *root;
+  char *sfx = (LON ? "" : ".S");   //  Suffix of the sorted thread files
 
   //  Make sure DB exists and is partitioned, get number of blocks in partition
 
@@ -220,6 +221,10 @@ void daligner_script(int argc, char *argv[])
               fprintf(out," -A");
             if (ION)
               fprintf(out," -I");
+            if (OON)
+              fprintf(out," -O");
+            if (LON)
+              fprintf(out," -L");
             if (KINT != 14)
               fprintf(out," -k%d",KINT);
             if (WINT != 6)
@@ -268,17 +273,23 @@ void daligner_script(int argc, char *argv[])
             if (DON)
               for (k = low; k < hgh; k++)
                 { fprintf(out," && mv");
-                  for (p = 0; p < NTHREADS; p++)
-                    { fprintf(out," %s.%d.%s.%d.C%d.las",root,i,root,k,p);
-                      fprintf(out," %s.%d.%s.%d.N%d.las",root,i,root,k,p);
-                    }
+                  if (OON)
+                    fprintf(out," %s.%d.%s.%d.las",root,i,root,k);
+                  else
+                    for (p = 0; p < NTHREADS; p++)
+                      { fprintf(out," %s.%d.%s.%d.C%d.las",root,i,root,k,p);
+                        fprintf(out," %s.%d.%s.%d.N%d.las",root,i,root,k,p);
+                      }
                   fprintf(out," work%d",i);
                   if (k != i)
                     { fprintf(out," && mv");
-                      for (p = 0; p < NTHREADS; p++)
-                        { fprintf(out," %s.%d.%s.%d.C%d.las",root,k,root,i,p);
-                          fprintf(out," %s.%d.%s.%d.N%d.las",root,k,root,i,p);
-                        }
+                      if (OON)
+                        fprintf(out," %s.%d.%s.%d.las",root,k,root,i);
+                      else
+                        for (p = 0; p < NTHREADS; p++)
+                          { fprintf(out," %s.%d.%s.%d.C%d.las",root,k,root,i,p);
+                            fprintf(out," %s.%d.%s.%d.N%d.las",root,k,root,i,p);
+                          }
                       fprintf(out," work%d",k);
                     }
                 }
@@ -311,30 +322,49 @@ void daligner_script(int argc, char *argv[])
           fprintf(out,LSF_SORT,jobid++);
           fprintf(out," \"");
 #endif
-          fprintf(out,"LAsort");
+          if (LON)                     //  Thread files are already sorted: just merge them
+            fprintf(out,"LAmerge");
+          else
+            fprintf(out,"LAsort");
           if (VON)
             fprintf(out," -v");
           if (CON)
             fprintf(out," -a");
-          for (k = 0; k < NTHREADS; k++)
-            if (useblock)
-              if (DON)
-                { fprintf(out," work%d/%s.%d.%s.%d.C%d",i,root,i,root,j,k);
-                  fprintf(out," work%d/%s.%d.%s.%d.N%d",i,root,i,root,j,k);
-                }
+          if (NTHREADS != 4)
+            fprintf(out," -T%d",NTHREADS);
+          if (OON)                     //  One file per block pair: sort it into place
+            { if (useblock)
+                if (DON)
+                  fprintf(out," work%d/%s.%d.%s.%d && mv work%d/%s.%d.%s.%d.S.las",
+                              i,root,i,root,j,i,root,i,root,j);
+                else
+                  fprintf(out," %s.%d.%s.%d && mv %s.%d.%s.%d.S.las",root,i,root,j,root,i,root,j);
               else
-                { fprintf(out," %s.%d.%s.%d.C%d",root,i,root,j,k);
-                  fprintf(out," %s.%d.%s.%d.N%d",root,i,root,j,k);
-                }
-            else
-              { fprintf(out," %s.%s.C%d",root,root,k);
-                fprintf(out," %s.%s.N%d",root,root,k);
-              }
-          fprintf(out," && LAmerge");
-          if (VON)
-            fprintf(out," -v");
-          if (CON)
-            fprintf(out," -a");
+                fprintf(out," %s.%s && mv %s.%s.S.las",root,root,root,root);
+            }
+          else if ( ! LON)
+            { for (k = 0; k < NTHREADS; k++)
+                if (useblock)
+                  if (DON)
+                    { fprintf(out," work%d/%s.%d.%s.%d.C%d",i,root,i,root,j,k);
+                      fprintf(out," work%d/%s.%d.%s.%d.N%d",i,root,i,root,j,k);
+                    }
+                  else
+                    { fprintf(out," %s.%d.%s.%d.C%d",root,i,root,j,k);
+                      fprintf(out," %s.%d.%s.%d.N%d",root,i,root,j,k);
+                    }
+                else
+                  { fprintf(out," %s.%s.C%d",root,root,k);
+                    fprintf(out," %s.%s.N%d",root,root,k);
+                  }
+              fprintf(out," && LAmerge");
+              if (VON)
+                fprintf(out," -v");
+              if (CON)
+                fprintf(out," -a");
+              if (NTHREADS != 4)
+                fprintf(out," -T%d",NTHREADS);
+            }
           if (lblock == 1)
             { if (usepath)
                 if (useblock)
@@ -359,20 +389,23 @@ void daligner_script(int argc, char *argv[])
               else
                 fprintf(out," L1.%d.%d",i,j);
             }
-          for (k = 0; k < NTHREADS; k++)
-            if (useblock)
-              if (DON)
-                { fprintf(out," work%d/%s.%d.%s.%d.C%d.S",i,root,i,root,j,k);
-                  fprintf(out," work%d/%s.%d.%s.%d.N%d.S",i,root,i,root,j,k);
-                }
+          if (OON)
+            fprintf(out,".las");
+          else
+            for (k = 0; k < NTHREADS; k++)
+              if (useblock)
+                if (DON)
+                  { fprintf(out," work%d/%s.%d.%s.%d.C%d%s",i,root,i,root,j,k,sfx);
+                    fprintf(out," work%d/%s.%d.%s.%d.N%d%s",i,root,i,root,j,k,sfx);
+                  }
+                else
+                  { fprintf(out," %s.%d.%s.%d.C%d%s",root,i,root,j,k,sfx);
+                    fprintf(out," %s.%d.%s.%d.N%d%s",root,i,root,j,k,sfx);
+                  }
               else
-                { fprintf(out," %s.%d.%s.%d.C%d.S",root,i,root,j,k);
-                  fprintf(out," %s.%d.%s.%d.N%d.S",root,i,root,j,k);
+                { fprintf(out," %s.%s.C%d%s",root,root,k,sfx);
+                  fprintf(out," %s.%s.N%d%s",root,root,k,sfx);
                 }
-            else
-              { fprintf(out," %s.%s.C%d.S",root,root,k);
-                fprintf(out," %s.%s.N%d.S",root,root,k);
-              }
 
 #ifdef LSF
           fprintf(out,"\"");
@@ -456,7 +489,14 @@ void daligner_script(int argc, char *argv[])
       { if (DON)
           fprintf(out,"cd work%d\n",i);
         for (j = (i < fblock ? fblock : 1); j <= lblock; j++)
-          { fprintf(out,"rm");
+          { if (OON)
+              { if (useblock)
+                  fprintf(out,"rm %s.%d.%s.%d.las\n",root,i,root,j);
+                else
+                  fprintf(out,"rm %s.%s.las\n",root,root);
+                continue;
+              }
+            fprintf(out,"rm");
             for (k = 0; k < NTHREADS; k++)
               if (useblock)
                 { fprintf(out," %s.%d.%s.%d.C%d.las",root,i,root,j,k);
@@ -467,6 +507,8 @@ void daligner_script(int argc, char *argv[])
                   fprintf(out," %s.%s.N%d.las",root,root,k);
                 }
             fprintf(out,"\n");
+            if (LON)
+              continue;
             fprintf(out,"rm");
             for (k = 0; k < NTHREADS; k++)
               if (useblock)
@@ -563,6 +605,8 @@ void daligner_script(int argc, char *argv[])
                             fprintf(out," -v");
                           if (CON)
                             fprintf(out," -a");
+                          if (NTHREADS != 4)
+                            fprintf(out," -T%d",NTHREADS);
                           if (last)
                             if (DON)
                               if (usepath)
@@ -610,6 +654,8 @@ void daligner_script(int argc, char *argv[])
                         fprintf(out," -v");
                       if (CON)
                         fprintf(out," -a");
+                      if (NTHREADS != 4)
+                        fprintf(out," -T%d",NTHREADS);
                       if (i == level)
                         if (usepath)
                           fprintf(out," %s/%s.%d",pwd,root,j);
@@ -820,6 +866,7 @@ void mapper_script(int argc, char *argv[])
   char  name[100];
   char *pwd1, *root1;
   char *pwd2, *root2;
+  char *sfx = (LON ? "" : ".S");   //  Suffix of the sorted thread files
 
   //  Make sure DAM and DB exist and the DB is partitioned, get number of blocks in partition
 
@@ -1022,6 +1069,10 @@ void mapper_script(int argc, char *argv[])
               fprintf(out," -v");
             if (BON)
               fprintf(out," -b");
+            if (OON)
+              fprintf(out," -O");
+            if (LON)
+              fprintf(out," -L");
             fprintf(out," -k%d",KINT);
             if (WINT != 6)
               fprintf(out," -w%d",WINT);
@@ -1063,10 +1114,13 @@ void mapper_script(int argc, char *argv[])
             if (DON)
               for (k = low; k < hgh; k++)
                 { fprintf(out," && mv");
-                  for (t = 0; t < NTHREADS; t++)
-                    { fprintf(out," %s.%d.%s.%d.C%d.las",root2,i,root1,k,t);
-                      fprintf(out," %s.%d.%s.%d.N%d.las",root2,i,root1,k,t);
-                    }
+                  if (OON)
+                    fprintf(out," %s.%d.%s.%d.las",root2,i,root1,k);
+                  else
+                    for (t = 0; t < NTHREADS; t++)
+                      { fprintf(out," %s.%d.%s.%d.C%d.las",root2,i,root1,k,t);
+                        fprintf(out," %s.%d.%s.%d.N%d.las",root2,i,root1,k,t);
+                      }
                   fprintf(out," work%d",i);
                 }
 #ifdef LSF
@@ -1097,14 +1151,21 @@ void mapper_script(int argc, char *argv[])
           fprintf(out,LSF_MSORT,jobid++);
           fprintf(out," \"");
 #endif
-          fprintf(out,"LAsort ");
+          if (LON)                     //  Thread files are already sorted: just merge them
+            fprintf(out,"LAmerge ");
+          else
+            fprintf(out,"LAsort ");
           if (VON)
             fprintf(out,"-v ");
           if (CON)
             fprintf(out,"-a ");
-          for (k = 0; k < NTHREADS; k++)
+          if (NTHREADS != 4)
+            fprintf(out,"-T%d ",NTHREADS);
+          if (OON)                           //  One file per block pair: sort it into place
             for (t = 0; t < 2; t++)
-              { if (DON)
+              { if (t > 0)
+                  fprintf(out,"&& mv ");
+                if (DON)
                   fprintf(out,"work%d/",j);
                 fprintf(out,"%s",root2);
                 if (useblock2)
@@ -1112,14 +1173,33 @@ void mapper_script(int argc, char *argv[])
                 fprintf(out,".%s",root1);
                 if (useblock1)
                   fprintf(out,".%d",i);
-                fprintf(out,".%c%d ",orient[t],k);
+                if (t > 0)
+                  fprintf(out,".S.las ");
+                else
+                  fprintf(out," ");
               }
+          else if ( ! LON)
+            { for (k = 0; k < NTHREADS; k++)
+                for (t = 0; t < 2; t++)
+                  { if (DON)
+                      fprintf(out,"work%d/",j);
+                    fprintf(out,"%s",root2);
+                    if (useblock2)
+                      fprintf(out,".%d",j);
+                    fprintf(out,".%s",root1);
+                    if (useblock1)
+                      fprintf(out,".%d",i);
+                    fprintf(out,".%c%d ",orient[t],k);
+                  }
 
-          fprintf(out,"&& LAmerge ");
-          if (VON)
-            fprintf(out,"-v ");
-          if (CON)
-            fprintf(out,"-a ");
+              fprintf(out,"&& LAmerge ");
+              if (VON)
+                fprintf(out,"-v ");
+              if (CON)
+                fprintf(out,"-a ");
+              if (NTHREADS != 4)
+                fprintf(out,"-T%d ",NTHREADS);
+            }
           if (nblocks1 == 1)
             { if (usepath2)
                 fprintf(out,"%s/",pwd2);
@@ -1134,19 +1214,22 @@ void mapper_script(int argc, char *argv[])
               fprintf(out,"L1.%d.%d",j,i);
             }
 
-          for (k = 0; k < NTHREADS; k++)
-            for (t = 0; t < 2; t++)
-              { if (DON)
-                  fprintf(out," work%d/%s",j,root2);
-                else
-                  fprintf(out," %s",root2);
-                if (useblock2)
-                  fprintf(out,".%d",j);
-                fprintf(out,".%s",root1);
-                if (useblock1)
-                  fprintf(out,".%d",i);
-                fprintf(out,".%c%d.S",orient[t],k);
-              }
+          if (OON)
+            fprintf(out,".las");
+          else
+            for (k = 0; k < NTHREADS; k++)
+              for (t = 0; t < 2; t++)
+                { if (DON)
+                    fprintf(out," work%d/%s",j,root2);
+                  else
+                    fprintf(out," %s",root2);
+                  if (useblock2)
+                    fprintf(out,".%d",j);
+                  fprintf(out,".%s",root1);
+                  if (useblock1)
+                    fprintf(out,".%d",i);
+                  fprintf(out,".%c%d%s",orient[t],k,sfx);
+                }
 #ifdef LSF
           fprintf(out,"\"");
 #endif
@@ -1224,22 +1307,34 @@ void mapper_script(int argc, char *argv[])
       { if (DON)
           fprintf(out,"cd work%d\n",j);
         for (i = 1; i <= nblocks1; i++)
-          for (t = 0; t < 4; t++)
-            { fprintf(out,"rm");
-              for (k = 0; k < NTHREADS; k++)
-                { fprintf(out," %s",root2);
-                  if (useblock2)
-                    fprintf(out,".%d",j);
-                  fprintf(out,".%s",root1);
-                  if (useblock1)
-                    fprintf(out,".%d",i);
-                  fprintf(out,".%c%d",orient[t%2],k);
-                  if (t >= 2)
-                    fprintf(out,".S");
-                  fprintf(out,".las");
-                }
-              fprintf(out,"\n");
+          if (OON)
+            { if (nblocks1 == 1 && ! useblock1 && ! DON)    //  Sorted into place
+                continue;
+              fprintf(out,"rm %s",root2);
+              if (useblock2)
+                fprintf(out,".%d",j);
+              fprintf(out,".%s",root1);
+              if (useblock1)
+                fprintf(out,".%d",i);
+              fprintf(out,".las\n");
             }
+          else
+            for (t = 0; t < (LON ? 2 : 4); t++)
+              { fprintf(out,"rm");
+                for (k = 0; k < NTHREADS; k++)
+                  { fprintf(out," %s",root2);
+                    if (useblock2)
+                      fprintf(out,".%d",j);
+                    fprintf(out,".%s",root1);
+                    if (useblock1)
+                      fprintf(out,".%d",i);
+                    fprintf(out,".%c%d",orient[t%2],k);
+                    if (t >= 2)
+                      fprintf(out,".S");
+                    fprintf(out,".las");
+                  }
+                fprintf(out,"\n");
+              }
         if (DON)
           fprintf(out,"cd ..\n");
       }
@@ -1295,6 +1390,8 @@ void mapper_script(int argc, char *argv[])
                         fprintf(out,"-v ");
                       if (CON)
                         fprintf(out,"-a ");
+                      if (NTHREADS != 4)
+                        fprintf(out,"-T%d ",NTHREADS);
                       if (i == level)
                         { if (usepath2)
                             fprintf(out,"%s/",pwd2);
@@ -1457,7 +1554,7 @@ int main(int argc, char *argv[])
     if (argv[i][0] == '-')
       switch (argv[i][1])
       { default:
-          ARG_FLAGS("vbadAI");
+          ARG_FLAGS("vbadAIOL");
           break;
         case 'e':
           ARG_REAL(EREL)
@@ -1527,6 +1624,8 @@ int main(int argc, char *argv[])
   ION = flags['I'];
   CON = flags['a'];
   DON = flags['d'];
+  OON = flags['O'];
+  LON = flags['L'];
 
   if (argc < 2 || argc > 4)
     { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -1537,6 +1636,11 @@ int main(int argc, char *argv[])
       exit (1);
     }
 
+  if (LON && (OON || CON))
+    { fprintf(stderr,"%s: Cannot use -L with -O or -a\n",Prog_Name);
+      exit (1);
+    }
+
   if (argc == 2)
     mapper = 0;
   else if (argc == 4)
@@ -1572,10 +1676,6 @@ int main(int argc, char *argv[])
         HINT = 35;
     }
 
-  for (j = 1; 2*j <= NTHREADS; j *= 2)
-    ;
-  NTHREADS = j;
-
   if (mapper)
     mapper_script(argc,argv);
   else
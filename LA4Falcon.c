@@ -58,6 +58,7 @@
 #include "DB.h"
 #include "DBX.h"
 #include "align.h"
+#include "las.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,6 +68,7 @@
 //#include <locale.h>
 #include <stdbool.h>
 // end debugging
+#include <pthread.h>
 
 
 
@@ -104,7 +106,7 @@ static bool belongs(OverlapGroup *grp, const Overlap *ovl) {
 // flag is false, effectively greating groups of 1.
 // Returns 1 if added as a new overlap group, otherwise 0.
 // caller keeps track of count
-static bool add_overlap(const Alignment *aln, const Overlap *ovl, const int count) {
+static bool add_overlap(OverlapGroup *ovlgrps, const Alignment *aln, const Overlap *ovl, const int count) {
     int added = false;
     // we assume breads are in order
     if (!GROUP || count < 0 || ovlgrps[count].beg.bread != ovl->bread) {
@@ -147,29 +149,237 @@ static bool add_overlap(const Alignment *aln, const Overlap *ovl, const int coun
     return added;
 }
 
-static void print_hits(const int hit_count, HITS_DBX *dbx2, char *bbuffer, char buffer[], int64 bsize, const int MAX_HIT_COUNT) {
+static void print_hits(FILE *out, OverlapGroup *ovlgrps, const int hit_count, HITS_DBX *dbx2, char buffer[], int64 bsize, const int MAX_HIT_COUNT) {
     int tmp_idx;
     qsort(ovlgrps, (hit_count+1), sizeof(OverlapGroup), compare_ovlgrps);
     for (tmp_idx = 0; tmp_idx < (hit_count+1) && tmp_idx < MAX_HIT_COUNT; tmp_idx++) {
         OverlapGroup *grp = &ovlgrps[tmp_idx];
-        //Load_ReadX assuming db2 == db1 is true
-        Load_ReadX(dbx2, grp->end.bread, bbuffer, 0);
-        if (COMP(grp->end.flags)) Complement_Seq(bbuffer, grp->blen );
-        Upper_Read(bbuffer);
         int64 const rlen = (int64)(grp->end.path.bepos) - (int64)(grp->beg.path.bbpos);
         if (rlen < bsize) {
-            strncpy( buffer, bbuffer + grp->beg.path.bbpos, rlen );
-            buffer[rlen - 1] = '\0';
-            printf("%08d %s\n", grp->end.bread, buffer);
+            // Decode just the window (less its last base, as always), oriented as the A-read
+            Load_SubreadX(dbx2, grp->end.bread, grp->beg.path.bbpos, grp->end.path.bepos - 1,
+                          COMP(grp->end.flags), buffer);
+            fprintf(out, "%08d %s\n", grp->end.bread, buffer);
         } else {
             fprintf(stderr, "[WARNING]Skipping super-long read %08d, len=%lld, buf=%lld\n", grp->end.bread, rlen, bsize);
         }
     }
-    printf("+ +\n");
+    fprintf(out, "+ +\n");
+}
+
+/*******************************************************************************************
+ *
+ *  THREADED PILEUPS (-f with -T): the main thread reads the .las file and hands its records
+ *    to the workers in batches of whole piles, each worker renders the pileups of a batch
+ *    into a private text buffer, and a writer thread outputs the buffers in batch order so
+ *    that the output is exactly that of the serial loop.
+ *
+ *******************************************************************************************/
+
+#define PILE_BATCH  4096   //  A batch is cut at the first pile boundary after this many records
+
+#define BATCH_EMPTY   0
+#define BATCH_FILLED  1
+#define BATCH_BUSY    2
+#define BATCH_DONE    3
+
+typedef struct {
+    Overlap *ovls;     // The records of the batch's piles
+    int      novl;
+    int      nmax;
+    int64    seqno;    // Its position in the output order
+    int      state;
+    char    *text;     // The rendered pileups once BATCH_DONE
+    size_t   tlen;
+} Pile_Batch;
+
+typedef struct {
+    HITS_DBX      dbx1, dbx2;    // Private copies so that reads are loaded through private files
+    int           istwo;
+    OverlapGroup *ovlgrps;
+    char         *abuffer;
+    char         *buffer;
+    int64         bsize;
+    int           skip, max_hit_count;
+    pthread_t     thread;
+} Pile_Arg;
+
+static Pile_Batch     *Batch;      // Ring of NSLOT batches, batch k is in slot k % NSLOT
+static int             NSLOT;
+static int64           NFILL;      // # of batches filled by the reader, rendered, and output
+static int64           NWORK;
+static int64           NOUT;
+static int             READING;    // Set until the reader has submitted its last batch
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  FILLED = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  DONE = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  EMPTIED = PTHREAD_COND_INITIALIZER;
+
+//  Render the pile of n records of an A-read exactly as the serial loop of main does
+
+static void render_pile(FILE *out, Pile_Arg *arg, Overlap *ovls, int n) {
+    HITS_DB  *db1 = &arg->dbx1.db;
+    HITS_DB  *db2 = arg->istwo ? &arg->dbx2.db : db1;
+    Alignment aln;
+    int       hit_count, skip_rest;
+    int       i;
+
+    Load_ReadX(&arg->dbx1, ovls[0].aread, arg->abuffer, 2);
+    fprintf(out, "%08d %s\n", ovls[0].aread, arg->abuffer);
+
+    hit_count = -1;
+    skip_rest = 0;
+    for (i = 0; i < n && skip_rest == 0; i++) {
+        Overlap *ovl = ovls+i;
+
+        aln.alen  = db1->reads[ovl->aread].rlen;
+        aln.blen  = db2->reads[ovl->bread].rlen;
+        aln.flags = ovl->flags;
+        if (add_overlap(arg->ovlgrps, &aln, ovl, hit_count))
+            hit_count ++;
+        if ((hit_count+1) > MAX_OVERLAPS)
+            skip_rest = 1;
+        if (arg->skip == 1) {
+            if ( ((int64) aln.alen < (int64) aln.blen) && ((int64) ovl->path.abpos < 1) && ((int64) aln.alen - (int64) ovl->path.aepos < 1) ) {
+                fprintf(out, "* *\n");
+                skip_rest = 1;
+            }
+        }
+    }
+
+    print_hits(out, arg->ovlgrps, hit_count, arg->istwo ? &arg->dbx2 : &arg->dbx1,
+               arg->buffer, arg->bsize, arg->max_hit_count);
+}
+
+static void *pile_thread(void *varg) {
+    Pile_Arg   *arg = (Pile_Arg *) varg;
+    Pile_Batch *b;
+    FILE       *out;
+    int         i, j;
+
+    while (1) {
+        pthread_mutex_lock(&LOCK);
+        while (NWORK >= NFILL && READING)
+            pthread_cond_wait(&FILLED, &LOCK);
+        if (NWORK >= NFILL) {
+            pthread_mutex_unlock(&LOCK);
+            break;
+        }
+        b = Batch + (NWORK % NSLOT);
+        b->state = BATCH_BUSY;
+        NWORK += 1;
+        pthread_mutex_unlock(&LOCK);
+
+        out = open_memstream(&b->text, &b->tlen);
+        if (out == NULL) {
+            fprintf(stderr, "%s: Could not open an output buffer\n", Prog_Name);
+            exit (1);
+        }
+        for (i = 0; i < b->novl; i = j) {
+            for (j = i+1; j < b->novl && b->ovls[j].aread == b->ovls[i].aread; j++)
+                ;
+            render_pile(out, arg, b->ovls+i, j-i);
+        }
+        fclose(out);
+
+        pthread_mutex_lock(&LOCK);
+        b->state = BATCH_DONE;
+        pthread_cond_broadcast(&DONE);
+        pthread_mutex_unlock(&LOCK);
+    }
+    return (NULL);
+}
+
+static void *write_thread(void *varg) {
+    Pile_Batch *b;
+
+    (void) varg;
+    while (1) {
+        pthread_mutex_lock(&LOCK);
+        b = Batch + (NOUT % NSLOT);
+        while ((NOUT >= NFILL && READING) || (NOUT < NFILL && b->state != BATCH_DONE))
+            pthread_cond_wait(&DONE, &LOCK);
+        if (NOUT >= NFILL) {
+            pthread_mutex_unlock(&LOCK);
+            break;
+        }
+        pthread_mutex_unlock(&LOCK);
+
+        fwrite(b->text, 1, b->tlen, stdout);
+        free(b->text);
+        b->text = NULL;
+
+        pthread_mutex_lock(&LOCK);
+        b->state = BATCH_EMPTY;
+        NOUT += 1;
+        pthread_cond_signal(&EMPTIED);
+        pthread_mutex_unlock(&LOCK);
+    }
+    return (NULL);
+}
+
+//  Hand the batch of records being collected in *cur to the workers, in exchange for the
+//    record array of the slot it goes to once the writer has emptied it
+
+static void submit_batch(Overlap **cur, int *ncur, int *mcur) {
+    Pile_Batch *b;
+    Overlap    *o;
+    int         m;
+
+    pthread_mutex_lock(&LOCK);
+    b = Batch + (NFILL % NSLOT);
+    while (b->state != BATCH_EMPTY)
+        pthread_cond_wait(&EMPTIED, &LOCK);
+    pthread_mutex_unlock(&LOCK);
+
+    o = b->ovls;
+    m = b->nmax;
+    b->ovls  = *cur;
+    b->novl  = *ncur;
+    b->nmax  = *mcur;
+    *cur  = o;
+    *ncur = 0;
+    *mcur = m;
+
+    pthread_mutex_lock(&LOCK);
+    b->seqno = NFILL;
+    b->state = BATCH_FILLED;
+    NFILL   += 1;
+    pthread_cond_broadcast(&FILLED);
+    pthread_mutex_unlock(&LOCK);
+}
+
+//  A private copy of a DB whose reads are not in memory gets its own .bps stream, opened
+//    here as Catenate is not thread safe, and if the DB has a read cache the copy gets its
+//    own of 'bytes' bytes
+
+static void copy_dbx(HITS_DBX *copy, HITS_DBX *dbx, int64 bytes) {
+    *copy = *dbx;
+    if (!copy->db.loaded) {
+        copy->db.bases = Fopen(Catenate(copy->db.path,"","",".bps"),"r");
+        if (copy->db.bases == NULL)
+            exit (1);
+    }
+    copy->cache = NULL;
+    if (dbx->cache != NULL)
+        Cache_DBX(copy, bytes);
+}
+
+//  Free a copy, adding the hits and misses of its cache to *hits and *misses
+
+static void free_dbx_copy(HITS_DBX *copy, int64 *hits, int64 *misses) {
+    int64 h, m;
+
+    Cache_Stats_DBX(copy, &h, &m);
+    *hits   += h;
+    *misses += m;
+    Uncache_DBX(copy);
+    if (!copy->db.loaded)
+        fclose((FILE *) copy->db.bases);
 }
 
 static char *Usage[] =
-    { "[-mfsocargUFM] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] ",
+    { "[-mfsocargUFMv] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] [-T<int(1)>] [-C<int(0)>]",
       "    <src1:db|dam> [ <src2:db|dam> ] <align:las> [ <reads:FILE> | <reads:range> ... ]"
     };
 
@@ -189,20 +399,24 @@ int main(int argc, char *argv[])
   Overlap   _ovl, *ovl = &_ovl;
   Alignment _aln, *aln = &_aln;
 
-  FILE   *input;
-  int64   novl;
-  int     tspace, tbytes, small;
-  int     reps, *pts;
-  int     input_pts;
-
-  int     ALIGN, CARTOON, REFERENCE, FLIP;
-  int     INDENT, WIDTH, BORDER, UPPERCASE;
-  int     ISTWO;
-  int     MAP;
-  int     FALCON, OVERLAP, M4OVL;
+  Las_File *input;
+  int64     novl;
+  int       tspace, tbytes, small;
+  int       reps, *pts;
+  int       input_pts;
+
+  int       ALIGN, CARTOON, REFERENCE, FLIP;
+  int       INDENT, WIDTH, BORDER, UPPERCASE;
+  int       ISTWO;
+  int       MAP;
+  int       FALCON, OVERLAP, M4OVL;
   // XXX: MAX_HIT_COUNT should be renamed
-  int     SEED_MIN, MAX_HIT_COUNT, SKIP;
-  int     PRELOAD;
+  int       SEED_MIN, MAX_HIT_COUNT, SKIP;
+  int       PRELOAD;
+  int       NTHREADS;
+  int       CACHE;
+  int       VERBOSE;
+  int64     chits, cmiss;
 
   //  Process options
 
@@ -226,13 +440,16 @@ int main(int argc, char *argv[])
     CARTOON   = 0;
     FLIP      = 0;
     MAX_HIT_COUNT = 400;
+    NTHREADS  = 1;
+    CACHE     = 0;
+    chits     = cmiss = 0;
 
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("smfocargUFMP")
+            ARG_FLAGS("smfocargUFMPv")
             break;
           case 'i':
             ARG_NON_NEGATIVE(INDENT,"Indent")
@@ -246,6 +463,12 @@ int main(int argc, char *argv[])
           case 'H':
             ARG_POSITIVE(SEED_MIN,"seed threshold (in bp)")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'C':
+            ARG_NON_NEGATIVE(CACHE,"Read cache size (in MB)")
+            break;
           case 'n':
             ARG_POSITIVE(MAX_HIT_COUNT, "max numer of supporting read ouput (used for FALCON consensus. default 400, max: 2000)")
             if (MAX_HIT_COUNT > 2000) MAX_HIT_COUNT = 2000;
@@ -265,6 +488,7 @@ int main(int argc, char *argv[])
     M4OVL     = flags['m'];
     FALCON    = flags['f'];
     SKIP      = flags['s'];
+    VERBOSE   = flags['v'];
     GROUP     = flags['g'];
     PRELOAD   = flags['P']; // Preload DB reads, if possible.
 
@@ -317,6 +541,11 @@ int main(int argc, char *argv[])
         db2 = db1;
       }
     Trim_DB(db1);
+
+    //  Cache the decoded B-reads, which are also the A-reads if there is one DB
+
+    if (CACHE > 0)
+      Cache_DBX(dbx2,CACHE*1000000ll);
   }
 
   //  Process read index arguments into a sorted list of read ranges
@@ -452,14 +681,15 @@ int main(int argc, char *argv[])
     pwd   = PathTo(argv[2+ISTWO]);
     root  = Root(argv[2+ISTWO],".las");
     over  = Catenate(pwd,"/",root,".las");
-    input = Fopen(over,"r");
+    if (ALIGN || REFERENCE)
+      input = Open_Las(over,LAS_SEQUENTIAL);
+    else
+      input = Open_Las(over,LAS_HEADERS);
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_ERROR
+    novl   = input->novl;
+    tspace = input->tspace;
 
     if (tspace == 0) {
         printf("\nCRITICAL ERROR: tspace=0 in '%s'", root);
@@ -488,6 +718,7 @@ int main(int argc, char *argv[])
   //  Read the file and display selected records
 
   { int        j;
+    Overlap   *next;
     uint16    *trace;
     Work_Data *work;
     int        tmax;
@@ -504,14 +735,25 @@ int main(int argc, char *argv[])
     int        tp_wide;
     int        blast, match, seen, lhalf, rhalf;
     int        hit_count;
+    int        ngrps;
+
+    int        PARALLEL;
+    Pile_Arg  *parg;
+    pthread_t  writer;
+    Overlap   *cur;
+    int        ncur, mcur;
 
     aln->path = &(ovl->path);
+    if (input->omax >= 0 && input->omax < MAX_OVERLAPS)  //  No pile is bigger
+      ngrps = input->omax+1;
+    else
+      ngrps = MAX_OVERLAPS+1;
     if (ALIGN || REFERENCE || FALCON)
       { work = New_Work_Data();
         abuffer = New_Read_Buffer(db1);
         bbuffer = New_Read_Buffer(db2);
         if (FALCON) {
-            ovlgrps = calloc(sizeof(OverlapGroup), MAX_OVERLAPS+1);
+            ovlgrps = calloc(sizeof(OverlapGroup), ngrps);
             hit_count = -1;
         }
       }
@@ -522,13 +764,59 @@ int main(int argc, char *argv[])
       }
 
     tmax  = 1000;
+    if (input->tmax > tmax)
+      tmax = input->tmax;
     trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
     if (trace == NULL)
       exit (1);
 
+    //  With -f and -T render the pileups in parallel, unless other displays are interleaved
+
+    PARALLEL = (FALCON && NTHREADS > 1 && !(M4OVL || MAP || ALIGN || CARTOON || REFERENCE));
+    parg     = NULL;
+    cur      = NULL;
+    ncur     = mcur = 0;
+    if (PARALLEL)
+      { int t;
+
+        NSLOT = 2*NTHREADS + 2;
+        Batch = (Pile_Batch *) Malloc(sizeof(Pile_Batch)*NSLOT,"Allocating pile batches");
+        parg  = (Pile_Arg *) Malloc(sizeof(Pile_Arg)*NTHREADS,"Allocating thread records");
+        if (Batch == NULL || parg == NULL)
+          exit (1);
+        for (t = 0; t < NSLOT; t++)
+          { Batch[t].ovls  = NULL;
+            Batch[t].nmax  = 0;
+            Batch[t].state = BATCH_EMPTY;
+            Batch[t].text  = NULL;
+          }
+        NFILL   = NWORK = NOUT = 0;
+        READING = 1;
+
+        for (t = 0; t < NTHREADS; t++)
+          { copy_dbx(&parg[t].dbx1,dbx1,(CACHE*1000000ll)/NTHREADS);
+            if (ISTWO)
+              copy_dbx(&parg[t].dbx2,dbx2,(CACHE*1000000ll)/NTHREADS);
+            parg[t].istwo   = ISTWO;
+            parg[t].ovlgrps = (OverlapGroup *) Malloc(sizeof(OverlapGroup)*ngrps,
+                                                      "Allocating overlap groups");
+            parg[t].abuffer = New_Read_Buffer(db1);
+            parg[t].bsize   = sizeof(buffer);
+            parg[t].buffer  = (char *) Malloc(parg[t].bsize,"Allocating hit buffer");
+            parg[t].skip    = SKIP;
+            parg[t].max_hit_count = MAX_HIT_COUNT;
+            if (parg[t].ovlgrps == NULL || parg[t].abuffer == NULL || parg[t].buffer == NULL)
+              exit (1);
+          }
+        for (t = 0; t < NTHREADS; t++)
+          pthread_create(&parg[t].thread,NULL,pile_thread,parg+t);
+        pthread_create(&writer,NULL,write_thread,NULL);
+      }
+
     in  = 0;
     npt = pts[0];
     idx = 1;
+    Seek_Las(input,npt-1);
 
     ar_wide = Number_Digits((int64) db1->nreads);
     br_wide = Number_Digits((int64) db2->nreads);
@@ -570,7 +858,7 @@ int main(int argc, char *argv[])
     match = 0;
     seen  = 0;
     lhalf = rhalf = 0;
-    for (j = 0; j < novl; j++)
+    for (j = 0; (next = Next_Las(input)) != NULL; j++)
        //  Read it in
 
       {
@@ -591,15 +879,17 @@ int main(int argc, char *argv[])
 
 
 
-        Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+        *ovl = *next;
+        if (small && (ALIGN || REFERENCE))
+          { if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            memcpy(trace,ovl->path.trace,ovl->path.tlen*tbytes);
+            ovl->path.trace = (void *) trace;
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
 
         //  Determine if it should be displayed
 
@@ -625,7 +915,11 @@ int main(int argc, char *argv[])
               }
           }
         if (!in)
-          continue;
+          { if (npt == INT32_MAX)
+              break;
+            Seek_Las(input,npt-1);
+            continue;
+          }
 
         //  Display it
 
@@ -634,6 +928,19 @@ int main(int argc, char *argv[])
         aln->flags = ovl->flags;
         tps        = ((ovl->path.aepos-1)/tspace - ovl->path.abpos/tspace);
 
+        if (PARALLEL)
+          { if (ncur >= PILE_BATCH && cur[ncur-1].aread != ovl->aread)
+              submit_batch(&cur,&ncur,&mcur);
+            if (ncur >= mcur)
+              { mcur = 1.2*ncur + PILE_BATCH;
+                cur  = (Overlap *) Realloc(cur,sizeof(Overlap)*mcur,"Allocating pile batch");
+                if (cur == NULL)
+                  exit (1);
+              }
+            cur[ncur++] = *ovl;
+            continue;
+          }
+
         if (OVERLAP && !FALCON)
           { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
               continue;
@@ -740,7 +1047,7 @@ int main(int argc, char *argv[])
                 skip_rest = 0;
             }
             if (p_aread != ovl -> aread ) {
-                print_hits(hit_count, dbx2, bbuffer, buffer, (int64)sizeof(buffer), MAX_HIT_COUNT);
+                print_hits(stdout, ovlgrps, hit_count, dbx2, buffer, (int64)sizeof(buffer), MAX_HIT_COUNT);
                 hit_count = -1;
 
                 Load_ReadX(dbx1, ovl->aread, abuffer, 2);
@@ -750,7 +1057,7 @@ int main(int argc, char *argv[])
             }
 
             if (skip_rest == 0) {
-                if (add_overlap(aln, ovl, hit_count))
+                if (add_overlap(ovlgrps, aln, ovl, hit_count))
                     hit_count ++;
 
                 if ((hit_count+1) > MAX_OVERLAPS)
@@ -863,6 +1170,45 @@ int main(int argc, char *argv[])
           }
       }
 
+    if (next == NULL && !At_End_Las(input))
+      SYSTEM_ERROR
+
+    //  Hand over the last batch, and wait for the workers and the writer to finish
+
+    if (PARALLEL)
+      { int t;
+
+        if (ncur > 0)
+          submit_batch(&cur,&ncur,&mcur);
+
+        pthread_mutex_lock(&LOCK);
+        READING = 0;
+        pthread_cond_broadcast(&FILLED);
+        pthread_cond_broadcast(&DONE);
+        pthread_mutex_unlock(&LOCK);
+
+        for (t = 0; t < NTHREADS; t++)
+          pthread_join(parg[t].thread,NULL);
+        pthread_join(writer,NULL);
+
+        if (NFILL > 0)
+          printf("- -\n");
+
+        for (t = 0; t < NTHREADS; t++)
+          { free_dbx_copy(&parg[t].dbx1,&chits,&cmiss);
+            if (ISTWO)
+              free_dbx_copy(&parg[t].dbx2,&chits,&cmiss);
+            free(parg[t].ovlgrps);
+            free(parg[t].abuffer-1);
+            free(parg[t].buffer);
+          }
+        for (t = 0; t < NSLOT; t++)
+          free(Batch[t].ovls);
+        free(Batch);
+        free(parg);
+        free(cur);
+      }
+
     // debugging
     time_t mytime = time(NULL);
     fprintf(stderr, "\ncompleted loop record j = %d out of %lld at %s %s\n", j, novl, argv[3], ctime(&mytime));
@@ -871,13 +1217,14 @@ int main(int argc, char *argv[])
 
     if (FALCON && hit_count != -1)
       {
-        print_hits(hit_count, dbx2, bbuffer, buffer, (int64)sizeof(buffer), MAX_HIT_COUNT);
+        print_hits(stdout, ovlgrps, hit_count, dbx2, buffer, (int64)sizeof(buffer), MAX_HIT_COUNT);
         printf("- -\n");
         free(ovlgrps);
       }
 
 
     free(trace);
+    Close_Las(input);
     if (ALIGN || FALCON)
       { free(bbuffer-1);
         free(abuffer-1);
@@ -885,6 +1232,22 @@ int main(int argc, char *argv[])
       }
   }
 
+  if (VERBOSE && CACHE > 0)
+    { int64 h, m;
+
+      Cache_Stats_DBX(dbx2,&h,&m);
+      chits += h;
+      cmiss += m;
+      fprintf(stderr,"  Read cache: ");
+      Print_Number(chits,0,stderr);
+      fprintf(stderr," hits, ");
+      Print_Number(cmiss,0,stderr);
+      fprintf(stderr," misses");
+      if (chits+cmiss > 0)
+        fprintf(stderr," (%.1f%% hits)",(100.*chits)/(chits+cmiss));
+      fprintf(stderr,"\n");
+    }
+
   Close_DBX(dbx1);
   if (ISTWO)
     Close_DBX(dbx2);
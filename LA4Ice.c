@@ -57,6 +57,7 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage[] =
     { "[-carmEUF] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] ",
@@ -77,16 +78,16 @@ int main(int argc, char *argv[])
   Overlap   _ovl, *ovl = &_ovl;
   Alignment _aln, *aln = &_aln;
 
-  FILE   *input;
-  int64   novl;
-  int     tspace, tbytes, small;
-  int     reps, *pts;
+  Las_File *input;
+  int64     novl;
+  int       tspace, tbytes, small;
+  int       reps, *pts;
 
-  int     ALIGN, CARTOON, REFERENCE, FLIP;
-  int     INDENT, WIDTH, BORDER, UPPERCASE;
-  int     ISTWO;
-  int     ICE_FL;
-  int     M4OVL;
+  int       ALIGN, CARTOON, REFERENCE, FLIP;
+  int       INDENT, WIDTH, BORDER, UPPERCASE;
+  int       ISTWO;
+  int       ICE_FL;
+  int       M4OVL;
 
   //  Process options
 
@@ -254,14 +255,15 @@ int main(int argc, char *argv[])
     pwd   = PathTo(argv[2+ISTWO]);
     root  = Root(argv[2+ISTWO],".las");
     over  = Catenate(pwd,"/",root,".las");
-    input = Fopen(over,"r");
+    if (ALIGN || REFERENCE)
+      input = Open_Las(over,LAS_SEQUENTIAL);
+    else
+      input = Open_Las(over,LAS_HEADERS);
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_ERROR
+    novl   = input->novl;
+    tspace = input->tspace;
 
     if (tspace <= TRACE_XOVR)
       { small  = 1;
@@ -284,7 +286,7 @@ int main(int argc, char *argv[])
 
   //  Read the file and display selected records
   if (tspace > 0)
-  { int        j;
+  { Overlap   *next;
     uint16    *trace;
     Work_Data *work;
     int        tmax;
@@ -310,6 +312,8 @@ int main(int argc, char *argv[])
       }
 
     tmax  = 1000;
+    if (input->tmax > tmax)
+      tmax = input->tmax;
     trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
     if (trace == NULL)
       exit (1);
@@ -317,6 +321,7 @@ int main(int argc, char *argv[])
     in  = 0;
     npt = pts[0];
     idx = 1;
+    Seek_Las(input,npt-1);
 
     ar_wide = Number_Digits((int64) db1->nreads);
     br_wide = Number_Digits((int64) db2->nreads);
@@ -347,19 +352,21 @@ int main(int argc, char *argv[])
 
     //  For each record do
 
-    for (j = 0; j < novl; j++)
+    while ((next = Next_Las(input)) != NULL)
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+      { *ovl = *next;
+        if (small && (ALIGN || REFERENCE))
+          { if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            memcpy(trace,ovl->path.trace,ovl->path.tlen*tbytes);
+            ovl->path.trace = (void *) trace;
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
 
         //  Determine if it should be displayed
 
@@ -385,7 +392,11 @@ int main(int argc, char *argv[])
               }
           }
         if (!in)
-          continue;
+          { if (npt == INT32_MAX)
+              break;
+            Seek_Las(input,npt-1);
+            continue;
+          }
 
         // move calculation of sStart and sEnd (bbpos, bepos) up here since both ICE and M4OVL uses it
         int64 bbpos, bepos;
@@ -547,7 +558,11 @@ int main(int argc, char *argv[])
           }
       }
 
+    if (next == NULL && !At_End_Las(input))
+      SYSTEM_ERROR
+
     free(trace);
+    Close_Las(input);
     if (ALIGN)
       { free(bbuffer-1);
         free(abuffer-1);
@@ -18,16 +18,17 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage = "[-v] <source:las> > <target>.las";
 
 #define MEMORY   1000   //  How many megabytes for output buffer
 
 int main(int argc, char *argv[])
-{ char     *iblock, *oblock;
-  FILE     *input;
-  int64     novl, bsize, ovlsize, ptrsize;
-  int       tspace, tbytes;
+{ char     *oblock;
+  Las_File *input;
+  int64     novl, bsize;
+  int       tspace;
   char     *pwd, *root, *root2;
 
   int       VERBOSE;
@@ -55,14 +56,10 @@ int main(int argc, char *argv[])
       }
   }
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
   bsize   = MEMORY * 1000000ll;
   oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
+  if (oblock == NULL)
     exit (1);
-  iblock += ptrsize;
 
   pwd    = PathTo(argv[1]);
   root   = Root(argv[1],".las");
@@ -78,45 +75,32 @@ int main(int argc, char *argv[])
     }
   *root2++ = '\0';
 
-  { int64    povl;
-    int      i, mspace;
+  { int      i;
 
     novl   = 0;
     tspace = 0;
-    mspace = 0;
-    tbytes = 0;
     for (i = 0; 1; i++)
       { char *name = Catenate(pwd,"/",Numbered_Suffix(root,i+1,root2),".las");
-        if ((input = fopen(name,"r")) == NULL) break;
+        if (access(name,R_OK) != 0) break;
+        if ((input = Open_Las(name,LAS_SEQUENTIAL)) == NULL)
+          exit (1);
 
-        if (fread(&povl,sizeof(int64),1,input) != 1)
-          SYSTEM_ERROR
-        novl += povl;
-        if (fread(&mspace,sizeof(int),1,input) != 1)
-          SYSTEM_ERROR
+        novl += input->novl;
         if (i == 0)
-          { tspace = mspace;
-            if (tspace <= TRACE_XOVR)
-              tbytes = sizeof(uint8);
-            else
-              tbytes = sizeof(uint16);
-          }
-        else if (tspace != mspace)
-          { fprintf(stderr,"%s: PT-point spacing conflict (%d vs %d)\n",Prog_Name,tspace,mspace);
+          tspace = input->tspace;
+        else if (tspace != input->tspace)
+          { fprintf(stderr,"%s: PT-point spacing conflict (%d vs %d)\n",Prog_Name,tspace,
+                           input->tspace);
             exit (1);
           }
 
-        fclose(input);
+        Close_Las(input);
       }
     fwrite(&novl,sizeof(int64),1,stdout);
     fwrite(&tspace,sizeof(int),1,stdout);
   }
 
   { int      i, j;
-    Overlap *w;
-    int64    tsize, povl;
-    int      mspace;
-    char    *iptr, *itop;
     char    *optr, *otop;
 
     optr = oblock;
@@ -124,56 +108,28 @@ int main(int argc, char *argv[])
 
     for (i = 0; 1; i++)
       { char *name = Catenate(pwd,"/",Numbered_Suffix(root,i+1,root2),".las");
-        if ((input = fopen(name,"r")) == NULL) break;
-
-        if (fread(&povl,sizeof(int64),1,input) != 1)
-          SYSTEM_ERROR
-        if (fread(&mspace,sizeof(int),1,input) != 1)
-          SYSTEM_ERROR
+        if (access(name,R_OK) != 0) break;
+        if ((input = Open_Las(name,LAS_SEQUENTIAL)) == NULL)
+          exit (1);
 
         if (VERBOSE)
-          fprintf(stderr,"  Concatenating %s: %lld la\'s\n",Numbered_Suffix(root,i+1,root2),povl);
-
-        iptr = iblock;
-        itop = iblock + fread(iblock,1,bsize,input);
-
-        for (j = 0; j < povl; j++)
-          { if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-              }
+          fprintf(stderr,"  Concatenating %s: %lld la\'s\n",Numbered_Suffix(root,i+1,root2),
+                         input->novl);
 
-            w = (Overlap *) (iptr - ptrsize);
-            tsize = w->path.tlen*tbytes;
+        for (j = 0; j < input->novl; j++)
+          { if (Next_Las(input) == NULL)
+              SYSTEM_ERROR
 
-            if (optr + ovlsize + tsize > otop)
+            if (optr + input->span > otop)
               { fwrite(oblock,1,optr-oblock,stdout);
                 optr = oblock;
               }
 
-            memcpy(optr,iptr,ovlsize);
-            optr += ovlsize;
-            iptr += ovlsize;
-
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-              }
-            
-            memcpy(optr,iptr,tsize);
-            optr += tsize;
-            iptr += tsize;
+            memcpy(optr,input->rec,input->span);
+            optr += input->span;
           }
 
-        fclose(input);
+        Close_Las(input);
       }
 
     if (optr > oblock)
@@ -186,7 +142,6 @@ int main(int argc, char *argv[])
   free(pwd);
   free(root);
   free(oblock);
-  free(iblock-ptrsize);
 
   exit (0);
 }
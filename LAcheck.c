@@ -17,11 +17,10 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage = "[-vS] <src1:db|dam> [ <src2:db|dam> ] <align:las> ...";
 
-#define MEMORY   1000   //  How many megabytes for output buffer
-
 int main(int argc, char *argv[])
 { HITS_DB   _db1,  *db1  = &_db1;
   HITS_DB   _db2,  *db2  = &_db2;
@@ -100,47 +99,32 @@ int main(int argc, char *argv[])
     free(pwd);
   }
 
-  { char      *iblock;
-    int64      bsize, ovlsize, ptrsize;
-    int        i, j;
+  { int        i, j;
     HITS_READ *reads1  = db1->reads;
     int        nreads1 = db1->nreads;
     HITS_READ *reads2  = db2->reads;
     int        nreads2 = db2->nreads;
 
-    //  Setup IO buffers
-
-    ptrsize = sizeof(void *);
-    ovlsize = sizeof(Overlap) - ptrsize;
-    bsize   = MEMORY * 1000000ll;
-    iblock  = (char *) Malloc(bsize+ptrsize,"Allocating input block");
-    if (iblock == NULL)
-      exit (1);
-    iblock += ptrsize;
-
     //  For each file do
 
     status = 0;
     for (i = 2+ISTWO; i < argc; i++)
       { char     *pwd, *root;
-        FILE     *input;
-        char     *iptr, *itop;
+        Las_File *input;
         Overlap   last, prev;
         int64     novl;
-        int       tspace, tbytes;
+        int       tspace;
         int       has_chains;
 
         //  Establish IO and (novl,tspace) header
 
         pwd    = PathTo(argv[i]);
         root   = Root(argv[i],".las");
-        if ((input = Fopen(Catenate(pwd,"/",root,".las"),"r")) == NULL)
+        if ((input = Open_Las(Catenate(pwd,"/",root,".las"),LAS_SEQUENTIAL)) == NULL)
           goto error;
 
-        if (fread(&novl,sizeof(int64),1,input) != 1)
-          SYSTEM_ERROR
-        if (fread(&tspace,sizeof(int),1,input) != 1)
-          SYSTEM_ERROR
+        novl   = input->novl;
+        tspace = input->tspace;
         if (novl < 0)
           { if (VERBOSE)
               fprintf(stderr,"  %s: Number of alignments < 0\n",root);
@@ -152,14 +136,6 @@ int main(int argc, char *argv[])
             goto error;
           }
 
-        if (tspace <= TRACE_XOVR)
-          tbytes = sizeof(uint8);
-        else
-          tbytes = sizeof(uint16);
-
-        iptr = iblock;
-        itop = iblock + fread(iblock,1,bsize,input);
-
         //  For each record in file do
 
         has_chains = 0;
@@ -170,45 +146,19 @@ int main(int argc, char *argv[])
         last.path.bepos = last.path.aepos = 0;
         prev = last;
         for (j = 0; j < novl; j++)
-          { Overlap ovl;
-            int     tsize;
-            int     equal;
+          { Overlap  ovl;
+            Overlap *next;
+            int      equal;
 
             //  Fetch next record
 
-            if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-                if (iptr + ovlsize > itop)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Too few alignment records\n",root);
-                    goto error;
-                  }
-              }
-
-            ovl   = *((Overlap *) (iptr - ptrsize));
-            iptr += ovlsize;
-            tsize = ovl.path.tlen*tbytes;
-
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-                if (iptr + tsize > itop)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Too few alignment records\n",root);
-                    goto error;
-                  }
+            next = Next_Las(input);
+            if (next == NULL)
+              { if (VERBOSE)
+                  fprintf(stderr,"  %s: Too few alignment records\n",root);
+                goto error;
               }
-            ovl.path.trace = iptr;
-            iptr += tsize;
+            ovl = *next;
 
             //  Basic checks
 
@@ -328,7 +278,7 @@ int main(int argc, char *argv[])
 
         //  File processing epilog: Check all data read and print OK if -v
 
-        if (iptr < itop)
+        if (!At_End_Las(input))
           { if (VERBOSE)
               fprintf(stderr,"  %s: Too many alignment records\n",root);
             goto error;
@@ -345,12 +295,10 @@ int main(int argc, char *argv[])
         status = 1;
       cleanup:
         if (input != NULL)
-          fclose(input);
+          Close_Las(input);
         free(pwd);
         free(root);
       }
-
-    free(iblock-ptrsize);
   }
 
   Close_DB(db1);
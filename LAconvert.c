@@ -0,0 +1,155 @@
+/*******************************************************************************************
+ *
+ *  Convert an overlap file <source>.las to the other .las format in <target>.las, i.e.
+ *    compress a plain (version 1) file, or decompress a compressed (version 2) file.
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "DB.h"
+#include "align.h"
+#include "las.h"
+
+static char *Usage = "[-v] <source:las> <target:las>";
+
+#define MEMORY   1000   //  How many megabytes for output buffer
+
+int main(int argc, char *argv[])
+{ Las_File *input;
+  Overlap  *ovl;
+  char     *pwd, *root, *target;
+  int64     j, novl;
+
+  int       VERBOSE;
+
+  //  Process options
+
+  { int i, k;
+    int flags[128];
+
+    ARG_INIT("LAconvert")
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        { ARG_FLAGS("v") }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+
+    if (argc != 3)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        exit (1);
+      }
+  }
+
+  pwd   = PathTo(argv[1]);
+  root  = Root(argv[1],".las");
+  input = Open_Las(Catenate(pwd,"/",root,".las"),LAS_SEQUENTIAL);
+  if (input == NULL)
+    exit (1);
+  free(pwd);
+  free(root);
+
+  pwd    = PathTo(argv[2]);
+  root   = Root(argv[2],".las");
+  target = Strdup(Catenate(pwd,"/",root,".las"),"Allocating target name");
+  if (target == NULL)
+    exit (1);
+  free(pwd);
+  free(root);
+
+  novl = input->novl;
+  if (VERBOSE)
+    { fprintf(stderr,"  %s %s: ",input->version == 1 ? "Compressing" : "Decompressing",
+                                 input->name);
+      Print_Number(novl,0,stderr);
+      fprintf(stderr," records\n");
+    }
+
+  //  Plain to compressed: encode each record
+
+  if (input->version == 1)
+    { Las2_File *output;
+
+      output = Create_Las2(target,input->tspace,novl);
+      if (output == NULL)
+        exit (1);
+
+      for (j = 0; j < novl; j++)
+        { if ((ovl = Next_Las(input)) == NULL)
+            break;
+          if (Write_Las2(output,ovl))
+            exit (1);
+        }
+
+      if (Close_Las2(output))
+        exit (1);
+    }
+
+  //  Compressed to plain: the records are delivered in plain form, copy them verbatim
+
+  else
+    { FILE  *output;
+      char  *oblock, *optr, *otop;
+      int64  bsize;
+
+      output = Fopen(target,"w");
+      if (output == NULL)
+        exit (1);
+
+      bsize  = MEMORY * 1000000ll;
+      oblock = (char *) Malloc(bsize,"Allocating output block");
+      if (oblock == NULL)
+        exit (1);
+      optr = oblock;
+      otop = oblock + bsize;
+
+      fwrite(&novl,sizeof(int64),1,output);
+      fwrite(&(input->tspace),sizeof(int),1,output);
+
+      for (j = 0; j < novl; j++)
+        { if ((ovl = Next_Las(input)) == NULL)
+            break;
+
+          if (optr + input->span > otop)
+            { fwrite(oblock,1,optr-oblock,output);
+              optr = oblock;
+            }
+          if (input->span > bsize)
+            fwrite(input->rec,1,input->span,output);
+          else
+            { memcpy(optr,input->rec,input->span);
+              optr += input->span;
+            }
+        }
+
+      if (optr > oblock)
+        fwrite(oblock,1,optr-oblock,output);
+      if (fclose(output) != 0)
+        { fprintf(stderr,"%s: System error, close of %s failed!\n",Prog_Name,target);
+          exit (1);
+        }
+      free(oblock);
+    }
+
+  if (j < novl)
+    { fprintf(stderr,"%s: %s has only %lld of the %lld records its header states\n",
+                     Prog_Name,input->name,j,novl);
+      exit (1);
+    }
+
+  Close_Las(input);
+  free(target);
+
+  exit (0);
+}
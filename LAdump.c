@@ -20,6 +20,7 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage =
     "[-cdt] [-o] <src1:db|dam> [ <src2:db|dam> ] <align:las> [ <reads:FILE> | <reads:range> ... ]";
@@ -35,17 +36,18 @@ static int ORDER(const void *l, const void *r)
 int main(int argc, char *argv[])
 { HITS_DB   _db1, *db1 = &_db1; 
   HITS_DB   _db2, *db2 = &_db2; 
-  Overlap   _ovl, *ovl = &_ovl;
+  Overlap  *ovl;
 
-  FILE   *input;
-  int64   novl;
-  int     tspace, tbytes, small;
-  int     reps, *pts;
-  int     input_pts;
+  Las_File *input;
+  char     *over;
+  int64     novl;
+  int       tspace, tbytes, small;
+  int       reps, *pts;
+  int       input_pts;
 
-  int     OVERLAP;
-  int     DOCOORDS, DODIFFS, DOTRACE;
-  int     ISTWO;
+  int       OVERLAP;
+  int       DOCOORDS, DODIFFS, DOTRACE;
+  int       ISTWO;
 
   //  Process options
 
@@ -248,20 +250,17 @@ int main(int argc, char *argv[])
 
   //  Initiate file reading and read header
   
-  { char  *over, *pwd, *root;
+  { char  *pwd, *root;
 
     pwd   = PathTo(argv[2+ISTWO]);
     root  = Root(argv[2+ISTWO],".las");
-    over  = Catenate(pwd,"/",root,".las");
-    input = Fopen(over,"r");
+    over  = Strdup(Catenate(pwd,"/",root,".las"),"Allocating .las name");
+    input = Open_Las(over,LAS_HEADERS);
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_ERROR
-
+    novl   = input->novl;
+    tspace = input->tspace;
     if (tspace <= TRACE_XOVR)
       { small  = 1;
         tbytes = sizeof(uint8);
@@ -277,7 +276,7 @@ int main(int argc, char *argv[])
 
   //  Scan to count sizes of things
 
-  { int   j, al, tlen;
+  { int   al, tlen;
     int   in, npt, idx, ar;
     int64 novls, odeg, omax, sdeg, smax, ttot, tmax;
 
@@ -290,72 +289,89 @@ int main(int argc, char *argv[])
     novls = omax = smax = ttot = tmax = 0;
     sdeg  = odeg = 0;
 
-    al = 0;
-    for (j = 0; j < novl; j++)
+    //  If all of the file is wanted and it has an index, the index already has its statistics
 
-       //  Read it in
+    if (!OVERLAP && pts[0] == 1 && pts[1] == INT32_MAX && input->omax >= 0)
+      { novls = novl;
+        omax  = input->omax;
+        ttot  = input->ttot;
+        smax  = input->smax;
+        tmax  = input->tmax;
+      }
+    else
+      { al = 0;
+        Seek_Las(input,npt-1);
+        while ((ovl = Next_Las(input)) != NULL)
 
-      { Read_Overlap(input,ovl);
-        tlen = ovl->path.tlen;
-        fseeko(input,tlen*tbytes,SEEK_CUR);
+           //  Read it in
 
-        //  Determine if it should be displayed
+          { tlen = ovl->path.tlen;
 
-        ar = ovl->aread+1;
-        if (in)
-          { while (ar > npt)
-              { npt = pts[idx++];
-                if (ar < npt)
-                  { in = 0;
-                    break;
+            //  Determine if it should be displayed
+
+            ar = ovl->aread+1;
+            if (in)
+              { while (ar > npt)
+                  { npt = pts[idx++];
+                    if (ar < npt)
+                      { in = 0;
+                        break;
+                      }
+                    npt = pts[idx++];
                   }
-                npt = pts[idx++];
               }
-          }
-        else
-          { while (ar >= npt)
-              { npt = pts[idx++];
-                if (ar <= npt)
-                  { in = 1;
-                    break;
+            else
+              { while (ar >= npt)
+                  { npt = pts[idx++];
+                    if (ar <= npt)
+                      { in = 1;
+                        break;
+                      }
+                    npt = pts[idx++];
                   }
-                npt = pts[idx++];
               }
-          }
-        if (!in)
-          continue;
+            if (!in)
+              { if (npt == INT32_MAX)
+                  break;
+                Seek_Las(input,npt-1);
+                continue;
+              }
 
-        //  If -o check display only overlaps
+            //  If -o check display only overlaps
 
-        if (OVERLAP)
-          { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
-              continue;
-            if (ovl->path.aepos != db1->reads[ovl->aread].rlen &&
-                ovl->path.bepos != db2->reads[ovl->bread].rlen)
-              continue;
-          }
+            if (OVERLAP)
+              { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
+                  continue;
+                if (ovl->path.aepos != db1->reads[ovl->aread].rlen &&
+                    ovl->path.bepos != db2->reads[ovl->bread].rlen)
+                  continue;
+              }
+
+            if (ar != al)
+              { if (sdeg > smax)
+                  smax = sdeg;
+                if (odeg > omax)
+                  omax = odeg;
+                sdeg = odeg = 0;
+                al = ar;
+              }
 
-        if (ar != al)
-          { if (sdeg > smax)
-              smax = sdeg;
-            if (odeg > omax)
-              omax = odeg;
-            sdeg = odeg = 0;
-            al = ar;
+            novls += 1;
+            odeg  += 1;
+            sdeg  += tlen;
+            ttot  += tlen;
+            if (tlen > tmax)
+              tmax = tlen;
           }
 
-        novls += 1;
-        odeg  += 1;
-        sdeg  += tlen;
-        ttot  += tlen;
-        if (tlen > tmax)
-          tmax = tlen;
-      }
+        if (ovl == NULL && !At_End_Las(input))
+          SYSTEM_ERROR
 
-    if (sdeg > smax)
-      smax = sdeg;
-    if (odeg > omax)
-      omax = odeg;
+        if (sdeg > smax)
+          smax = sdeg;
+        if (odeg > omax)
+          omax = odeg;
+      }
 
     printf("+ P %lld\n",novls);
     printf("%% P %lld\n",omax);
@@ -370,17 +386,18 @@ int main(int argc, char *argv[])
     uint16    *trace;
     int        tmax;
     int        in, npt, idx, ar;
-    int64      verse;
-
-    rewind(input);
-    fread(&verse,sizeof(int64),1,input);
-    fread(&tspace,sizeof(int),1,input);
-    if (verse < 0)
-      { for (j = 0; j < 5; j++)
-          fread(&verse,sizeof(int64),1,input);
-      }
+
+    Close_Las(input);
+    if (DOTRACE)
+      input = Open_Las(over,LAS_SEQUENTIAL);
+    else
+      input = Open_Las(over,LAS_HEADERS);
+    if (input == NULL)
+      exit (1);
 
     tmax  = 1000;
+    if (input->tmax > tmax)
+      tmax = input->tmax;
     trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
     if (trace == NULL)
       exit (1);
@@ -391,19 +408,21 @@ int main(int argc, char *argv[])
 
     //  For each record do
 
-    for (j = 0; j < novl; j++)
+    Seek_Las(input,npt-1);
+    while ((ovl = Next_Las(input)) != NULL)
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+      { if (small && DOTRACE)
+          { if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            memcpy(trace,ovl->path.trace,ovl->path.tlen*tbytes);
+            ovl->path.trace = (void *) trace;
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
 
         //  Determine if it should be displayed
 
@@ -429,7 +448,11 @@ int main(int argc, char *argv[])
               }
           }
         if (!in)
-          continue;
+          { if (npt == INT32_MAX)
+              break;
+            Seek_Las(input,npt-1);
+            continue;
+          }
 
         //  If -o check display only overlaps
 
@@ -476,7 +499,12 @@ int main(int argc, char *argv[])
           }
       }
 
+    if (ovl == NULL && !At_End_Las(input))
+      SYSTEM_ERROR
+
     free(trace);
+    Close_Las(input);
+    free(over);
   }
 
   Close_DB(db1);
@@ -21,16 +21,14 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage = "[-v] <source:las> ...";
 
-#define MEMORY   1000   //  How many megabytes for output buffer
-
 int main(int argc, char *argv[])
-{ char     *iblock;
-  FILE     *input, *output;
-  int64     novl, bsize, ovlsize, ptrsize;
-  int       tspace, tbytes;
+{ Las_File *input;
+  FILE     *output;
+  int64     novl;
   char     *pwd, *root;
   int64     tmax, ttot;
   int64     omax, smax;
@@ -64,29 +62,18 @@ int main(int argc, char *argv[])
 
   //  For each file do
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
-  bsize   = MEMORY * 1000000ll;
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (iblock == NULL)
-    exit (1);
-  iblock += ptrsize;
-
   for (i = 1; i < argc; i++)
     { pwd   = PathTo(argv[i]);
       root  = Root(argv[i],".las");
-      input = Fopen(Catenate(pwd,"/",root,".las"),"r");
+      input = Open_Las(Catenate(pwd,"/",root,".las"),LAS_HEADERS);
       if (input == NULL)
         exit (1);
-    
-      if (fread(&novl,sizeof(int64),1,input) != 1)
-        SYSTEM_ERROR
-      if (fread(&tspace,sizeof(int),1,input) != 1)
-        SYSTEM_ERROR
-      if (tspace <= TRACE_XOVR)
-        tbytes = sizeof(uint8);
-      else
-        tbytes = sizeof(uint16);
+      if (input->version != 1)
+        { fprintf(stderr,"%s: %s is compressed and carries its own block index\n",
+                         Prog_Name,input->name);
+          exit (1);
+        }
+      novl = input->novl;
     
       output = Fopen(Catenate(pwd,"/.",root,".las.idx"),"w");
       if (output == NULL)
@@ -109,30 +96,19 @@ int main(int argc, char *argv[])
     
       { int         j, alst;
         Overlap    *w;
-        int64       tsize;
         int64       optr;
-        char       *iptr, *itop;
         int64       tlen;
     
         optr = sizeof(int64) + sizeof(int32);
-        iptr = iblock;
-        itop = iblock + fread(iblock,1,bsize,input);
     
         alst = -1;
         odeg = sdeg = 0;
         omax = smax = 0;
         tmax = ttot = 0;
         for (j = 0; j < novl; j++)
-          { if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-              }
-    
-            w = (Overlap *) (iptr - ptrsize);
+          { w = Next_Las(input);
+            if (w == NULL)
+              SYSTEM_ERROR
     
             tlen = w->path.tlen;
             if (alst < 0)
@@ -155,20 +131,7 @@ int main(int argc, char *argv[])
             odeg += 1;
             sdeg += tlen;
     
-            iptr += ovlsize;
-    
-            tsize = tlen*tbytes;
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,input);
-              }
-            
-            optr += ovlsize + tsize;
-            iptr += tsize;
+            optr += input->span;
           }
         fwrite(&optr,sizeof(int64),1,output);
       }
@@ -191,11 +154,9 @@ int main(int argc, char *argv[])
           fflush(stdout);
         }
     
-      fclose(input);
+      Close_Las(input);
       fclose(output);
     }
 
-  free(iblock-ptrsize);
-
   exit (0);
 }
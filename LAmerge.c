@@ -2,6 +2,11 @@
  *
  *  Given a list of sorted .las files, merge them into a single sorted .las file.
  *
+ *  The inputs are mapped into memory and the (aread,bread) key space (aread alone if -a) is
+ *    cut into -T ranges of about equal size by sampling the chains of every input.  Each
+ *    range is then merged by its own thread with a loser tree over all the inputs, and
+ *    written at its precomputed place in the output.
+ *
  *  Author:  Gene Myers
  *  Date  :  July 2013
  *
@@ -14,39 +19,20 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
-static char *Usage = "[-va] <merge:las> <parts:las> ...";
+static char *Usage = "[-va] [-T<int(4)>] <merge:las> <parts:las> ...";
 
-#define MEMORY 4000   // in Mb
+#define MEMORY   1000   //  How many megabytes for output buffers (split among the threads)
+#define SAMPLE   1024   //  Every SAMPLE'th chain of an input is sampled to partition the merge
 
-#undef   DEBUG
+#define THREAD    pthread_t
 
-  //  Heap sort of records according to (aread,bread,COMP(flags),abpos) order
-
-#define COMPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->bread > rp->bread)		\
-    bigger = 1;					\
-  else if (lp->bread < rp->bread)		\
-    bigger = 0;					\
-  else if (COMP(lp->flags) > COMP(rp->flags))	\
-    bigger = 1;					\
-  else if (COMP(lp->flags) < COMP(rp->flags))	\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
+#undef   DEBUG
 
 static void Fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
   size_t rc = fwrite(ptr, size, nmemb, stream);
@@ -66,161 +52,354 @@ static void Fclose(FILE *stream) {
   }
 }
 
-static void reheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
-      else
-        { hr = heap[r];
-          COMPARE(hr,hl)
-        }
-      if (bigger)
-        { COMPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
-            }
-          else
-            break;
-        }
-      else
-        { COMPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
-            }
-          else
-            break;
-        }
+static void Pwrite(int fd, const void *ptr, int64 len, int64 pos) {
+  ssize_t rc;
+  while (len > 0) {
+    rc = pwrite(fd, ptr, len, pos);
+    if (rc <= 0) {
+      EPRINTF(EPLACE,"  Error writing %lld bytes at %lld\n", len, pos);
+      exit(1);
     }
-  if (c != s)
-    heap[c] = hs;
+    ptr  = ((char *) ptr) + rc;
+    len -= rc;
+    pos += rc;
+  }
 }
 
-  //  Heap sort of records according to (aread,abpos) order
-
-#define MAPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
-
-static void maheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
-      else
-        { hr = heap[r];
-          MAPARE(hr,hl)
-        }
-      if (bigger)
-        { MAPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
+static int        MAP_SORT;     //  Sort on (aread,abpos) alone
+static int        NTHREADS;
+static int        FWAY;         //  # of inputs,
+static Las_File **IN;           //    their files,
+static int        TBYTES;       //    and the # of bytes per trace value
+
+  //  Each thread merges the records of input i in [SPLIT[i][t],SPLIT[i][t+1]) for all i,
+  //    these are offsets from IN[i]->data, and places the result at OPOS[t] in the output
+
+static int64    **SPLIT;
+static int64     *OPOS;
+static int        OUTPUT;       //  File descriptor of the output
+static int64      OSIZE;        //  Size of each thread's output buffer
+
+/*******************************************************************************************
+ *
+ *  PARTITIONING
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { int   aread;
+    int   bread;
+    int64 off;
+  } Sample;
+
+static Sample **SAMP;           //  SAMP[i][0..NSAMP[i]-1] are the samples of input i in order
+static int64   *NSAMP;
+
+  //  Compare the keys (a1,b1) and (a2,b2), the b's are ignored if MAP_SORT
+
+static inline int key_cmp(int a1, int b1, int a2, int b2)
+{ if (a1 != a2)
+    return (a1 < a2 ? -1 : 1);
+  if (MAP_SORT || b1 == b2)
+    return (0);
+  return (b1 < b2 ? -1 : 1);
+}
+
+static int SORT_SAMPLE(const void *x, const void *y)
+{ Sample *l = (Sample *) x;
+  Sample *r = (Sample *) y;
+
+  return (key_cmp(l->aread,l->bread,r->aread,r->bread));
+}
+
+  //  Sample the inputs i = tid, tid+T, ... : every SAMPLE'th chain is recorded
+
+static void *sample_thread(void *arg)
+{ int64       tid = (int64) arg;
+  Las_Record *r;
+  uint8      *p, *top;
+  int64       n, ns, max;
+  int         i;
+
+  for (i = tid; i < FWAY; i += NTHREADS)
+    { p   = IN[i]->data;
+      top = IN[i]->top;
+      max = IN[i]->novl/SAMPLE + 1;
+      n   = ns = 0;
+      while (p + LAS_RECORD <= top && ns < max)
+        { r = (Las_Record *) p;
+          if ( ! CHAIN_NEXT(r->flags))
+            { if (n % SAMPLE == 0)
+                { SAMP[i][ns].aread = r->aread;
+                  SAMP[i][ns].bread = r->bread;
+                  SAMP[i][ns].off   = p - IN[i]->data;
+                  ns += 1;
+                }
+              n += 1;
             }
-          else
-            break;
+          p += LAS_SPAN(p,TBYTES);
         }
+      NSAMP[i] = ns;
+    }
+  return (NULL);
+}
+
+  //  Return the offset of the first chain of input i whose key is not less than (a,b)
+
+static int64 find_split(int i, int a, int b)
+{ Sample     *s = SAMP[i];
+  Las_Record *r;
+  uint8      *p, *top;
+  int64       l, h, m;
+
+  l = 0;                       //  Find the last sample less than (a,b), start from it
+  h = NSAMP[i];
+  while (l < h)
+    { m = (l+h)/2;
+      if (key_cmp(s[m].aread,s[m].bread,a,b) < 0)
+        l = m+1;
       else
-        { MAPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
-            }
+        h = m;
+    }
+  if (l > 0)
+    p = IN[i]->data + s[l-1].off;
+  else
+    p = IN[i]->data;
+
+  top = IN[i]->top;
+  while (p + LAS_RECORD <= top)
+    { r = (Las_Record *) p;
+      if ( ! CHAIN_NEXT(r->flags) && key_cmp(r->aread,r->bread,a,b) >= 0)
+        break;
+      p += LAS_SPAN(p,TBYTES);
+    }
+  if (p > top)
+    p = top;
+  return (p - IN[i]->data);
+}
+
+  //  Set SPLIT so that the T ranges have about the same number of chains
+
+static void partition()
+{ THREAD  *threads;
+  Sample  *pool;
+  int64    npool, j;
+  int      i, t;
+
+  SAMP  = (Sample **) Malloc(sizeof(Sample *)*FWAY,"Allocating samples");
+  NSAMP = (int64 *) Malloc(sizeof(int64)*FWAY,"Allocating samples");
+  if (SAMP == NULL || NSAMP == NULL)
+    exit (1);
+  for (i = 0; i < FWAY; i++)
+    { SAMP[i] = (Sample *) Malloc(sizeof(Sample)*(IN[i]->novl/SAMPLE+1),"Allocating samples");
+      if (SAMP[i] == NULL)
+        exit (1);
+    }
+
+  threads = (THREAD *) Malloc(sizeof(THREAD)*NTHREADS,"Allocating threads");
+  if (threads == NULL)
+    exit (1);
+  for (t = 0; t < NTHREADS; t++)
+    pthread_create(threads+t,NULL,sample_thread,(void *) ((int64) t));
+  for (t = 0; t < NTHREADS; t++)
+    pthread_join(threads[t],NULL);
+  free(threads);
+
+  npool = 0;
+  for (i = 0; i < FWAY; i++)
+    npool += NSAMP[i];
+  pool = (Sample *) Malloc(sizeof(Sample)*(npool+1),"Allocating samples");
+  if (pool == NULL)
+    exit (1);
+  npool = 0;
+  for (i = 0; i < FWAY; i++)
+    { memcpy(pool+npool,SAMP[i],sizeof(Sample)*NSAMP[i]);
+      npool += NSAMP[i];
+    }
+  qsort(pool,npool,sizeof(Sample),SORT_SAMPLE);
+
+  //  The t'th splitter is the sample of rank npool*t/T, every input is cut at its first
+  //    chain not less than it (and never before its previous cut should an input be unsorted)
+
+  for (t = 1; t < NTHREADS; t++)
+    { j = (npool*t)/NTHREADS;
+      for (i = 0; i < FWAY; i++)
+        { if (npool == 0)
+            SPLIT[i][t] = 0;
           else
-            break;
+            SPLIT[i][t] = find_split(i,pool[j].aread,pool[j].bread);
+          if (SPLIT[i][t] < SPLIT[i][t-1])
+            SPLIT[i][t] = SPLIT[i][t-1];
         }
     }
-  if (c != s)
-    heap[c] = hs;
+
+  free(pool);
+  for (i = 0; i < FWAY; i++)
+    free(SAMP[i]);
+  free(NSAMP);
+  free(SAMP);
 }
 
-#ifdef DEBUG
+/*******************************************************************************************
+ *
+ *  LOSER TREE MERGE
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { int     tid;
+    uint8 **cur;                //  Next chain of each input in this thread's range,
+    uint8 **end;                //    and the end of the range
+    int    *tree;               //  tree[0] is the winner, tree[1..FWAY-1] the losers
+    int64   nrec;               //  # of records output
+  } Merge_Arg;
 
-static void showheap(Overlap **heap, int hsize)
-{ int i;
-  printf("\n");
-  for (i = 1; i <= hsize; i++)
-    printf(" %3d: %5d, %5d\n",i,heap[i]->aread,heap[i]->bread);
+  //  Is there a whole record at the cursor of input i?
+
+static inline int live(Merge_Arg *m, int i)
+{ uint8 *p = m->cur[i];
+
+  return (p + LAS_RECORD <= m->end[i] && p + LAS_SPAN(p,TBYTES) <= m->end[i]);
 }
 
-#endif
+  //  Does the chain of input x come before that of input y in (aread,bread,COMP(flags),abpos)
+  //    order, or (aread,abpos) order if MAP_SORT?  Ties go to the input listed first, and
+  //    FWAY is a sentinel that beats everything.
+
+static inline int beats(Merge_Arg *m, int x, int y)
+{ Las_Record *rx, *ry;
+
+  if (x == FWAY)
+    return (1);
+  if (y == FWAY)
+    return (0);
+  if ( ! live(m,x))
+    return (0);
+  if ( ! live(m,y))
+    return (1);
+
+  rx = (Las_Record *) m->cur[x];
+  ry = (Las_Record *) m->cur[y];
+  if (rx->aread != ry->aread)
+    return (rx->aread < ry->aread);
+  if ( ! MAP_SORT)
+    { if (rx->bread != ry->bread)
+        return (rx->bread < ry->bread);
+      if (COMP(rx->flags) != COMP(ry->flags))
+        return (COMP(rx->flags) < COMP(ry->flags));
+    }
+  if (rx->abpos != ry->abpos)
+    return (rx->abpos < ry->abpos);
+  return (x < y);
+}
 
-  //  Input block data structure and block fetcher
+  //  Replay the matches from leaf s to the root after the chain of input s has changed
 
-typedef struct
-  { FILE   *stream;
-    char   *block;
-    char   *ptr;
-    char   *top;
-    int64   count;
-  } IO_block;
-
-static void ovl_reload(IO_block *in, int64 bsize)
-{ int64 remains;
-
-  remains = in->top - in->ptr;
-  if (remains > 0)
-    memmove(in->block, in->ptr, remains);
-  in->ptr  = in->block;
-  in->top  = in->block + remains;
-  in->top += fread(in->top,1,bsize-remains,in->stream);
+static void adjust(Merge_Arg *m, int s)
+{ int *tree = m->tree;
+  int  t, x;
+
+  for (t = (s+FWAY)/2; t > 0; t /= 2)
+    if (beats(m,tree[t],s))
+      { x       = s;
+        s       = tree[t];
+        tree[t] = x;
+      }
+  tree[0] = s;
+}
+
+static void *merge_thread(void *arg)
+{ Merge_Arg  *m   = (Merge_Arg *) arg;
+  int         tid = m->tid;
+  char       *oblock, *optr, *otop;
+  int64       opos, span;
+  uint8      *p, *e;
+  int         i, w;
+
+  for (i = 0; i < FWAY; i++)
+    { m->cur[i] = IN[i]->data + SPLIT[i][tid];
+      m->end[i] = IN[i]->data + SPLIT[i][tid+1];
+    }
+
+  for (i = 0; i < FWAY; i++)
+    m->tree[i] = FWAY;
+  for (i = FWAY-1; i >= 0; i--)
+    adjust(m,i);
+
+  oblock = (char *) Malloc(OSIZE,"Allocating LAmerge output block");
+  if (oblock == NULL)
+    exit (1);
+  optr = oblock;
+  otop = oblock + OSIZE;
+  opos = OPOS[tid];
+
+  //  While the winner has a chain, output it and replay its matches
+
+  while (live(m,w = m->tree[0]))
+    { p = m->cur[w];
+      e = m->end[w];
+      do
+        { span = LAS_SPAN(p,TBYTES);
+          if (optr + span > otop)
+            { Pwrite(OUTPUT,oblock,optr-oblock,opos);
+              opos += optr-oblock;
+              optr  = oblock;
+            }
+          if (span > OSIZE)
+            { Pwrite(OUTPUT,p,span,opos);
+              opos += span;
+            }
+          else
+            { memcpy(optr,p,span);
+              optr += span;
+            }
+          m->nrec += 1;
+          p += span;
+        }
+      while (p + LAS_RECORD <= e && p + LAS_SPAN(p,TBYTES) <= e
+                                 && CHAIN_NEXT(((Las_Record *) p)->flags));
+      m->cur[w] = p;
+      adjust(m,w);
+    }
+
+  if (optr > oblock)
+    Pwrite(OUTPUT,oblock,optr-oblock,opos);
+
+  free(oblock);
+  return (NULL);
 }
 
   //  The program
 
 int main(int argc, char *argv[])
-{ IO_block *in;
-  int64     bsize, osize, psize;
-  char     *block, *oblock;
-  int       i, fway;
-  Overlap **heap;
-  int       hsize;
-  Overlap  *ovls;
-  int64     totl;
-  int       tspace, tbytes;
+{ int64     totl;
+  int       tspace;
   FILE     *output;
-  char     *optr, *otop;
+  int       i, t;
 
   int       VERBOSE;
-  int       MAP_SORT;
 
   //  Process command line
 
-  { int j, k;
-    int flags[128];
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAmerge")
 
+    NTHREADS = 4;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("va") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("va")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
       else
         argv[j++] = argv[i];
     argc = j;
@@ -233,68 +412,42 @@ int main(int argc, char *argv[])
         exit (1);
       }
 
-    fway = argc-2;
-    if (fway > 252)
-      { fprintf(stderr,"Exceeded maximum # of inputs and outputs (252) of merge\n");
-        exit (1);
-      }
+    FWAY = argc-2;
   }
 
-  //  Open all the input files and initialize their buffers
+  //  Map all the input files, they do not hold a file descriptor so there is no limit
+  //    on their number
 
-  psize  = sizeof(void *);
-  osize  = sizeof(Overlap) - psize;
-  bsize  = (MEMORY*1000000ll)/(fway + 1);
-  block  = (char *) Malloc(bsize*(fway+1)+psize,"Allocating LAmerge blocks");
-  in     = (IO_block *) Malloc(sizeof(IO_block)*fway,"Allocating LAmerge IO-reacords");
-  if (block == NULL || in == NULL)
+  IN = (Las_File **) Malloc(sizeof(Las_File *)*FWAY,"Allocating LAmerge inputs");
+  if (IN == NULL)
     exit (1);
-  block += psize;
 
   totl   = 0;
-  tbytes = 0;
   tspace = 0;
-  for (i = 0; i < fway; i++)
-    { int64  novl;
-      int    mspace;
-      FILE  *input;
-      char  *pwd, *root;
-      char  *iblock;
+  for (i = 0; i < FWAY; i++)
+    { char  *pwd, *root;
 
       pwd   = PathTo(argv[i+2]);
       root  = Root(argv[i+2],".las");
-      input = Fopen(Catenate(pwd,"/",root,".las"),"r");
-      if (input == NULL)
+      IN[i] = Open_Las(Catenate(pwd,"/",root,".las"),LAS_SWEEP);
+      if (IN[i] == NULL)
         exit (1);
 
-      if (fread(&novl,sizeof(int64),1,input) != 1)
-        SYSTEM_ERROR
-      totl += novl;
-      if (VERBOSE) fprintf(stdout, "In file %s, there are %lld records\n", Catenate(pwd,"/",root,".las"), novl);
+      totl += IN[i]->novl;
+      if (VERBOSE) fprintf(stdout, "In file %s, there are %lld records\n", IN[i]->name, IN[i]->novl);
       free(pwd);
       free(root);
-      if (fread(&mspace,sizeof(int),1,input) != 1)
-        SYSTEM_ERROR
       if (i == 0)
-        { tspace = mspace;
-          if (tspace <= TRACE_XOVR)
-            tbytes = sizeof(uint8);
-          else
-            tbytes = sizeof(uint16);
-        }
-      else if (tspace != mspace)
-        { fprintf(stderr,"%s: PT-point spacing conflict (%d vs %d)\n",Prog_Name,tspace,mspace);
+        tspace = IN[i]->tspace;
+      else if (tspace != IN[i]->tspace)
+        { fprintf(stderr,"%s: PT-point spacing conflict (%d vs %d)\n",Prog_Name,tspace,
+                         IN[i]->tspace);
           exit (1);
         }
-
-      in[i].stream = input;
-      in[i].block  = iblock = block+i*bsize;
-      in[i].ptr    = iblock;
-      in[i].top    = iblock + fread(in[i].block,1,bsize,input);
-      in[i].count  = 0;
     }
+  TBYTES = IN[0]->tbytes;
 
-  //  Open the output file buffer and write (novl,tspace) header
+  //  Open the output file and write (novl,tspace) header
 
   { char *pwd, *root;
 
@@ -308,108 +461,101 @@ int main(int argc, char *argv[])
 
     Fwrite(&totl,sizeof(int64),1,output);
     Fwrite(&tspace,sizeof(int),1,output);
-
-    oblock = block+fway*bsize;
-    optr   = oblock;
-    otop   = oblock + bsize;
+    fflush(output);
+    OUTPUT = fileno(output);
   }
 
   if (VERBOSE)
-    { printf("Merging %d files totalling ",fway);
+    { printf("Merging %d files totalling ",FWAY);
       Print_Number(totl,0,stdout);
       printf(" records\n");
     }
 
-  //  Initialize the heap
+  //  Cut the inputs into a range per thread and place the ranges in the output
 
-  heap = (Overlap **) Malloc(sizeof(Overlap *)*(fway+1),"Allocating heap");
-  ovls = (Overlap *) Malloc(sizeof(Overlap)*fway,"Allocating heap");
-  if (heap == NULL || ovls == NULL)
+  SPLIT = (int64 **) Malloc(sizeof(int64 *)*FWAY,"Allocating merge ranges");
+  OPOS  = (int64 *) Malloc(sizeof(int64)*(NTHREADS+1),"Allocating merge ranges");
+  if (SPLIT == NULL || OPOS == NULL)
     exit (1);
-
-  hsize = 0;
-  for (i = 0; i < fway; i++)
-    { if (in[i].ptr < in[i].top)
-        { ovls[i]     = *((Overlap *) (in[i].ptr - psize));
-          in[i].ptr  += osize;
-          hsize      += 1;
-          heap[hsize] = ovls + i;
-        }
+  for (i = 0; i < FWAY; i++)
+    { SPLIT[i] = (int64 *) Malloc(sizeof(int64)*(NTHREADS+1),"Allocating merge ranges");
+      if (SPLIT[i] == NULL)
+        exit (1);
+      SPLIT[i][0]        = 0;
+      SPLIT[i][NTHREADS] = IN[i]->top - IN[i]->data;
     }
 
-  if (hsize > 3)
-    { if (MAP_SORT)
-        for (i = hsize/2; i > 1; i--)
-          maheap(i,heap,hsize);
-      else
-        for (i = hsize/2; i > 1; i--)
-          reheap(i,heap,hsize);
-    }
+  if (NTHREADS > 1)
+    partition();
 
-  //  While the heap is not empty do
+  OPOS[0] = LAS_HEADER;
+  for (t = 0; t < NTHREADS; t++)
+    { OPOS[t+1] = OPOS[t];
+      for (i = 0; i < FWAY; i++)
+        OPOS[t+1] += SPLIT[i][t+1] - SPLIT[i][t];
+    }
 
-  while (hsize > 0)
-    { Overlap  *ov;
-      IO_block *src;
-      int64     tsize, span;
+#ifdef DEBUG
+  for (t = 0; t < NTHREADS; t++)
+    printf(" Range %d: %lld .. %lld\n",t,OPOS[t],OPOS[t+1]);
+#endif
 
-      if (MAP_SORT)
-        maheap(1,heap,hsize);
-      else
-        reheap(1,heap,hsize);
+  //  Merge each range in its own thread
 
-      ov  = heap[1];
-      src = in + (ov - ovls);
+  { THREAD    *threads;
+    Merge_Arg *parm;
 
-      do
-        { src->count += 1;
+    OSIZE   = (MEMORY*1000000ll)/NTHREADS;
+    threads = (THREAD *) Malloc(sizeof(THREAD)*NTHREADS,"Allocating threads");
+    parm    = (Merge_Arg *) Malloc(sizeof(Merge_Arg)*NTHREADS,"Allocating threads");
+    if (threads == NULL || parm == NULL)
+      exit (1);
 
-          tsize = ov->path.tlen*tbytes;
-          span  = osize + tsize;
-          if (src->ptr + span > src->top)
-            ovl_reload(src,bsize);
-          if (optr + span > otop)
-            { Fwrite(oblock,1,optr-oblock,output);
-              optr = oblock;
-            }
+    for (t = 0; t < NTHREADS; t++)
+      { parm[t].tid  = t;
+        parm[t].nrec = 0;
+        parm[t].cur  = (uint8 **) Malloc(sizeof(uint8 *)*FWAY,"Allocating loser tree");
+        parm[t].end  = (uint8 **) Malloc(sizeof(uint8 *)*FWAY,"Allocating loser tree");
+        parm[t].tree = (int *) Malloc(sizeof(int)*FWAY,"Allocating loser tree");
+        if (parm[t].cur == NULL || parm[t].end == NULL || parm[t].tree == NULL)
+          exit (1);
+      }
 
-          memcpy(optr,((char *) ov) + psize,osize);
-          optr += osize;
-          memcpy(optr,src->ptr,tsize);
-          optr += tsize;
+    if (NTHREADS == 1)
+      merge_thread(parm);
+    else
+      { for (t = 0; t < NTHREADS; t++)
+          pthread_create(threads+t,NULL,merge_thread,parm+t);
+        for (t = 0; t < NTHREADS; t++)
+          pthread_join(threads[t],NULL);
+      }
 
-          src->ptr += tsize;
-          if (src->ptr >= src->top)
-            { heap[1] = heap[hsize];
-              hsize  -= 1;
-              break;
-            }
-          *ov       = *((Overlap *) (src->ptr - psize));
-          src->ptr += osize;
-        }
-      while (CHAIN_NEXT(ov->flags));
-    }
+    for (t = 0; t < NTHREADS; t++)
+      { totl -= parm[t].nrec;
+        free(parm[t].tree);
+        free(parm[t].end);
+        free(parm[t].cur);
+      }
+    free(parm);
+    free(threads);
+  }
 
-  //  Flush output buffer and wind up
+  //  Wind up
 
-  if (optr > oblock)
-    Fwrite(oblock,1,optr-oblock,output);
   Fclose(output);
 
-  for (i = 0; i < fway; i++)
-    fclose(in[i].stream);
-
-  for (i = 0; i < fway; i++)
-    totl -= in[i].count;
+  for (i = 0; i < FWAY; i++)
+    { free(SPLIT[i]);
+      Close_Las(IN[i]);
+    }
   if (totl != 0)
     { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",argv[0],argv[1],totl);
       exit (1);
     }
 
-  free(ovls);
-  free(heap);
-  free(in);
-  free(block-psize);
+  free(OPOS);
+  free(SPLIT);
+  free(IN);
 
   exit (0);
 }
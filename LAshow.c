@@ -20,6 +20,7 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage[] =
     { "[-caroUF] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] ",
@@ -40,17 +41,17 @@ int main(int argc, char *argv[])
   Overlap   _ovl, *ovl = &_ovl;
   Alignment _aln, *aln = &_aln;
 
-  FILE   *input;
-  int     sameDB;
-  int64   novl;
-  int     tspace, tbytes, small;
-  int     reps, *pts;
-  int     input_pts;
+  Las_File *input;
+  int       sameDB;
+  int64     novl;
+  int       tspace, tbytes, small;
+  int       reps, *pts;
+  int       input_pts;
 
-  int     ALIGN, CARTOON, REFERENCE, OVERLAP;
-  int     FLIP, MAP;
-  int     INDENT, WIDTH, BORDER, UPPERCASE;
-  int     ISTWO;
+  int       ALIGN, CARTOON, REFERENCE, OVERLAP;
+  int       FLIP, MAP;
+  int       INDENT, WIDTH, BORDER, UPPERCASE;
+  int       ISTWO;
 
   //  Process options
 
@@ -279,14 +280,15 @@ int main(int argc, char *argv[])
     pwd   = PathTo(argv[2+ISTWO]);
     root  = Root(argv[2+ISTWO],".las");
     over  = Catenate(pwd,"/",root,".las");
-    input = Fopen(over,"r");
+    if (ALIGN || REFERENCE)
+      input = Open_Las(over,LAS_SEQUENTIAL);
+    else
+      input = Open_Las(over,LAS_HEADERS);
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_ERROR
+    novl   = input->novl;
+    tspace = input->tspace;
     if (tspace <= 0)
       { fprintf(stderr,"%s: Garbage .las file, trace spacing <= 0 !\n",Prog_Name);
         exit (1);
@@ -311,7 +313,7 @@ int main(int argc, char *argv[])
 
   //  Read the file and display selected records
   
-  { int        j;
+  { Overlap   *next;
     uint16    *trace;
     Work_Data *work;
     int        tmax;
@@ -338,6 +340,8 @@ int main(int argc, char *argv[])
       }
 
     tmax  = 1000;
+    if (input->tmax > tmax)
+      tmax = input->tmax;
     trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
     if (trace == NULL)
       exit (1);
@@ -345,6 +349,7 @@ int main(int argc, char *argv[])
     in  = 0;
     npt = pts[0];
     idx = 1;
+    Seek_Las(input,npt-1);
 
     ar_wide = Number_Digits((int64) db1->nreads);
     br_wide = Number_Digits((int64) db2->nreads);
@@ -379,19 +384,21 @@ int main(int argc, char *argv[])
     match = 0;
     seen  = 0;
     lhalf = rhalf = 0;
-    for (j = 0; j < novl; j++)
+    while ((next = Next_Las(input)) != NULL)
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+      { *ovl = *next;
+        if (small && (ALIGN || REFERENCE))
+          { if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            memcpy(trace,ovl->path.trace,ovl->path.tlen*tbytes);
+            ovl->path.trace = (void *) trace;
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
 
         //  Determine if it should be displayed
 
@@ -417,7 +424,11 @@ int main(int argc, char *argv[])
               }
           }
         if (!in)
-          continue;
+          { if (npt == INT32_MAX)
+              break;
+            Seek_Las(input,npt-1);
+            continue;
+          }
 
         //  If -o check display only overlaps
 
@@ -602,7 +613,11 @@ int main(int argc, char *argv[])
           }
       }
 
+    if (next == NULL && !At_End_Las(input))
+      SYSTEM_ERROR
+
     free(trace);
+    Close_Las(input);
     if (ALIGN)
       { free(bbuffer-1);
         free(abuffer-1);
@@ -1,7 +1,10 @@
 /*******************************************************************************************
  *
  *  Load a file U.las of overlaps into memory, sort them all by A,B index,
- *    and then output the result to U.S.las
+ *    and then output the result to U.S.las.  The sort is a threaded radix sort on
+ *    keys packed from the records, the records are then gathered in order by the
+ *    threads into the output buffer.  If -M is given and the file does not fit in it, it is
+ *    instead sorted in runs that do, which are spilled to temporary files and merged.
  *
  *  Author:  Gene Myers
  *  Date  :  July 2013
@@ -15,15 +18,25 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
-static char *Usage = "[-va] <align:las> ...";
+static char *Usage = "[-va] [-M<int>] [-T<int(4)>] <align:las> ...";
 
 #define MEMORY   1000   //  How many megabytes for output buffer
 
-static char *IBLOCK;
+#define THREAD    pthread_t
+
+static uint8 *IBLOCK;
+static int    NTHREADS;
+static int    VERBOSE;
+static int    MAP_ORDER;
+static int64  MEM_LIMIT;     //  Bytes LAsort may use, 0 if unlimited
+static char  *FBLOCK;        //  Output buffer and its size
+static int64  OSIZE;
 
 static void Fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
   size_t rc = fwrite(ptr, size, nmemb, stream);
@@ -47,14 +60,14 @@ static int SORT_OVL(const void *x, const void *y)
 { int64 l = *((int64 *) x);
   int64 r = *((int64 *) y);
 
-  Overlap *ol, *or;
-  int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
+  Las_Record *ol, *or;
+  int         al, ar;
+  int         bl, br;
+  int         cl, cr;
+  int         pl, pr;
 
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
+  ol = (Las_Record *) (IBLOCK+l);
+  or = (Las_Record *) (IBLOCK+r);
 
   al = ol->aread;
   ar = or->aread;
@@ -67,12 +80,12 @@ static int SORT_OVL(const void *x, const void *y)
     return (bl-br);
 
   cl = COMP(ol->flags);
-  cr = COMP(ol->flags);
+  cr = COMP(or->flags);
   if (cl != cr)
     return (cl-cr);
 
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
+  pl = ol->abpos;
+  pr = or->abpos;
   if (pl != pr)
     return (pl-pr);
 
@@ -88,20 +101,20 @@ static int SORT_MAP(const void *x, const void *y)
 { int64 l = *((int64 *) x);
   int64 r = *((int64 *) y);
 
-  Overlap *ol, *or;
-  int      al, ar;
-  int      pl, pr;
+  Las_Record *ol, *or;
+  int         al, ar;
+  int         pl, pr;
 
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
+  ol = (Las_Record *) (IBLOCK+l);
+  or = (Las_Record *) (IBLOCK+r);
 
   al = ol->aread;
   ar = or->aread;
   if (al != ar)
     return (al-ar);
 
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
+  pl = ol->abpos;
+  pr = or->abpos;
   if (pl != pr)
     return (pl-pr);
 
@@ -113,191 +126,889 @@ static int SORT_MAP(const void *x, const void *y)
     return (0);
 }
 
-int main(int argc, char *argv[])
-{ char     *iblock, *fblock, *iend;
-  int64     isize,   osize;
-  int64     ovlsize, ptrsize;
-  int       tspace, tbytes;
-  int       i;
-
-  int       VERBOSE;
-  int       MAP_ORDER;
- 
-  //  Process options
 
-  { int j, k;
-    int flags[128];
+/*******************************************************************************************
+ *
+ *  RADIX SORT
+ *
+ ********************************************************************************************/
+
+  //  Each chain (or record if there are no chains) is represented by a 16-byte record whose
+  //    128-bit value packs the sort key of its first record, a,b,o,ab (or a,ab if -a), above
+  //    the offset of its first record from IBLOCK, each field in just the bits needed for the
+  //    largest value in the file.  These are LSD radix sorted on the bits of the key with
+  //    digits of at most SORT_BITS bits.  The threads take equal slices of the records and
+  //    each bucket receives the records of thread 0 first, then thread 1, and so on, so the
+  //    sort is stable and chains with equal keys stay in file order as with the qsort.
+
+#define SORT_BITS  11           //  Maximum digit width
+#define SORT_POWR  2048         //  = 2^SORT_BITS
+
+typedef struct
+  { uint64 p1;                  //  Low word, the offset is in its low OBITS bits
+    uint64 p2;                  //  High word
+  } Sort_Rec;
+
+typedef struct
+  { int    word;                //  0 = p1, 1 = p2, a digit never straddles the two
+    int    shift;
+    uint64 mask;
+  } Sort_Digit;
+
+static int        OBITS;        //  Bits of the offset
+static int        NFIELD;       //  # of key fields and their low bit and width, least
+static int        FSHIFT[4];    //    significant first
+static int        FWIDTH[4];
+
+static int        NDIGIT;
+static Sort_Digit DIGITS[16];
+
+typedef struct
+  { int64     beg;              //  Slice of the records of the current phase
+    int64     end;
+    int64     tptr[SORT_POWR];  //  Bucket histogram of the slice, then its scatter positions
+    Sort_Rec *src;
+    Sort_Rec *trg;
+    Sort_Digit *dig;
+    int       map;
+    int       tbytes;
+    int64    *off;              //  Offset of each chain in sorted order, and its span in
+    int64    *pos;              //    bytes, then its position in the output
+    int64     total;            //  Bytes of the records, or of the output for gather
+    int64     nsort;            //  Gather: # of chains and the output position of the
+    int64     base;             //    start of the output buffer
+    char     *fblock;
+  } Sort_Arg;
+
+static THREAD   *Threads;
+static Sort_Arg *Parmx;
+
+static int nbits(uint64 x)
+{ int n;
+
+  for (n = 0; x != 0; n++)
+    x >>= 1;
+  return (n);
+}
 
-    ARG_INIT("LAsort")
+  //  Run 'task' on each of Parmx[0..NTHREADS-1], in the calling thread if only 1
 
-    j = 1;
-    for (i = 1; i < argc; i++)
-      if (argv[i][0] == '-')
-        { ARG_FLAGS("va") }
+static void run_threads(void *(*task)(void *))
+{ int i;
+
+  if (NTHREADS == 1)
+    { task(Parmx);
+      return;
+    }
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(Threads+i,NULL,task,Parmx+i);
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(Threads[i],NULL);
+}
+
+  //  Set up the digits of the fields in FSHIFT & FWIDTH, cutting each at bit 64
+
+static void plan_digits()
+{ int i, j, k, w;
+  int lo, hi, cut, nb;
+
+  NDIGIT = 0;
+  for (i = 0; i < NFIELD; i++)
+    { lo = FSHIFT[i];
+      hi = lo + FWIDTH[i];
+      while (lo < hi)
+        { if (lo < 64 && hi > 64)
+            cut = 64;
+          else
+            cut = hi;
+          nb = cut-lo;
+          k  = (nb-1)/SORT_BITS + 1;
+          w  = (nb-1)/k + 1;
+          for (j = 0; j < k; j++)
+            { if (w > cut-lo)
+                w = cut-lo;
+              DIGITS[NDIGIT].word  = (lo >= 64);
+              DIGITS[NDIGIT].shift = lo - 64*(lo >= 64);
+              DIGITS[NDIGIT].mask  = (0x1llu << w) - 1;
+              NDIGIT += 1;
+              lo     += w;
+            }
+        }
+    }
+}
+
+#define SDIGIT(d,r)  ((((d)->word ? (r)->p2 : (r)->p1) >> (d)->shift) & (d)->mask)
+
+  //  Put the value v in bits [shift,shift+width) of record r
+
+static inline void pack_field(Sort_Rec *r, uint64 v, int shift)
+{ if (v == 0)
+    return;
+  if (shift >= 64)
+    r->p2 |= v << (shift-64);
+  else
+    { r->p1 |= v << shift;
+      if (shift > 0)
+        r->p2 |= v >> (64-shift);
+    }
+}
+
+  //  Replace the offsets in src[beg..end) by the packed records of their chains
+
+static void *pack_thread(void *arg)
+{ Sort_Arg   *data = (Sort_Arg *) arg;
+  Sort_Rec   *src  = data->src;
+  int         map  = data->map;
+  Las_Record *r;
+  int64       i;
+
+  for (i = data->beg; i < data->end; i++)
+    { r = (Las_Record *) (IBLOCK + src[i].p1);
+      src[i].p2 = 0;
+      pack_field(src+i,(uint64) r->abpos,FSHIFT[0]);
+      if (map)
+        pack_field(src+i,(uint64) r->aread,FSHIFT[1]);
       else
-        argv[j++] = argv[i];
-    argc = j;
+        { pack_field(src+i,(uint64) (COMP(r->flags) != 0),FSHIFT[1]);
+          pack_field(src+i,(uint64) r->bread,FSHIFT[2]);
+          pack_field(src+i,(uint64) r->aread,FSHIFT[3]);
+        }
+    }
+  return (NULL);
+}
 
-    VERBOSE   = flags['v'];
-    MAP_ORDER = flags['a'];
+static void *count_thread(void *arg)
+{ Sort_Arg   *data = (Sort_Arg *) arg;
+  Sort_Rec   *src  = data->src;
+  Sort_Digit *dig  = data->dig;
+  int64      *tptr = data->tptr;
+  int64       i;
+
+  for (i = 0; i <= (int64) dig->mask; i++)
+    tptr[i] = 0;
+  for (i = data->beg; i < data->end; i++)
+    tptr[SDIGIT(dig,src+i)] += 1;
+  return (NULL);
+}
 
-    if (argc <= 1)
-      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
-        exit (1);
+static void *scatter_thread(void *arg)
+{ Sort_Arg   *data = (Sort_Arg *) arg;
+  Sort_Rec   *src  = data->src;
+  Sort_Rec   *trg  = data->trg;
+  Sort_Digit *dig  = data->dig;
+  int64      *tptr = data->tptr;
+  int64       i;
+
+  for (i = data->beg; i < data->end; i++)
+    trg[tptr[SDIGIT(dig,src+i)]++] = src[i];
+  return (NULL);
+}
+
+  //  Sort src[0..len-1] on the digits set up by plan_digits, the result is in src or trg
+
+static Sort_Rec *radix_sort(Sort_Rec *src, Sort_Rec *trg, int64 len)
+{ Sort_Rec *x;
+  int64     y, pos;
+  int       d, b, t, npowr;
+
+  for (d = 0; d < NDIGIT; d++)
+    { npowr = DIGITS[d].mask + 1;
+      for (t = 0; t < NTHREADS; t++)
+        { Parmx[t].src = src;
+          Parmx[t].trg = trg;
+          Parmx[t].dig = DIGITS+d;
+        }
+
+      run_threads(count_thread);
+
+      //  Skip the digit if it is the same for all records, otherwise turn the counts
+      //    into the positions at which each thread scatters each bucket
+
+      y = 0;
+      for (b = 0; y == 0 && b < npowr; b++)
+        for (t = 0; t < NTHREADS; t++)
+          y += Parmx[t].tptr[b];
+      if (y == len)
+        continue;
+
+      pos = 0;
+      for (b = 0; b < npowr; b++)
+        for (t = 0; t < NTHREADS; t++)
+          { y = Parmx[t].tptr[b];
+            Parmx[t].tptr[b] = pos;
+            pos += y;
+          }
+
+      run_threads(scatter_thread);
+
+      x   = src;
+      src = trg;
+      trg = x;
+    }
+
+  return (src);
+}
+
+  //  Set off[beg..end) to the offsets of the sorted records (if src is not NULL) and
+  //    pos[beg..end) to the number of bytes of their chains
+
+static void *span_thread(void *arg)
+{ Sort_Arg *data  = (Sort_Arg *) arg;
+  Sort_Rec *src   = data->src;
+  int64    *off   = data->off;
+  int64    *pos   = data->pos;
+  int64     tb    = data->tbytes;
+  uint8    *iend  = IBLOCK + data->total;
+  uint64    omask = (OBITS >= 64 ? ~0llu : (0x1llu << OBITS) - 1);
+  uint8    *w;
+  int64     i, o;
+
+  for (i = data->beg; i < data->end; i++)
+    { if (src != NULL)
+        off[i] = o = (int64) (src[i].p1 & omask);
+      else
+        o = off[i];
+      w = IBLOCK + o;
+      do
+        w += LAS_SPAN(w,tb);
+      while (w < iend && CHAIN_NEXT(((Las_Record *) w)->flags));
+      pos[i] = (w - IBLOCK) - o;
+    }
+  return (NULL);
+}
+
+  //  Copy the chains [beg,end) of a batch to their positions in the output buffer
+
+static void *gather_thread(void *arg)
+{ Sort_Arg *data   = (Sort_Arg *) arg;
+  int64    *off    = data->off;
+  int64    *pos    = data->pos;
+  char     *fblock = data->fblock;
+  int64     base   = data->base;
+  int64     i, e;
+
+  for (i = data->beg; i < data->end; i++)
+    { if (i+1 < data->nsort)
+        e = pos[i+1];
+      else
+        e = data->total;
+      memcpy(fblock + (pos[i]-base),IBLOCK+off[i],e-pos[i]);
+    }
+  return (NULL);
+}
+
+  //  Split [beg,end) evenly over the threads
+
+static void slice_threads(int64 beg, int64 end)
+{ int t;
+
+  for (t = 0; t < NTHREADS; t++)
+    { Parmx[t].beg = beg + ((end-beg)*t)/NTHREADS;
+      Parmx[t].end = beg + ((end-beg)*(t+1))/NTHREADS;
+    }
+}
+
+  //  Sort the novl records in [iblock,iend) and write them to foutput
+
+static void sort_block(uint8 *iblock, uint8 *iend, int64 novl, int tbytes, FILE *foutput)
+{ Sort_Rec *sarr, *sorted;
+  int64    *off, *pos;
+  int64     sov, total;
+  int       radix;
+  int       t;
+
+  //  Find the offset of each chain (or record) in the first words of sarr, and the
+  //    largest value of each key field so that the keys can be packed
+
+  sarr = (Sort_Rec *) Malloc(sizeof(Sort_Rec)*2*(novl+1),"Allocating LAsort sort arrays");
+  if (sarr == NULL)
+    exit (1);
+
+  { Las_Record *r;
+    int64       o, size, j;
+    int         chains;
+    int         mina, minb, minp;
+    int         maxa, maxb, maxp, maxc;
+
+    size   = iend-iblock;
+    chains = (novl > 0 && size >= LAS_RECORD && CHAIN_START(((Las_Record *) iblock)->flags));
+
+    mina = minb = minp = 0;
+    maxa = maxb = maxp = maxc = 0;
+    sov  = 0;
+    o    = 0;
+    for (j = 0; j < novl && o + LAS_RECORD <= size; j++)
+      { r = (Las_Record *) (iblock+o);
+        if (!chains || CHAIN_START(r->flags))
+          { sarr[sov++].p1 = o;
+            if (r->aread > maxa)
+              maxa = r->aread;
+            else if (r->aread < mina)
+              mina = r->aread;
+            if (r->bread > maxb)
+              maxb = r->bread;
+            else if (r->bread < minb)
+              minb = r->bread;
+            if (r->abpos > maxp)
+              maxp = r->abpos;
+            else if (r->abpos < minp)
+              minp = r->abpos;
+            if (COMP(r->flags))
+              maxc = 1;
+          }
+        o += LAS_SPAN(r,tbytes);
       }
+
+    OBITS = nbits((uint64) o);
+    if (OBITS == 0)
+      OBITS = 1;
+    NFIELD = 0;
+    FSHIFT[NFIELD] = OBITS;
+    FWIDTH[NFIELD] = nbits(maxp);
+    NFIELD += 1;
+    if (!MAP_ORDER)
+      { FSHIFT[NFIELD] = FSHIFT[NFIELD-1] + FWIDTH[NFIELD-1];
+        FWIDTH[NFIELD] = nbits(maxc);
+        NFIELD += 1;
+        FSHIFT[NFIELD] = FSHIFT[NFIELD-1] + FWIDTH[NFIELD-1];
+        FWIDTH[NFIELD] = nbits(maxb);
+        NFIELD += 1;
+      }
+    FSHIFT[NFIELD] = FSHIFT[NFIELD-1] + FWIDTH[NFIELD-1];
+    FWIDTH[NFIELD] = nbits(maxa);
+    NFIELD += 1;
+
+    //  Radix sort unless a field is negative (garbage) or the packed keys do not fit
+
+    radix = (mina >= 0 && minb >= 0 && minp >= 0 && FSHIFT[NFIELD-1] + FWIDTH[NFIELD-1] <= 128);
   }
 
-  //  For each file do
+  IBLOCK = iblock;
+  for (t = 0; t < NTHREADS; t++)
+    { Parmx[t].map    = MAP_ORDER;
+      Parmx[t].tbytes = tbytes;
+      Parmx[t].total  = iend-iblock;
+    }
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
-  isize   = 0;
-  iblock  = NULL;
-  osize   = MEMORY * 1000000ll;
-  fblock  = Malloc(osize,"Allocating LAsort output block");
+  if (radix)
+    { plan_digits();
 
-  for (i = 1; i < argc; i++)
-    { int64    *perm;
-      FILE     *input, *foutput;
-      int64     novl, sov;
+      slice_threads(0,sov);
+      for (t = 0; t < NTHREADS; t++)
+        Parmx[t].src = sarr;
+      run_threads(pack_thread);
 
-      //  Read in the entire file and output header
+      sorted = radix_sort(sarr,sarr+(novl+1),sov);
+      if (sorted == sarr)
+        off = (int64 *) (sarr+(novl+1));
+      else
+        off = (int64 *) sarr;
+    }
 
-      { int64  size;
-        struct stat info;
-        char  *pwd, *root, *name;
+  //  Otherwise sort permutation array of ptrs to records
 
-        pwd   = PathTo(argv[i]);
-        root  = Root(argv[i],".las");
-        name  = Catenate(pwd,"/",root,".las");
-        input = Fopen(name,"r");
-        if (input == NULL)
-          exit (1);
+  else
+    { int64 j;
 
-        stat(name,&info);
-        size = info.st_size;
+      off = (int64 *) (sarr+(novl+1));
+      for (j = 0; j < sov; j++)
+        off[j] = sarr[j].p1;
+      sorted = NULL;
 
-        if (fread(&novl,sizeof(int64),1,input) != 1)
-          SYSTEM_ERROR
-        if (fread(&tspace,sizeof(int),1,input) != 1)
-          SYSTEM_ERROR
+      if (MAP_ORDER)
+        qsort(off,sov,sizeof(int64),SORT_MAP);
+      else
+        qsort(off,sov,sizeof(int64),SORT_OVL);
+    }
 
-        if (tspace <= TRACE_XOVR)
-          tbytes = sizeof(uint8);
-        else
-          tbytes = sizeof(uint16);
-
-        if (VERBOSE)
-          { printf("  %s: ",root);
-            Print_Number(novl,0,stdout);
-            printf(" records ");
-            Print_Number(size-novl*ovlsize,0,stdout);
-            printf(" trace bytes\n");
-            fflush(stdout);
+  //  Determine the span of each chain and from them its position in the output
+
+  pos = off + (novl+1);
+
+  slice_threads(0,sov);
+  for (t = 0; t < NTHREADS; t++)
+    { Parmx[t].src = sorted;
+      Parmx[t].off = off;
+      Parmx[t].pos = pos;
+    }
+  run_threads(span_thread);
+
+  { int64 j, x;
+
+    total = 0;
+    for (j = 0; j < sov; j++)
+      { x = pos[j];
+        pos[j] = total;
+        total += x;
+      }
+  }
+
+  //  Output the chains in sorted order, gathering as many as fit in the output buffer
+  //    at a time in parallel
+
+  { int64 j, k, base, end;
+
+    for (t = 0; t < NTHREADS; t++)
+      { Parmx[t].fblock = FBLOCK;
+        Parmx[t].nsort  = sov;
+        Parmx[t].total  = total;
+      }
+
+#define CHAIN_END(k)  ((k)+1 < sov ? pos[(k)+1] : total)
+
+    j = 0;
+    while (j < sov)
+      { base = pos[j];
+        for (k = j; k < sov; k++)
+          if (CHAIN_END(k) - base > OSIZE)
+            break;
+        if (k == j)
+          { Fwrite(iblock+off[j],1,CHAIN_END(j)-base,foutput);
+            j += 1;
+            continue;
           }
+        end = CHAIN_END(k-1);
 
-        foutput = Fopen(Catenate(pwd,"/",root,".S.las"),"w");
-        if (foutput == NULL)
-          exit (1);
+        slice_threads(j,k);
+        for (t = 0; t < NTHREADS; t++)
+          Parmx[t].base = base;
+        run_threads(gather_thread);
+
+        Fwrite(FBLOCK,1,end-base,foutput);
+        j = k;
+      }
+  }
 
-        Fwrite(&novl,sizeof(int64),1,foutput);
-        Fwrite(&tspace,sizeof(int),1,foutput);
+  free(sarr);
+}
 
-        free(pwd);
-        free(root);
 
-        if (size > isize)
-          { if (iblock == NULL)
-              iblock = Malloc(size+ptrsize,"Allocating LAsort input block");
-            else
-              iblock = Realloc(iblock-ptrsize,size+ptrsize,"Allocating LAsort input block");
-            if (iblock == NULL)
+/*******************************************************************************************
+ *
+ *  EXTERNAL SORT
+ *
+ ********************************************************************************************/
+
+  //  A file whose records and sort arrays do not fit in MEM_LIMIT bytes is read sequentially
+  //    in runs that do, each ending at a chain boundary.  Each run is sorted as above into
+  //    the temporary file .<root>.S.<k>.las and the runs are then merged into <root>.S.las
+  //    with the heap of LAmerge.  Ties go to the earlier run so the result is identical to
+  //    that of an in-memory sort.
+
+  //  Heap sort of records according to (aread,bread,COMP(flags),abpos) order
+
+#define COMPARE(lp,rp)				\
+  if (lp->aread > rp->aread)			\
+    bigger = 1;					\
+  else if (lp->aread < rp->aread)		\
+    bigger = 0;					\
+  else if (lp->bread > rp->bread)		\
+    bigger = 1;					\
+  else if (lp->bread < rp->bread)		\
+    bigger = 0;					\
+  else if (COMP(lp->flags) > COMP(rp->flags))	\
+    bigger = 1;					\
+  else if (COMP(lp->flags) < COMP(rp->flags))	\
+    bigger = 0;					\
+  else if (lp->path.abpos > rp->path.abpos)	\
+    bigger = 1;					\
+  else if (lp->path.abpos < rp->path.abpos)	\
+    bigger = 0;					\
+  else if (lp > rp)				\
+    bigger = 1;					\
+  else						\
+    bigger = 0;
+
+static void reheap(int s, Overlap **heap, int hsize)
+{ int      c, l, r;
+  int      bigger;
+  Overlap *hs, *hr, *hl;
+
+  c  = s;
+  hs = heap[s];
+  while ((l = 2*c) <= hsize)
+    { r  = l+1;
+      hl = heap[l];
+      if (r > hsize)
+        bigger = 1;
+      else
+        { hr = heap[r];
+          COMPARE(hr,hl)
+        }
+      if (bigger)
+        { COMPARE(hs,hl)
+          if (bigger)
+            { heap[c] = hl;
+              c = l;
+            }
+          else
+            break;
+        }
+      else
+        { COMPARE(hs,hr)
+          if (bigger)
+            { heap[c] = hr;
+              c = r;
+            }
+          else
+            break;
+        }
+    }
+  if (c != s)
+    heap[c] = hs;
+}
+
+  //  Heap sort of records according to (aread,abpos) order
+
+#define MAPARE(lp,rp)				\
+  if (lp->aread > rp->aread)			\
+    bigger = 1;					\
+  else if (lp->aread < rp->aread)		\
+    bigger = 0;					\
+  else if (lp->path.abpos > rp->path.abpos)	\
+    bigger = 1;					\
+  else if (lp->path.abpos < rp->path.abpos)	\
+    bigger = 0;					\
+  else if (lp > rp)				\
+    bigger = 1;					\
+  else						\
+    bigger = 0;
+
+static void maheap(int s, Overlap **heap, int hsize)
+{ int      c, l, r;
+  int      bigger;
+  Overlap *hs, *hr, *hl;
+
+  c  = s;
+  hs = heap[s];
+  while ((l = 2*c) <= hsize)
+    { r  = l+1;
+      hl = heap[l];
+      if (r > hsize)
+        bigger = 1;
+      else
+        { hr = heap[r];
+          MAPARE(hr,hl)
+        }
+      if (bigger)
+        { MAPARE(hs,hl)
+          if (bigger)
+            { heap[c] = hl;
+              c = l;
+            }
+          else
+            break;
+        }
+      else
+        { MAPARE(hs,hr)
+          if (bigger)
+            { heap[c] = hr;
+              c = r;
+            }
+          else
+            break;
+        }
+    }
+  if (c != s)
+    heap[c] = hs;
+}
+
+static char *run_name(char *pwd, char *root, int k)
+{ return (Catenate(pwd,"/.",root,Numbered_Suffix(".S.",k,".las"))); }
+
+  //  Sort the novl records in [beg,end) into run k
+
+static void spill_run(uint8 *beg, uint8 *end, int64 novl, Las_File *input,
+                      char *pwd, char *root, int k)
+{ FILE *rfile;
+
+  rfile = Fopen(run_name(pwd,root,k),"w");
+  if (rfile == NULL)
+    exit (1);
+  Fwrite(&novl,sizeof(int64),1,rfile);
+  Fwrite(&(input->tspace),sizeof(int),1,rfile);
+  sort_block(beg,end,novl,input->tbytes,rfile);
+  Fclose(rfile);
+
+  if (VERBOSE)
+    { printf("    run %d: ",k);
+      Print_Number(novl,0,stdout);
+      printf(" records\n");
+      fflush(stdout);
+    }
+}
+
+  //  Sort the records of input, opened sequentially, and write them to foutput
+
+static void external_sort(Las_File *input, FILE *foutput, char *pwd, char *root)
+{ uint8    *rblock, *rptr, *rtop, *chain;
+  int64     rsize, rnovl, cnovl;
+  int       nruns, k;
+  Overlap  *ov;
+
+  //  A run of r bytes has at most r/LAS_RECORD records, each needing 2 Sort_Recs
+
+  rsize  = ((MEM_LIMIT - OSIZE) * LAS_RECORD) / (LAS_RECORD + 2*((int64) sizeof(Sort_Rec)));
+  rblock = (uint8 *) Malloc(rsize,"Allocating LAsort run block");
+  if (rblock == NULL)
+    exit (1);
+  rtop = rblock + rsize;
+
+  //  Cut the input into runs, the chain being read starts at 'chain' and has cnovl records
+  //    so far.  A chain that does not fit in an empty run enlarges the run buffer.
+
+  nruns = 0;
+  rptr  = chain = rblock;
+  rnovl = cnovl = 0;
+  while ((ov = Next_Las(input)) != NULL)
+    { if (!CHAIN_NEXT(ov->flags))
+        { chain = rptr;
+          cnovl = 0;
+        }
+      while (rptr + input->span > rtop)
+        if (chain > rblock)
+          { spill_run(rblock,chain,rnovl-cnovl,input,pwd,root,++nruns);
+            memmove(rblock,chain,rptr-chain);
+            rptr  = rblock + (rptr-chain);
+            chain = rblock;
+            rnovl = cnovl;
+          }
+        else
+          { int64 full = rptr-rblock;
+
+            rsize  = full + input->span;
+            rblock = (uint8 *) Realloc(rblock,rsize,"Enlarging LAsort run block");
+            if (rblock == NULL)
               exit (1);
-            iblock += ptrsize;
-            isize   = size;
+            rptr  = rblock + full;
+            chain = rblock;
+            rtop  = rblock + rsize;
           }
-        size -= (sizeof(int64) + sizeof(int));
-        if (size > 0)
-          { if (fread(iblock,size,1,input) != 1)
-              SYSTEM_ERROR
+      memcpy(rptr,input->rec,input->span);
+      rptr  += input->span;
+      rnovl += 1;
+      cnovl += 1;
+    }
+  if (rptr > rblock || nruns == 0)
+    spill_run(rblock,rptr,rnovl,input,pwd,root,++nruns);
+  free(rblock);
+
+  if (input->nread != input->novl)
+    { fprintf(stderr,"%s: %s has %lld records, not %lld as its header states\n",
+                     Prog_Name,input->name,input->nread,input->novl);
+      for (k = 1; k <= nruns; k++)
+        unlink(run_name(pwd,root,k));
+      exit (1);
+    }
+
+  //  Merge the runs into the output
+
+  { Las_File **in;
+    Overlap  **heap;
+    Overlap   *ovls;
+    int        i, hsize;
+    char      *optr, *otop;
+
+    in   = (Las_File **) Malloc(sizeof(Las_File *)*nruns,"Allocating LAsort runs");
+    heap = (Overlap **) Malloc(sizeof(Overlap *)*(nruns+1),"Allocating heap");
+    ovls = (Overlap *) Malloc(sizeof(Overlap)*nruns,"Allocating heap");
+    if (in == NULL || heap == NULL || ovls == NULL)
+      exit (1);
+
+    hsize = 0;
+    for (i = 0; i < nruns; i++)
+      { in[i] = Open_Las(run_name(pwd,root,i+1),LAS_SEQUENTIAL);
+        if (in[i] == NULL)
+          exit (1);
+        ov = Next_Las(in[i]);
+        if (ov != NULL)
+          { ovls[i]     = *ov;
+            hsize      += 1;
+            heap[hsize] = ovls + i;
           }
-        fclose(input);
-        iend = iblock + (size - ptrsize);
       }
 
-      //  Set up unsorted permutation array
+    if (hsize > 3)
+      { if (MAP_ORDER)
+          for (i = hsize/2; i > 1; i--)
+            maheap(i,heap,hsize);
+        else
+          for (i = hsize/2; i > 1; i--)
+            reheap(i,heap,hsize);
+      }
+
+    optr = FBLOCK;
+    otop = FBLOCK + OSIZE;
+    while (hsize > 0)
+      { Overlap  *nx;
+        Las_File *src;
 
-      perm = (int64 *) Malloc(sizeof(int64)*novl,"Allocating LAsort permutation vector");
-      if (perm == NULL)
-        exit (1);
+        if (MAP_ORDER)
+          maheap(1,heap,hsize);
+        else
+          reheap(1,heap,hsize);
 
-      { int64 off;
-        int   j;
+        ov  = heap[1];
+        src = in[ov - ovls];
 
-        if (CHAIN_START(((Overlap *) (iblock-ptrsize))->flags))
-          { sov = 0;
-            off = -ptrsize;
-            for (j = 0; j < novl; j++)
-              { if (CHAIN_START(((Overlap *) (iblock+off))->flags))
-                  perm[sov++] = off;
-                off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
+        do
+          { if (optr + src->span > otop)
+              { Fwrite(FBLOCK,1,optr-FBLOCK,foutput);
+                optr = FBLOCK;
               }
-          }
-        else
-          { off = -ptrsize;
-            for (j = 0; j < novl; j++)
-              { perm[j] = off;
-                off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
+            if (src->span > OSIZE)
+              Fwrite(src->rec,1,src->span,foutput);
+            else
+              { memcpy(optr,src->rec,src->span);
+                optr += src->span;
+              }
+
+            nx = Next_Las(src);
+            if (nx == NULL)
+              { heap[1] = heap[hsize];
+                hsize  -= 1;
+                break;
               }
-            sov = novl;
+            *ov = *nx;
           }
+        while (CHAIN_NEXT(ov->flags));
       }
+    if (optr > FBLOCK)
+      Fwrite(FBLOCK,1,optr-FBLOCK,foutput);
 
-      //  Sort permutation array of ptrs to records
+    for (i = 0; i < nruns; i++)
+      { Close_Las(in[i]);
+        unlink(run_name(pwd,root,i+1));
+      }
 
-      IBLOCK = iblock;
-      if (MAP_ORDER)
-        qsort(perm,sov,sizeof(int64),SORT_MAP);
+    free(ovls);
+    free(heap);
+    free(in);
+  }
+}
+
+int main(int argc, char *argv[])
+{ int       i;
+
+  //  Process options
+
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+
+    ARG_INIT("LAsort")
+
+    NTHREADS  = 4;
+    MEM_LIMIT = 0;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("va")
+            break;
+          case 'M':
+            { int limit;
+
+              ARG_POSITIVE(limit,"Memory allocation (in Gb)")
+              MEM_LIMIT = limit * 0x40000000ll;
+              break;
+            }
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
       else
-        qsort(perm,sov,sizeof(int64),SORT_OVL);
-
-      //  Output the records in sorted order
-
-      { int      j;
-        Overlap *w;
-        int64    tsize, span;
-        char    *fptr, *ftop, *wo;
-
-        fptr = fblock;
-        ftop = fblock + osize;
-        for (j = 0; j < sov; j++)
-          { w = (Overlap *) (wo = iblock+perm[j]);
-            do
-              { tsize = w->path.tlen*tbytes;
-                span  = ovlsize + tsize;
-                if (fptr + span > ftop)
-                  { Fwrite(fblock,1,fptr-fblock,foutput);
-                    fptr = fblock;
-                  }
-                memcpy(fptr,((char *) w)+ptrsize,ovlsize);
-                fptr += ovlsize;
-                memcpy(fptr,(char *) (w+1),tsize);
-                fptr += tsize;
-                w = (Overlap *) (wo += span);
-              }
-            while (wo < iend && CHAIN_NEXT(w->flags));
-          }
-        if (fptr > fblock)
-          Fwrite(fblock,1,fptr-fblock,foutput);
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE   = flags['v'];
+    MAP_ORDER = flags['a'];
+
+    if (argc <= 1)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
+        fprintf(stderr,"      -a: Sort on (a,ab) alone, as for a mapping to a reference.\n");
+        fprintf(stderr,"      -M: Use no more than -M Gb of memory, sorting in runs if needed.\n");
+        fprintf(stderr,"      -T: Use -T threads.\n");
+        exit (1);
       }
+  }
+
+  //  The output buffer takes at most an eighth of the memory limit
+
+  OSIZE = MEMORY * 1000000ll;
+  if (MEM_LIMIT > 0 && OSIZE > MEM_LIMIT/8)
+    OSIZE = MEM_LIMIT/8;
+  FBLOCK  = Malloc(OSIZE,"Allocating LAsort output block");
+  Threads = (THREAD *) Malloc(sizeof(THREAD)*NTHREADS,"Allocating LAsort threads");
+  Parmx   = (Sort_Arg *) Malloc(sizeof(Sort_Arg)*NTHREADS,"Allocating LAsort threads");
+  if (FBLOCK == NULL || Threads == NULL || Parmx == NULL)
+    exit (1);
+
+  //  For each file do
+
+  for (i = 1; i < argc; i++)
+    { Las_File   *input;
+      FILE       *foutput;
+      char       *pwd, *root;
+      struct stat info;
+      int64       size, novl;
+      int         external;
+
+      pwd  = PathTo(argv[i]);
+      root = Root(argv[i],".las");
+
+      //  Sort in runs if the records and two Sort_Recs per record (at most) exceed -M
+
+      external = 0;
+      if (MEM_LIMIT > 0 && stat(Catenate(pwd,"/",root,".las"),&info) == 0)
+        { size = info.st_size - LAS_HEADER;
+          if (size + (size/LAS_RECORD+1)*2*((int64) sizeof(Sort_Rec)) > MEM_LIMIT - OSIZE)
+            external = 1;
+        }
+
+      input = Open_Las(Catenate(pwd,"/",root,".las"),external ? LAS_SEQUENTIAL : LAS_RANDOM);
+      if (input == NULL)
+        exit (1);
+      novl = input->novl;
+      if (external)
+        size = info.st_size - LAS_HEADER;
+      else
+        size = input->top - input->data;
+
+      if (VERBOSE)
+        { printf("  %s: ",root);
+          Print_Number(novl,0,stdout);
+          printf(" records ");
+          Print_Number(size-novl*LAS_RECORD,0,stdout);
+          printf(" trace bytes\n");
+          fflush(stdout);
+        }
+
+      foutput = Fopen(Catenate(pwd,"/",root,".S.las"),"w");
+      if (foutput == NULL)
+        exit (1);
+
+      Fwrite(&novl,sizeof(int64),1,foutput);
+      Fwrite(&(input->tspace),sizeof(int),1,foutput);
+
+      if (external)
+        external_sort(input,foutput,pwd,root);
+      else
+        sort_block(input->data,input->top,novl,input->tbytes,foutput);
 
-      free(perm);
       Fclose(foutput);
+      Close_Las(input);
+      free(pwd);
+      free(root);
     }
 
-  if (iblock != NULL)
-    free(iblock - ptrsize);
-  free(fblock);
+  free(Parmx);
+  free(Threads);
+  free(FBLOCK);
 
   exit (0);
 }
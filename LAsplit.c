@@ -18,16 +18,18 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
 static char *Usage = "-v <align:las> (<parts:int> | <path:db|dam>) < <source>.las";
 
 #define MEMORY   1000   //  How many megabytes for output buffer
 
 int main(int argc, char *argv[])
-{ char     *iblock, *oblock;
+{ char     *oblock;
+  Las_File *input;
   FILE     *output, *dbvis;
-  int64     novl, bsize, ovlsize, ptrsize;
-  int       parts, tspace, tbytes;
+  int64     novl, bsize;
+  int       parts, tspace;
   int       olast, blast;
   char     *pwd, *root, *root2;
 
@@ -104,14 +106,10 @@ int main(int argc, char *argv[])
       }
   }
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
   bsize   = MEMORY * 1000000ll;
   oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
+  if (oblock == NULL)
     exit (1);
-  iblock += ptrsize;
 
   pwd   = PathTo(argv[1]);
   root  = Root(argv[1],".las");
@@ -127,14 +125,11 @@ int main(int argc, char *argv[])
     }
   *root2++ = '\0';
 
-  if (fread(&novl,sizeof(int64),1,stdin) != 1)
-    SYSTEM_ERROR
-  if (fread(&tspace,sizeof(int),1,stdin) != 1)
-    SYSTEM_ERROR
-  if (tspace <= TRACE_XOVR)
-    tbytes = sizeof(uint8);
-  else
-    tbytes = sizeof(uint16);
+  input = Open_Las(NULL,LAS_SEQUENTIAL);
+  if (input == NULL)
+    exit (1);
+  novl   = input->novl;
+  tspace = input->tspace;
 
   if (VERBOSE)
     fprintf(stderr,"  Distributing %lld la\'s\n",novl);
@@ -142,12 +137,10 @@ int main(int argc, char *argv[])
   { int      i, j;
     Overlap *w;
     int      low, hgh, last;
-    int64    tsize, povl;
-    char    *iptr, *itop;
+    int64    povl;
     char    *optr, *otop;
 
-    iptr = iblock;
-    itop = iblock + fread(iblock,1,bsize,stdin);
+    w = Next_Las(input);
 
     hgh = 0;
     for (i = 0; i < parts; i++)
@@ -175,16 +168,9 @@ int main(int argc, char *argv[])
         otop = oblock + bsize;
 
         for (j = low; j < novl; j++)
-          { if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
+          { if (w == NULL)
+              SYSTEM_ERROR
 
-            w = (Overlap *) (iptr-ptrsize);
             if (dbvis == NULL)
               { if (j >= hgh && w->aread > last)
                   break;
@@ -195,27 +181,15 @@ int main(int argc, char *argv[])
                   break;
               }
 
-            tsize = w->path.tlen*tbytes;
-            if (optr + ovlsize + tsize > otop)
+            if (optr + input->span > otop)
               { fwrite(oblock,1,optr-oblock,output);
                 optr = oblock;
               }
             
-            memcpy(optr,iptr,ovlsize);
-            optr += ovlsize;
-            iptr += ovlsize;
-
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memcpy(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
-	    memcpy(optr,iptr,tsize);
-            optr += tsize;
-            iptr += tsize;
+            memcpy(optr,input->rec,input->span);
+            optr += input->span;
+
+            w = Next_Las(input);
           }
         hgh = j;
 
@@ -235,7 +209,7 @@ int main(int argc, char *argv[])
 
   free(pwd);
   free(root);
-  free(iblock-ptrsize);
+  Close_Las(input);
   free(oblock);
 
   exit (0);
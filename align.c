@@ -20,6 +20,12 @@
 #include <unistd.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define X86_SIMD         //  SSE2 snake extension in the O(NP) trace algorithms
+#include <emmintrin.h>
+#endif
 
 #include "DB.h"
 #include "align.h"
@@ -57,6 +63,8 @@ typedef struct            //  Hidden from the user, working space for each threa
     void   *points;
     int     tramax;
     void   *trace;
+    int64   bchmax;
+    void   *batch;
   } _Work_Data;
 
 Work_Data *New_Work_Data()
@@ -73,6 +81,8 @@ Work_Data *New_Work_Data()
   work->trace  = NULL;
   work->celmax = 0;
   work->cells  = NULL;
+  work->bchmax = 0;
+  work->batch  = NULL;
   return ((Work_Data *) work);
 }
 
@@ -125,6 +135,8 @@ void Free_Work_Data(Work_Data *ework)
     free(work->trace);
   if (work->points != NULL)
     free(work->points);
+  if (work->batch != NULL)
+    free(work->batch);
   free(work);
 }
 
@@ -312,6 +324,12 @@ static void print_wave(int *V, int *M, int low, int hgh, int besta)
      recording the last TRIM_LEN columns of the implied alignment (T), and the
      # of matches (1-bits) in the bitvector (M).                               */
 
+/* The wave step is deliberately scalar.  All but one or two of the diagonals of a wave are off
+     the best path and their snakes end at the first or second base, and the trace-point and
+     trim bookkeeping of each diagonal must be done in diagonal order, so neither comparing
+     16 bases at a time nor selecting the predecessors of several diagonals at once pays,
+     not even on 99% identity reads.                                                         */
+
 typedef struct
   { int ptr;
     int diag;
@@ -3859,6 +3877,67 @@ void Alignment_Cartoon(FILE *file, Alignment *align, int indent, int coord)
 *                                                                                        *
 \****************************************************************************************/
 
+  //  The snakes of the trace algorithms are extended 16 bases at a time with SSE2 (8 at a time
+  //    on other little-endian machines): fwd_snake returns the first j' >= j such that a[j'] !=
+  //    b[j'] or j' = e, and rev_snake returns the last c' <= c such that a[c'] != b[c'] or
+  //    c' = m-1.  Only a[j..e-1] and b[j..e-1] (resp. a[m..c] and b[m..c]) are ever touched.
+
+static inline int fwd_snake(char *a, char *b, int j, int e)
+{
+#ifdef X86_SIMD
+  uint32 x;
+
+  while (j+16 <= e)
+    { x = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (a+j)),
+                                           _mm_loadu_si128((__m128i *) (b+j))));
+      if (x != 0xffff)
+        return (j + __builtin_ctz(~x));
+      j += 16;
+    }
+#elif defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64 x, y;
+
+  while (j+8 <= e)
+    { memcpy(&x,a+j,8);
+      memcpy(&y,b+j,8);
+      if (x != y)
+        return (j + (__builtin_ctzll(x^y) >> 3));
+      j += 8;
+    }
+#endif
+  while (j < e && a[j] == b[j])
+    j += 1;
+  return (j);
+}
+
+static inline int rev_snake(char *a, char *b, int c, int m)
+{
+#ifdef X86_SIMD
+  uint32 x;
+
+  while (c-15 >= m)
+    { x = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (a+(c-15))),
+                                           _mm_loadu_si128((__m128i *) (b+(c-15)))));
+      if (x != 0xffff)
+        return (c - (__builtin_clz(~x << 16)));
+      c -= 16;
+    }
+#elif defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64 x, y;
+
+  while (c-7 >= m)
+    { memcpy(&x,a+(c-7),8);
+      memcpy(&y,b+(c-7),8);
+      if (x != y)
+        return (c - (__builtin_clzll(x^y) >> 3));
+      c -= 8;
+    }
+#endif
+  while (c >= m && a[c] == b[c])
+    c -= 1;
+  return (c);
+}
+
 
 #ifdef DEBUG_AWAVE
 
@@ -3928,11 +4007,9 @@ static int dandc_nd(char *A, int M, char *B, int N, Trace_Waves *wave)
 
     y = 0;
     if (N < M)
-      while (y < N && B[y] == A[y])
-        y += 1;
+      y = fwd_snake(A,B,y,N);
     else
-      { while (y < M && B[y] == A[y])
-          y += 1;
+      { y = fwd_snake(A,B,y,M);
         if (y >= M && N == M)
           return (0);
       }
@@ -3945,11 +4022,9 @@ static int dandc_nd(char *A, int M, char *B, int N, Trace_Waves *wave)
     a = A-x;
     y = N-1;
     if (N > M)
-      while (y >= x && B[y] == a[y])
-        y -= 1;
+      y = rev_snake(a,B,y,x);
     else
-      while (y >= 0 && B[y] == a[y])
-        y -= 1;
+      y = rev_snake(a,B,y,0);
 
     blow = bhgh = -x;
     VB += x;
@@ -3999,11 +4074,9 @@ static int dandc_nd(char *A, int M, char *B, int N, Trace_Waves *wave)
               }
 
             if (N < x)
-              while (y < N && B[y] == a[y])
-                y += 1;
+              y = fwd_snake(a,B,y,N);
             else
-              while (y < x && B[y] == a[y])
-                y += 1;
+              y = fwd_snake(a,B,y,x);
             
             VF[k] = y;
             a -= 1;
@@ -4055,11 +4128,9 @@ static int dandc_nd(char *A, int M, char *B, int N, Trace_Waves *wave)
 
             y -= 1;
             if (x > 0)
-              while (y >= x && B[y] == a[y])
-                y -= 1;
+              y = rev_snake(a,B,y,x);
             else
-              while (y >= 0 && B[y] == a[y])
-                y -= 1;
+              y = rev_snake(a,B,y,0);
 
             VB[k] = y;
             a -= 1;
@@ -4269,11 +4340,9 @@ static int iter_np(char *A, int M, char *B, int N, Trace_Waves *wave, int mode)
       }						\
 						\
   if (N < i)					\
-    while (j < N && B[j] == a[j])		\
-      j += 1;					\
+    j = fwd_snake(a,B,j,N);			\
   else						\
-    while (j < i && B[j] == a[j])		\
-      j += 1;					\
+    j = fwd_snake(a,B,j,i);			\
   F0[k] = j;
 
         j = -2;
@@ -4344,8 +4413,7 @@ static int iter_np(char *A, int M, char *B, int N, Trace_Waves *wave, int mode)
                 m = 0;
               if (PVF[D][h] <= c)
                 c = PVF[D][h]-1;
-              while (c >= m && a[c] == B[c])
-                c -= 1;
+              c = rev_snake(a,B,c,m);
               if (e == -1)  //  => edge is 2, others are 1, and 0
                 { if (c <= PVF[D+2][k+1])
                     { e = 4;
@@ -4410,8 +4478,7 @@ static int iter_np(char *A, int M, char *B, int N, Trace_Waves *wave, int mode)
                 m = 0;
               if (PVF[D][h] < c)
                 c = PVF[D][h];
-              while (c >= m && a[c] == B[c])
-                c -= 1;
+              c = rev_snake(a,B,c,m);
               if (e == 1)  //  => edge is 2, others are 1, and 0
                 { if (c < PVF[D+2][k-1])
                     { e = 2;
@@ -4641,8 +4708,7 @@ static int middle_np(char *A, int M, char *B, int N, Trace_Waves *wave, int mode
                 m = 0;
               if (PVF[D][h] <= c)
                 c = PVF[D][h]-1;
-              while (c >= m && a[c] == B[c])
-                c -= 1;
+              c = rev_snake(a,B,c,m);
               if (e == -1)  //  => edge is 2, others are 1, and 0
                 { if (c <= PVF[D+2][k+1])
                     { e = 4;
@@ -4705,8 +4771,7 @@ static int middle_np(char *A, int M, char *B, int N, Trace_Waves *wave, int mode
                 m = 0;
               if (PVF[D][h] < c)
                 c = PVF[D][h];
-              while (c >= m && a[c] == B[c])
-                c -= 1;
+              c = rev_snake(a,B,c,m);
               if (e == 1)  //  => edge is 2, others are 1, and 0
                 { if (c < PVF[D+2][k-1])
                     { e = 2;
@@ -5060,6 +5125,116 @@ int Compute_Trace_MID(Alignment *align, Work_Data *ework, int trace_spacing, int
   return (0);
 }
 
+  //  Compute_Traces_PTS_Batch: each thread repeatedly claims the next alignment of the batch,
+  //    computes its trace with Compute_Trace_PTS, and appends the trace to the batch vector
+  //    of its Work_Data.  As a thread claims alignments in increasing order, the traces of
+  //    the alignments it did lie in order in its batch vector, so once all threads are done
+  //    each trace pointer is set by a single sweep that tracks an offset per thread.
+
+typedef struct
+  { Alignment **align;
+    int         nalign;
+    int         next;      //  Next alignment to claim
+    int        *owner;     //  owner[i] = thread that computed the trace of align[i]
+    int         space;
+    int         mode;
+  } Batch_Job;
+
+typedef struct
+  { int          tnum;
+    _Work_Data  *work;
+    Batch_Job   *job;
+    int          error;
+  } Batch_Arg;
+
+static void *batch_thread(void *arg)
+{ Batch_Arg  *data = (Batch_Arg *) arg;
+  _Work_Data *work = data->work;
+  Batch_Job  *job  = data->job;
+  Alignment  *align;
+  int64       len, tlen, max;
+  void       *vec;
+  int         i;
+
+  len = 0;
+  while ((i = __sync_fetch_and_add(&(job->next),1)) < job->nalign)
+    { align = job->align[i];
+      if (Compute_Trace_PTS(align,work,job->space,job->mode))
+        { data->error = 1;
+          break;
+        }
+      tlen = align->path->tlen*sizeof(int);
+      if (len + tlen > work->bchmax)
+        { max = ((int64) ((len+tlen)*1.2)) + 10000;
+          vec = Realloc(work->batch,max,"Enlarging batch trace vector");
+          if (vec == NULL)
+            { data->error = 1;
+              break;
+            }
+          work->bchmax = max;
+          work->batch  = vec;
+        }
+      memcpy(((char *) work->batch) + len,align->path->trace,tlen);
+      len += tlen;
+      job->owner[i] = data->tnum;
+    }
+
+  return (NULL);
+}
+
+int Compute_Traces_PTS_Batch(Alignment **align, int nalign, Work_Data **ework, int nthreads,
+                             int trace_spacing, int mode)
+{ pthread_t threads[nthreads];
+  Batch_Arg parmt[nthreads];
+  int64     off[nthreads];
+  Batch_Job job;
+  int       i, t, error;
+
+  job.owner = (int *) Malloc(sizeof(int)*(nalign+1),"Allocating batch owner vector");
+  if (job.owner == NULL)
+    EXIT(1);
+  job.align  = align;
+  job.nalign = nalign;
+  job.next   = 0;
+  job.space  = trace_spacing;
+  job.mode   = mode;
+
+  for (t = 0; t < nthreads; t++)
+    { parmt[t].tnum  = t;
+      parmt[t].work  = (_Work_Data *) ework[t];
+      parmt[t].job   = &job;
+      parmt[t].error = 0;
+    }
+
+  if (nthreads == 1)
+    batch_thread(parmt);
+  else
+    { for (t = 0; t < nthreads; t++)
+        pthread_create(threads+t,NULL,batch_thread,parmt+t);
+      for (t = 0; t < nthreads; t++)
+        pthread_join(threads[t],NULL);
+    }
+
+  error = 0;
+  for (t = 0; t < nthreads; t++)
+    { error |= parmt[t].error;
+      off[t] = 0;
+    }
+
+  if ( ! error)
+    for (i = 0; i < nalign; i++)
+      { t = job.owner[i];
+        align[i]->path->trace = ((int *) parmt[t].work->batch) + off[t];
+        off[t] += align[i]->path->tlen;
+      }
+
+  free(job.owner);
+
+  if (error)
+    EXIT(1);
+  return (0);
+}
+
 int Compute_Trace_IRR(Alignment *align, Work_Data *ework, int mode)
 { _Work_Data *work = (_Work_Data *) ework;
   Trace_Waves wave;
@@ -255,6 +255,17 @@ void Complement_Seq(char *a, int n);
   int Compute_Trace_PTS(Alignment *align, Work_Data *work, int trace_spacing, int mode);
   int Compute_Trace_MID(Alignment *align, Work_Data *work, int trace_spacing, int mode);
 
+  /* Compute_Traces_PTS_Batch computes the traces of the 'nalign' alignments align[0..nalign-1]
+     exactly as Compute_Trace_PTS would, dividing the work dynamically amongst 'nthreads'
+     threads where thread t uses the Work_Data work[t].  Each alignment's sequences must stay
+     in place until the call returns.  Upon return the trace of each alignment is held in the
+     storage of one of the work objects and remains valid until the next call of this routine
+     with that Work_Data.  It returns 1 if an error occurred and 0 otherwise.
+  */
+
+  int Compute_Traces_PTS_Batch(Alignment **align, int nalign, Work_Data **work, int nthreads,
+                               int trace_spacing, int mode);
+
   /* Compute_Trace_IRR (IRR for IRRegular) computes a trace for the given alignment where
      it assumes the spacing between trace points between both the A and B read varies, and
      futher assumes that the A-spacing is given in the short integers normally occupied by
@@ -49,7 +49,7 @@
 #include "filter.h"
 
 static char *Usage[] =
-  { "[-vbAI] [-k<int(14)>] [-w<int(6)>] [-h<int(35)>] [-t<int>] [-M<int>]",
+  { "[-vbAISXOL] [-k<int(14)>] [-w<int(6)>] [-h<int(35)>] [-t<int>] [-M<int>]",
     "        [-e<double(.70)] [-l<int(1000)>] [-s<int(100)>] [-H<int>] [-T<int(4)>]",
     "        [-m<track>]+ <subject:db|dam> <target:db|dam> ...",
   };
@@ -60,6 +60,8 @@ int     MINOVER;
 int     HGAP_MIN;
 int     SYMMETRIC;
 int     IDENTITY;
+int     STREAM;
+int     SORTED;
 uint64  MEM_LIMIT;
 uint64  MEM_PHYSICAL;
 
@@ -517,13 +519,62 @@ static HITS_DB *complement_DB(HITS_DB *block, int inplace)
   return (cblock);
 }
 
+  //  With -X the sorted k-mer list of a block is kept in the hidden file .<root>.[N|C].kdx
+  //    next to the block's .db and is mapped back in by later runs instead of being rebuilt.
+
+static int   KEEP_INDEX;
+static char *MASK_LIST;     //  Concatenated -m track names, part of an index's identity
+static int   ONE_FILE;      //  -O: one .las file per block pair (see Open_Match_Output)
+
+static void *get_index(char *file, char *root, HITS_DB *block, int comp, int *len)
+{ char *pwd, *path, *name;
+  void *index;
+
+  if (comp)
+    name = Strdup(Catenate("c(",root,")",""),"Allocating index name");
+  else
+    name = Strdup(root,"Allocating index name");
+  if (name == NULL)
+    exit (1);
+
+  if (!KEEP_INDEX)
+    { if (VERBOSE)
+        printf("\nBuilding index for %s\n",name);
+      free(name);
+      return (Sort_Kmers(block,len));
+    }
+
+  pwd  = PathTo(file);
+  path = Strdup(Catenate(pwd,"/.",root,comp ? ".C.kdx" : ".N.kdx"),"Allocating index path");
+  if (path == NULL)
+    exit (1);
+  free(pwd);
+
+  index = Load_Kmer_Index(path,block,MASK_LIST,len);
+  if (index != NULL)
+    { if (VERBOSE)
+        printf("\nMapping index for %s\n",name);
+    }
+  else
+    { if (VERBOSE)
+        printf("\nBuilding index for %s\n",name);
+      index = Sort_Kmers(block,len);
+      if (index != NULL)
+        Save_Kmer_Index(path,block,MASK_LIST,index,*len);
+    }
+
+  free(path);
+  free(name);
+  return (index);
+}
+
 int main(int argc, char *argv[])
 { HITS_DB    _ablock, _bblock;
   HITS_DB    *ablock = &_ablock, *bblock = &_bblock;
   char       *afile,  *bfile;
   char       *aroot,  *broot;
-  void       *aindex, *bindex;
-  int         alen,    blen;
+  void       *aindex, *bindex, *cindex;
+  int         alen,    blen,    clen;
   Align_Spec *asettings;
   int         isdam;
   int         MMAX, MTOP, *MSTAT;
@@ -572,7 +623,7 @@ int main(int argc, char *argv[])
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("vbAI")
+            ARG_FLAGS("vbAISXOL")
             break;
           case 'k':
             ARG_POSITIVE(KMER_LEN,"K-mer length")
@@ -636,6 +687,15 @@ int main(int argc, char *argv[])
     BIASED    = flags['b'];   //  Globally declared in filter.h
     SYMMETRIC = 1-flags['A'];
     IDENTITY  = flags['I'];
+    STREAM    = flags['S'];
+    SORTED    = flags['L'];
+    KEEP_INDEX = flags['X'];
+    ONE_FILE   = flags['O'];
+
+    if (SORTED && ONE_FILE)
+      { fprintf(stderr,"%s: -L and -O cannot be used together\n",Prog_Name);
+        exit (1);
+      }
 
     if (argc <= 2)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -646,6 +706,18 @@ int main(int argc, char *argv[])
 
     for (j = 0; j < MTOP; j++)
       MSTAT[j] = -2;
+
+    k = 1;
+    for (j = 0; j < MTOP; j++)
+      k += strlen(MASK[j]) + 1;
+    MASK_LIST = (char *) Malloc(k,"Allocating mask list");
+    if (MASK_LIST == NULL)
+      exit (1);
+    MASK_LIST[0] = '\0';
+    for (j = 0; j < MTOP; j++)
+      { strcat(MASK_LIST,MASK[j]);
+        strcat(MASK_LIST," ");
+      }
   }
 
   MINOVER *= 2;
@@ -669,7 +741,8 @@ int main(int argc, char *argv[])
 
   { int i, j;
 
-    aindex = NULL;
+    aindex = cindex = NULL;
+    alen   = clen   = 0;
     broot  = NULL;
     for (i = 2; i < argc; i++)
       { bfile = argv[i];
@@ -691,39 +764,58 @@ int main(int argc, char *argv[])
                   printf("%s: Warning: %s track is not a mask track.\n",Prog_Name,MASK[j]);
               }
 
-            if (VERBOSE)
-              printf("\nBuilding index for %s\n",aroot);
-            aindex = Sort_Kmers(ablock,&alen);
+            aindex = get_index(afile,aroot,ablock,0,&alen);
+
+            //  Unless -b, the k-mers of c(X) are exactly the complements of those of X, so
+            //    comparing c(A) to B is the same as comparing A to c(B).  Index c(A) once
+            //    for all targets by complementing A in place and back again.
+
+            if (!BIASED)
+              { complement_DB(ablock,1);
+                cindex = get_index(afile,aroot,ablock,1,&clen);
+                complement_DB(ablock,1);
+              }
           }
 
         if (strcmp(afile,bfile) != 0)
-          { if (VERBOSE)
-              printf("\nBuilding index for %s\n",broot);
-            bindex = Sort_Kmers(bblock,&blen);
+          { bindex = get_index(bfile,broot,bblock,0,&blen);
+            if (ONE_FILE)
+              Open_Match_Output(aroot,broot,asettings);
             Match_Filter(aroot,ablock,broot,bblock,aindex,alen,bindex,blen,0,asettings);
 
-            bblock = complement_DB(bblock,1);
-            if (VERBOSE)
-              printf("\nBuilding index for c(%s)\n",broot);
-            bindex = Sort_Kmers(bblock,&blen);
-            Match_Filter(aroot,ablock,broot,bblock,aindex,alen,bindex,blen,1,asettings);
+            if (BIASED)
+              { Free_Kmer_Index(bindex);
+                bblock = complement_DB(bblock,1);
+                bindex = get_index(bfile,broot,bblock,1,&blen);
+                Match_Filter(aroot,ablock,broot,bblock,aindex,alen,bindex,blen,1,asettings);
+              }
+            else
+              Match_Filter(aroot,ablock,broot,bblock,cindex,clen,bindex,blen,2,asettings);
+            if (ONE_FILE)
+              Close_Match_Output();
 
             free(broot);
+            Close_DB(bblock);
           }
         else
-          { Match_Filter(aroot,ablock,aroot,ablock,aindex,alen,aindex,alen,0,asettings);
-
-            bblock = complement_DB(ablock,0);
-            if (VERBOSE)
-              printf("\nBuilding index for c(%s)\n",aroot);
-            bindex = Sort_Kmers(bblock,&blen);
-            Match_Filter(aroot,ablock,aroot,bblock,aindex,alen,bindex,blen,1,asettings);
-
-            bblock->reads = NULL;  //  ablock & bblock share "reads" vector, don't let Close_DB
-                                   //     free it !
+          { if (ONE_FILE)
+              Open_Match_Output(aroot,aroot,asettings);
+            Match_Filter(aroot,ablock,aroot,ablock,aindex,alen,aindex,alen,0,asettings);
+
+            if (BIASED)
+              { bblock = complement_DB(ablock,0);
+                bindex = get_index(afile,aroot,bblock,1,&blen);
+                Match_Filter(aroot,ablock,aroot,bblock,aindex,alen,bindex,blen,1,asettings);
+
+                bblock->reads = NULL;  //  ablock & bblock share "reads" vector, don't let
+                                       //     Close_DB free it !
+                Close_DB(bblock);
+              }
+            else
+              Match_Filter(aroot,ablock,aroot,ablock,cindex,clen,aindex,alen,2,asettings);
+            if (ONE_FILE)
+              Close_Match_Output();
           }
-
-        Close_DB(bblock);
       }
   }
 
@@ -22,7 +22,17 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <time.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define X86_SIMD         //  AVX2/SSE4.1 k-mer scanners (chosen at run time), streaming stores
+#include <immintrin.h>
+#endif
 
 #include "DB.h"
 #include "filter.h"
@@ -103,6 +113,38 @@ typedef struct
 
 #endif
 
+  //  When the block dimensions permit, a sorted k-mer list is an array of 8-byte words rather
+  //    than KmerPos records: the code and one more bit occupy the top Kshift+1 bits (so that
+  //    the all 1's sentinel sorts last and reads back as an all 1's code), followed by the read
+  //    and then the position.  Likewise seed pairs are sorted as 8-byte words holding, from
+  //    the top, bread, aread, apos, and diag (offset to be non-negative).
+
+typedef struct
+  { int    packed;    //  List entries are uint64's, otherwise KmerPos records
+    int    cshift;    //  code = (int64) entry >> cshift
+    int    rshift;    //  read = (entry >> rshift) & rmask
+    uint64 rmask;
+    uint64 pmask;     //  rpos = entry & pmask
+  } Kmer_Pack;
+
+#define KCODE(k,l,i)  ((k)->packed ? (uint64) (((int64 *) (l))[i] >> (k)->cshift)        \
+                                   : ((KmerPos *) (l))[i].code)
+#define KREAD(k,l,i)  ((k)->packed ? (int) ((((uint64 *) (l))[i] >> (k)->rshift) & (k)->rmask) \
+                                   : ((KmerPos *) (l))[i].read)
+#define KRPOS(k,l,i)  ((k)->packed ? (int) (((uint64 *) (l))[i] & (k)->pmask)              \
+                                   : ((KmerPos *) (l))[i].rpos)
+
+typedef struct
+  { int    packed;    //  Pairs are sorted as uint64's and then widened to SeedPairs
+    int    pshift;    //  Low bit of apos, aread, and bread (diag is in the lowest bits)
+    int    ashift;
+    int    bshift;
+    int    doff;      //  diag + doff >= 0
+    uint64 dmask;
+    uint64 pmask;
+    uint64 amask;
+  } Seed_Pack;
+
 /*******************************************************************************************
  *
  *  PARAMETER SETUP
@@ -118,8 +160,7 @@ static int    Kshift;         //  2*Kmer
 static uint64 Kmask;          //  4^Kmer-1
 static int    TooFrequent;    //  (Suppress != 0) ? Suppress : INT32_MAX
 
-static int    NTHREADS;       //  Adjusted downward to nearest power of 2
-static int    NSHIFT;         //  NTHREADS = 1 << NSHIFT
+static int    NTHREADS;       //  Any number of threads >= 1
 
 int Set_Filter_Params(int kmer, int binshift, int suppress, int hitmin, int nthread)
 { if (kmer <= 1)
@@ -141,12 +182,10 @@ int Set_Filter_Params(int kmer, int binshift, int suppress, int hitmin, int nthr
   else
     TooFrequent = Suppress;
 
-  NTHREADS = 1;
-  NSHIFT   = 0;
-  while (2*NTHREADS <= nthread)
-    { NTHREADS *= 2;
-      NSHIFT   += 1;
-    }
+  if (nthread < 1)
+    NTHREADS = 1;
+  else
+    NTHREADS = nthread;
 
   return (0);
 }
@@ -158,193 +197,392 @@ int Set_Filter_Params(int kmer, int binshift, int suppress, int hitmin, int nthr
  *
  ********************************************************************************************/
 
-#define BMER      4
-#define BSHIFT    8             //  = 2*BMER
-#define BPOWR   256             //  = 2^BSHIFT
-#define BMASK  0xffllu          //  = BPOWR-1
+  //  The sort is an LSD radix sort of 16-byte Double records, or of 8-byte words (packed
+  //    k-mers and seed pairs), on a key given as a list of bit fields (least significant first).  Each field is cut into digits of at most
+  //    LEX_BITS bits (8 bits for small sorts where the larger count tables do not pay off).
+  //    The histogram of the first digit is produced by the caller as it builds the array
+  //    (see FMASK), and each pass produces the histogram of the next digit as it scatters.
+  //    A digit that has the same value for every record is not sorted on.  Scattered records
+  //    are staged in per-bucket cache-line buffers and written a line at a time.
 
-static uint64  QMASK;           //  = BMASK << NSHIFT
-static int     LEX_shift;
-static int64   LEX_zsize;
-static int     LEX_last;
-static int     LEX_next;
-static Double *LEX_src;
-static Double *LEX_trg;
+#define LEX_BITS     11             //  Maximum digit width
+#define LEX_POWR   2048             //  = 2^LEX_BITS
+#define LEX_BIG  (1ll << 24)        //  Sorts of this many records or more use LEX_BITS digits
+#define LEX_TABLE (1ll << 22)       //  Cap on the NTHREADS^2 * 2^digit scatter counts
+#define WC_LINE       4             //  Double records per 64-byte cache line (8 words)
 
 typedef struct
-  { int64  beg;
-    int64  end;
-    int64  tptr[BPOWR];
-    int64 *sptr;
+  { int    word;                    //  0 = p1, 1 = p2
+    int    shift;
+    uint64 mask;
+  } Lex_Digit;
+
+static int       LEX_bits = LEX_BITS;  //  Digit width cap, size threshold for it, and use of
+static int64     LEX_big  = LEX_BIG;   //    line buffers (settable for benchmarking, see
+static int       LEX_wc   = 1;         //    lexbench.c)
+
+static uint64    FMASK;             //  Mask of the first digit, producers histogram on it
+static int       LEX_ndigit;
+static Lex_Digit LEX_digit[32];
+
+static int64     LEX_zsize;
+static int       LEX_rword;         //  Words per record: 2 = Double, 1 = uint64
+static int       LEX_stream;
+static Lex_Digit *LEX_cur;
+static Lex_Digit *LEX_nxt;
+static Double   *LEX_src;
+static Double   *LEX_trg;
+
+typedef struct
+  { int64   beg;
+    int64   end;
+    int64   tptr[LEX_POWR];
+    int64  *sptr;
+    Double *wbuf;
+    int    *wcnt;
   } Lex_Arg;
 
-#define VERY_VERBOSE 0
+  //  Set up the digits of a sort of len records on the nfield fields given as (word, low
+  //    bit, # of bits) triples in field, and set FMASK accordingly.
+
+static void lex_plan(int nfield, int *field, int64 len)
+{ int i, j, k, n, w, cap;
+  int lo, nbits;
+
+  if (len >= LEX_big)
+    cap = LEX_bits;
+  else
+    cap = 8;
+  while (cap > 8 && (((int64) NTHREADS*NTHREADS) << cap) > LEX_TABLE)
+    cap -= 1;
+
+  n = 0;
+  for (i = 0; i < nfield; i++)
+    { lo    = field[3*i+1];
+      nbits = field[3*i+2];
+      if (nbits <= 0)
+        continue;
+      k = (nbits-1)/cap + 1;
+      w = (nbits-1)/k + 1;
+      for (j = 0; j < k; j++)
+        { LEX_digit[n].word  = field[3*i];
+          LEX_digit[n].shift = lo;
+          if (nbits < w)
+            w = nbits;
+          LEX_digit[n].mask  = (0x1llu << w) - 1;
+          lo    += w;
+          nbits -= w;
+          n     += 1;
+        }
+    }
+  LEX_ndigit = n;
+
+  if (n > 0)
+    FMASK = LEX_digit[0].mask;
+  else
+    FMASK = 0;
+}
+
+#define DIGIT(d,r)  ((((uint64 *) (r))[(d)->word] >> (d)->shift) & (d)->mask)
+
+  //  Move the records staged for one bucket to trg[x..x+n-1]
+
+static inline void wc_flush(Double *trg, int64 x, Double *w, int n)
+{ Double *t = trg + x;
+
+#ifdef X86_SIMD
+  if (n == WC_LINE && LEX_stream)
+    { _mm_stream_si128((__m128i *) t,    _mm_load_si128((__m128i *) w));
+      _mm_stream_si128((__m128i *) (t+1),_mm_load_si128((__m128i *) (w+1)));
+      _mm_stream_si128((__m128i *) (t+2),_mm_load_si128((__m128i *) (w+2)));
+      _mm_stream_si128((__m128i *) (t+3),_mm_load_si128((__m128i *) (w+3)));
+      return;
+    }
+#endif
+  while (n-- > 0)
+    *t++ = *w++;
+}
 
 static void *lex_thread(void *arg)
 { Lex_Arg    *data  = (Lex_Arg *) arg;
   int64      *sptr  = data->sptr;
   int64      *tptr  = data->tptr;
-  int         shift = LEX_shift;   //  Must be a multiple of 8 in [0,120]
-  int        qshift = (LEX_next - LEX_shift) - NSHIFT;
+  Lex_Digit  *cur   = LEX_cur;
+  Lex_Digit  *nxt   = LEX_nxt;
   int64       zsize = LEX_zsize;
+  int64       nthr  = NTHREADS;
   Double     *src   = LEX_src;
   Double     *trg   = LEX_trg;
   int64       i, n, x;
-  uint64      c, b;
+  uint64      b;
 
   n = data->end;
-  if (VERY_VERBOSE)
-    { printf("\n ----");
-      printf("\n shift=%d, LEX_last=%d, n=%lld", shift, LEX_last, n);
-      fflush(stdout);
-    }
-  if (shift >= 64)
-    { shift -= 64;
-      if (LEX_last)
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p2;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-          }
-      else
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p2;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-            sptr[((b >> qshift) & QMASK) + x/zsize] += 1;
+  if (LEX_wc)
+    { Double *wbuf = data->wbuf;
+      int    *wcnt = data->wcnt;
+      Double *w;
+      int     k;
+
+      for (i = data->beg; i < n; i++)
+        { b = DIGIT(cur,src+i);
+          x = tptr[b]++;
+          k = (((uint64) (trg+x)) >> 4) & (WC_LINE-1);
+          w = wbuf + b*WC_LINE;
+          w[k] = src[i];
+          wcnt[b] += 1;
+          if (k == WC_LINE-1)
+            { wc_flush(trg,x+1-wcnt[b],w+(WC_LINE-wcnt[b]),wcnt[b]);
+              wcnt[b] = 0;
+            }
+          if (nxt != NULL)
+            sptr[DIGIT(nxt,src+i)*nthr + x/zsize] += 1;
+        }
+
+      for (b = 0; b <= cur->mask; b++)
+        if (wcnt[b] > 0)
+          { x = tptr[b] - wcnt[b];
+            k = (((uint64) (trg+x)) >> 4) & (WC_LINE-1);
+            wc_flush(trg,x,wbuf+(b*WC_LINE+k),wcnt[b]);
+            wcnt[b] = 0;
           }
+#ifdef X86_SIMD
+      _mm_sfence();
+#endif
     }
 
-  else if ( ! LEX_last && LEX_next >= 64)   //  && LEX_shift < 64
+  else if (nxt != NULL)
+    for (i = data->beg; i < n; i++)
+      { b = DIGIT(cur,src+i);
+        x = tptr[b]++;
+        trg[x] = src[i];
+        sptr[DIGIT(nxt,src+i)*nthr + x/zsize] += 1;
+      }
+  else
+    for (i = data->beg; i < n; i++)
+      { b = DIGIT(cur,src+i);
+        x = tptr[b]++;
+        trg[x] = src[i];
+      }
 
-    { qshift = (LEX_next - 64) - NSHIFT;
-      if (qshift < 0)
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-            sptr[((src[i].p2 << NSHIFT) & QMASK) + x/zsize] += 1;
-          }
-      else
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-            sptr[((src[i].p2 >> qshift) & QMASK) + x/zsize] += 1;
-          }
+  return (NULL);
+}
+
+  //  As wc_flush and lex_thread but for 8-byte records
+
+static inline void wc_word_flush(uint64 *trg, int64 x, uint64 *w, int n)
+{ uint64 *t = trg + x;
+
+#ifdef X86_SIMD
+  if (n == 2*WC_LINE && LEX_stream)
+    { _mm_stream_si128((__m128i *) t,    _mm_load_si128((__m128i *) w));
+      _mm_stream_si128((__m128i *) (t+2),_mm_load_si128((__m128i *) (w+2)));
+      _mm_stream_si128((__m128i *) (t+4),_mm_load_si128((__m128i *) (w+4)));
+      _mm_stream_si128((__m128i *) (t+6),_mm_load_si128((__m128i *) (w+6)));
+      return;
     }
+#endif
+  while (n-- > 0)
+    *t++ = *w++;
+}
 
-  else // LEX_last || LEX_next < 64
-    if (LEX_last)
-      if (shift == 0)
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            x = tptr[c&BMASK]++;
-            trg[x] = src[i];
-          }
-      else
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-          }
-    else
-      if (shift == 0)
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            x = tptr[c&BMASK]++;
-            if (VERY_VERBOSE)
-            { printf("\n @=%p+%lld i=%6lld,c&=%3lld,x=%3lld,c=%lld ", (void*)trg, (sizeof(Double)*x), i, (c&BMASK), x, c);
-              fflush(stdout);
+static void *lex_word_thread(void *arg)
+{ Lex_Arg    *data  = (Lex_Arg *) arg;
+  int64      *sptr  = data->sptr;
+  int64      *tptr  = data->tptr;
+  Lex_Digit  *cur   = LEX_cur;
+  Lex_Digit  *nxt   = LEX_nxt;
+  int64       zsize = LEX_zsize;
+  int64       nthr  = NTHREADS;
+  uint64     *src   = (uint64 *) LEX_src;
+  uint64     *trg   = (uint64 *) LEX_trg;
+  int64       i, n, x;
+  uint64      b;
+
+  n = data->end;
+  if (LEX_wc)
+    { uint64 *wbuf = (uint64 *) data->wbuf;
+      int    *wcnt = data->wcnt;
+      uint64 *w;
+      int     k;
+
+      for (i = data->beg; i < n; i++)
+        { b = DIGIT(cur,src+i);
+          x = tptr[b]++;
+          k = (((uint64) (trg+x)) >> 3) & (2*WC_LINE-1);
+          w = wbuf + b*(2*WC_LINE);
+          w[k] = src[i];
+          wcnt[b] += 1;
+          if (k == 2*WC_LINE-1)
+            { wc_word_flush(trg,x+1-wcnt[b],w+(2*WC_LINE-wcnt[b]),wcnt[b]);
+              wcnt[b] = 0;
             }
-            trg[x] = src[i];
-            sptr[((c >> qshift) & QMASK) + x/zsize] += 1;
-          }
-      else
-        for (i = data->beg; i < n; i++)
-          { c = src[i].p1;
-            b = (c >> shift);
-            x = tptr[b&BMASK]++;
-            trg[x] = src[i];
-            sptr[((b >> qshift) & QMASK) + x/zsize] += 1;
-          }
+          if (nxt != NULL)
+            sptr[DIGIT(nxt,src+i)*nthr + x/zsize] += 1;
+        }
 
-  if (VERY_VERBOSE)
-    { printf("\n Finished @%p n=%lld", (void*)trg, n);
-      fflush(stdout);
+      for (b = 0; b <= cur->mask; b++)
+        if (wcnt[b] > 0)
+          { x = tptr[b] - wcnt[b];
+            k = (((uint64) (trg+x)) >> 3) & (2*WC_LINE-1);
+            wc_word_flush(trg,x,wbuf+(b*(2*WC_LINE)+k),wcnt[b]);
+            wcnt[b] = 0;
+          }
+#ifdef X86_SIMD
+      _mm_sfence();
+#endif
     }
+
+  else if (nxt != NULL)
+    for (i = data->beg; i < n; i++)
+      { b = DIGIT(cur,src+i);
+        x = tptr[b]++;
+        trg[x] = src[i];
+        sptr[DIGIT(nxt,src+i)*nthr + x/zsize] += 1;
+      }
+  else
+    for (i = data->beg; i < n; i++)
+      { b = DIGIT(cur,src+i);
+        x = tptr[b]++;
+        trg[x] = src[i];
+      }
+
+  return (NULL);
+}
+
+  //  Histogram the current digit over [beg,end) (needed after a skipped pass)
+
+static void *lex_count_thread(void *arg)
+{ Lex_Arg    *data  = (Lex_Arg *) arg;
+  int64      *tptr  = data->tptr;
+  Lex_Digit  *cur   = LEX_cur;
+  uint64     *src   = (uint64 *) LEX_src;
+  int         rw    = LEX_rword;
+  int64       i, n;
+
+  n = data->end;
+  for (i = data->beg; i < n; i++)
+    tptr[DIGIT(cur,src+i*rw)] += 1;
+
   return (NULL);
 }
 
-static Double *lex_sort(int bytes[16], Double *src, Double *trg, Lex_Arg *parmx)
+  //  Sort src on the key set up by the last call to lex_plan, where parmx[i].tptr holds the
+  //    histogram of the first digit over parmx[i].beg..end.  Records are Doubles if rbytes
+  //    is 16 and uint64's if it is 8.  The result is in src or trg.
+
+static void *lex_sort(void *src, void *trg, int rbytes, Lex_Arg *parmx)
 { THREAD  threads[NTHREADS];
 
   int64   len, x, y;
   Double *xch;
-  int     i, j, k, z;
-  int     b, c, fb;
+  int64  *sptr;
+  Double *wbuf, *wlin;
+  int    *wcnt;
+  int     i, j, k, z, d;
+  int     npowr, count, moved;
 
   len       = parmx[NTHREADS-1].end;
   LEX_zsize = (len-1)/NTHREADS + 1;
-  LEX_src   = src;
-  LEX_trg   = trg;
-  QMASK     = (BMASK << NSHIFT);
-
-  for (c = 0; c < 16; c++)
-    if (bytes[c])
-      break;
-  fb = c;
-  for (b = c; b < 16; b = c)
-    { for (c = b+1; c < 16; c++)
-        if (bytes[c])
-          break;
-      LEX_last  = (c >= 16);
-      LEX_shift = (b << 3);
-      LEX_next  = (c << 3);
- 
-      if (b == fb)
-        { for (i = 0; i < NTHREADS; i++)
-            for (z = 0; z < NTHREADS*BPOWR; z++)
-              parmx[i].sptr[z] = 0;
+  LEX_src   = (Double *) src;
+  LEX_trg   = (Double *) trg;
+  LEX_rword = rbytes / sizeof(uint64);
+  LEX_stream = ((((uint64) src) & 0xf) == 0 && (((uint64) trg) & 0xf) == 0);
+
+  npowr = 1;
+  for (d = 0; d < LEX_ndigit; d++)
+    if (LEX_digit[d].mask >= (uint64) npowr)
+      npowr = LEX_digit[d].mask + 1;
+
+  sptr = (int64 *) Malloc(sizeof(int64)*NTHREADS*NTHREADS*npowr,"Allocating sort histograms");
+  if (sptr == NULL)
+    exit (1);
+  wbuf = NULL;
+  wcnt = NULL;
+  if (LEX_wc)
+    { wbuf = (Double *) Malloc(sizeof(Double)*(NTHREADS*npowr*WC_LINE+WC_LINE),
+                               "Allocating sort line buffers");
+      wcnt = (int *) Malloc(sizeof(int)*NTHREADS*npowr,"Allocating sort line buffers");
+      if (wbuf == NULL || wcnt == NULL)
+        exit (1);
+      wlin = (Double *) ((((uint64) wbuf) + 63) & ~0x3fllu);    //  Cache-line aligned
+      for (i = 0; i < NTHREADS*npowr; i++)
+        wcnt[i] = 0;
+    }
+  else
+    wlin = NULL;
+  for (i = 0; i < NTHREADS; i++)
+    { parmx[i].sptr = sptr + i*NTHREADS*npowr;
+      if (LEX_wc)
+        { parmx[i].wbuf = wlin + i*npowr*WC_LINE;
+          parmx[i].wcnt = wcnt + i*npowr;
         }
-      else
-        { x = 0;
+    }
+
+  moved = 0;      //  Records have been scattered at least once (threads now own zsize slices)
+  count = 0;      //  tptr's must be computed by a counting pass
+  for (d = 0; d < LEX_ndigit; d++)
+    { LEX_cur = LEX_digit + d;
+      npowr   = LEX_cur->mask + 1;
+
+      if (count)
+        { for (i = 0; i < NTHREADS; i++)
+            for (j = 0; j < npowr; j++)
+              parmx[i].tptr[j] = 0;
+
           for (i = 0; i < NTHREADS; i++)
-            { parmx[i].beg = x;
-              x = LEX_zsize*(i+1);
-              if (x > len)
-                x = len;
-              parmx[i].end = x;
-              for (j = 0; j < BPOWR; j++)
-                parmx[i].tptr[j] = 0;
-            }
-          parmx[NTHREADS-1].end = len;
+            pthread_create(threads+i,NULL,lex_count_thread,parmx+i);
+
+          for (i = 0; i < NTHREADS; i++)
+            pthread_join(threads[i],NULL);
+        }
+      else if (moved)
+        { for (i = 0; i < NTHREADS; i++)
+            for (j = 0; j < npowr; j++)
+              parmx[i].tptr[j] = 0;
 
-          for (j = 0; j < BPOWR; j++)
-            { k = (j << NSHIFT);
+          for (j = 0; j < npowr; j++)
+            { k = j*NTHREADS;
               for (z = 0; z < NTHREADS; z++)
                 for (i = 0; i < NTHREADS; i++)
-                  { parmx[i].tptr[j] += parmx[z].sptr[k+i];
-                    parmx[z].sptr[k+i] = 0;
-                  }
+                  parmx[i].tptr[j] += parmx[z].sptr[k+i];
             }
         }
 
+      //  Skip the digit if it is the same for all records
+
+      y = 0;
+      for (j = 0; y == 0 && j < npowr; j++)
+        for (i = 0; i < NTHREADS; i++)
+          y += parmx[i].tptr[j];
+      if (y == len)
+        { count = 1;
+          continue;
+        }
+
+      if (d+1 < LEX_ndigit)
+        { LEX_nxt = LEX_digit + (d+1);
+          z = (LEX_nxt->mask + 1) * NTHREADS;
+          for (i = 0; i < NTHREADS; i++)
+            for (j = 0; j < z; j++)
+              parmx[i].sptr[j] = 0;
+        }
+      else
+        LEX_nxt = NULL;
+
       x = 0;
-      for (j = 0; j < BPOWR; j++)
+      for (j = 0; j < npowr; j++)
         for (i = 0; i < NTHREADS; i++)
           { y = parmx[i].tptr[j];
             parmx[i].tptr[j] = x;
             x += y;
           }
 
-      for (i = 0; i < NTHREADS; i++)
-        pthread_create(threads+i,NULL,lex_thread,parmx+i);
+      if (LEX_rword == 1)
+        for (i = 0; i < NTHREADS; i++)
+          pthread_create(threads+i,NULL,lex_word_thread,parmx+i);
+      else
+        for (i = 0; i < NTHREADS; i++)
+          pthread_create(threads+i,NULL,lex_thread,parmx+i);
 
       for (i = 0; i < NTHREADS; i++)
         pthread_join(threads[i],NULL);
@@ -353,35 +591,40 @@ static Double *lex_sort(int bytes[16], Double *src, Double *trg, Lex_Arg *parmx)
       LEX_src = LEX_trg;
       LEX_trg = xch;
 
-#ifdef TEST_LSORT
-      printf("\nLSORT %d\n",LEX_shift);
-      if (LEX_shift >= 64)
-        { x = (1 << ((LEX_shift-64)+BSHIFT))-1;
-          for (i = 0; i < len; i++)
-            { printf("%6d: %8llx %8llx %8llx %8llx : %4llx",
-                     i,LEX_src[i].p2>>32,(LEX_src[i].p2)&0xffffffffll,LEX_src[i].p1>>32,
-                     LEX_src[i].p1&0xffffffffll,LEX_src[i].p2&x);
-              if (i > 0 && (LEX_src[i].p1 < LEX_src[i].p1 ||
-                             (LEX_src[i].p1 == LEX_src[i].p1 && 
-                             (LEX_src[i].p2 & x) < (LEX_src[i-1].p2 & x))))
-                printf(" OO");
-              printf("\n");
+      if ( ! moved)
+        { moved = 1;
+          x = 0;
+          for (i = 0; i < NTHREADS; i++)
+            { parmx[i].beg = x;
+              x = LEX_zsize*(i+1);
+              if (x > len)
+                x = len;
+              parmx[i].end = x;
             }
+          parmx[NTHREADS-1].end = len;
         }
-      else
-        { x = (1 << (LEX_shift+BSHIFT))-1;
-          for (i = 0; i < len; i++)
-            { printf("%6d: %8llx %8llx %8llx %8llx : %4llx",
-                     i,LEX_src[i].p2>>32,(LEX_src[i].p2)&0xffffffffll,LEX_src[i].p1>>32,
-                     LEX_src[i].p1&0xffffffffll,LEX_src[i].p1&x);
-              if (i > 0 && (LEX_src[i].p1 & x) < (LEX_src[i-1].p1 & x))
-                printf(" OO");
-              printf("\n");
-            }
+      count = 0;
+
+#ifdef TEST_LSORT
+      printf("\nLSORT %d.%d\n",LEX_cur->word,LEX_cur->shift);
+      for (x = 0; x < len; x++)
+        { uint64 *r = ((uint64 *) LEX_src) + x*LEX_rword;
+
+          printf("%6lld:",x);
+          for (k = LEX_rword-1; k >= 0; k--)
+            printf(" %8llx %8llx",r[k]>>32,r[k]&0xffffffffll);
+          printf(" : %4llx",DIGIT(LEX_cur,r));
+          if (x > 0 && DIGIT(LEX_cur,r) < DIGIT(LEX_cur,r-LEX_rword))
+            printf(" OO");
+          printf("\n");
         }
 #endif
     }
 
+  free(wcnt);
+  free(wbuf);
+  free(sptr);
+
   return (LEX_src);
 }
 
@@ -406,18 +649,174 @@ typedef struct
     int    fill;
   } Tuple_Arg;
 
+  //  Add to list[n..] the k-mers of read 'read' that lie wholly within s[p..q-1] (q >= p+Kmer),
+  //    counting the low byte of each code in kptr, and return the new value of n.  Each of
+  //    the vector scanners below rolls 4 (resp. 2) codes forward 4 (resp. 2) bases at a time,
+  //    builds the KmerPos records in registers, and finishes any remainder like scan_tuples.
+
+static int (*Scan_Tuples)(KmerPos *list, int n, int read, char *s, int p, int q, int64 *kptr);
+
+static int scan_tuples(KmerPos *list, int n, int read, char *s, int p, int q, int64 *kptr)
+{ uint64 c;
+  int    x;
+
+  c = 0;
+  for (x = 1; x < Kmer; x++)
+    c = (c << 2) | s[p++];
+  while (p < q)
+    { x = s[p];
+      c = ((c << 2) | x) & Kmask;
+      list[n].read = read;
+      list[n].rpos = p++;
+      list[n].code = c;
+      n += 1;
+      kptr[c & FMASK] += 1;
+    }
+  return (n);
+}
+
+#ifdef X86_SIMD
+
+__attribute__((target("avx2")))
+static int scan_tuples_avx2(KmerPos *list, int n, int read, char *s, int p, int q, int64 *kptr)
+{ uint64 c, cv[4] __attribute__((aligned(32)));
+  int    x;
+
+  c = 0;
+  for (x = 1; x < Kmer; x++)
+    c = (c << 2) | s[p++];
+
+  if (p+3 < q)
+    { __m256i C, P, W, M, F, V, lo, hi;
+      __m128i B;
+      uint64  r;
+
+      for (x = 0; x < 4; x++)
+        cv[x] = c = ((c << 2) | s[p+x]) & Kmask;
+      r = ((uint64) read) << 32;
+      C = _mm256_load_si256((__m256i *) cv);
+      P = _mm256_set_epi64x(r|(p+3),r|(p+2),r|(p+1),r|p);
+      M = _mm256_set1_epi64x((long long) Kmask);
+      F = _mm256_set1_epi64x((long long) FMASK);
+      V = _mm256_set1_epi64x(4);
+      while (1)
+        { lo = _mm256_unpacklo_epi64(C,P);
+          hi = _mm256_unpackhi_epi64(C,P);
+          _mm256_storeu_si256((__m256i *) (list+n),_mm256_permute2x128_si256(lo,hi,0x20));
+          _mm256_storeu_si256((__m256i *) (list+(n+2)),_mm256_permute2x128_si256(lo,hi,0x31));
+          _mm256_store_si256((__m256i *) cv,_mm256_and_si256(C,F));
+          kptr[cv[0]] += 1;
+          kptr[cv[1]] += 1;
+          kptr[cv[2]] += 1;
+          kptr[cv[3]] += 1;
+          n += 4;
+          if (p+7 >= q)
+            break;
+
+          B = _mm_loadl_epi64((__m128i *) (s+(p+1)));      //  s[p+8] <= s[q] is addressable
+          W = _mm256_slli_epi64(_mm256_cvtepu8_epi64(B),6);
+          W = _mm256_or_si256(W,_mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_srli_si128(B,1)),4));
+          W = _mm256_or_si256(W,_mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_srli_si128(B,2)),2));
+          W = _mm256_or_si256(W,_mm256_cvtepu8_epi64(_mm_srli_si128(B,3)));
+          C = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi64(C,8),W),M);
+          P = _mm256_add_epi64(P,V);
+          p += 4;
+        }
+      c  = (uint64) _mm256_extract_epi64(C,3);
+      p += 4;
+    }
+
+  while (p < q)
+    { x = s[p];
+      c = ((c << 2) | x) & Kmask;
+      list[n].read = read;
+      list[n].rpos = p++;
+      list[n].code = c;
+      n += 1;
+      kptr[c & FMASK] += 1;
+    }
+  return (n);
+}
+
+__attribute__((target("sse4.1")))
+static int scan_tuples_sse4(KmerPos *list, int n, int read, char *s, int p, int q, int64 *kptr)
+{ uint64 c, cv[2] __attribute__((aligned(16)));
+  int    x;
+
+  c = 0;
+  for (x = 1; x < Kmer; x++)
+    c = (c << 2) | s[p++];
+
+  if (p+1 < q)
+    { __m128i C, P, W, M, F, V, B;
+      uint64  r;
+
+      for (x = 0; x < 2; x++)
+        cv[x] = c = ((c << 2) | s[p+x]) & Kmask;
+      r = ((uint64) read) << 32;
+      C = _mm_load_si128((__m128i *) cv);
+      P = _mm_set_epi64x(r|(p+1),r|p);
+      M = _mm_set1_epi64x((long long) Kmask);
+      F = _mm_set1_epi64x((long long) FMASK);
+      V = _mm_set1_epi64x(2);
+      while (1)
+        { _mm_storeu_si128((__m128i *) (list+n),_mm_unpacklo_epi64(C,P));
+          _mm_storeu_si128((__m128i *) (list+(n+1)),_mm_unpackhi_epi64(C,P));
+          _mm_store_si128((__m128i *) cv,_mm_and_si128(C,F));
+          kptr[cv[0]] += 1;
+          kptr[cv[1]] += 1;
+          n += 2;
+          if (p+3 >= q)
+            break;
+
+          B = _mm_cvtsi32_si128(*((int *) (s+(p+1))));      //  s[p+4] <= s[q] is addressable
+          W = _mm_slli_epi64(_mm_cvtepu8_epi64(B),2);
+          W = _mm_or_si128(W,_mm_cvtepu8_epi64(_mm_srli_si128(B,1)));
+          C = _mm_and_si128(_mm_or_si128(_mm_slli_epi64(C,4),W),M);
+          P = _mm_add_epi64(P,V);
+          p += 2;
+        }
+      c  = (uint64) _mm_extract_epi64(C,1);
+      p += 2;
+    }
+
+  while (p < q)
+    { x = s[p];
+      c = ((c << 2) | x) & Kmask;
+      list[n].read = read;
+      list[n].rpos = p++;
+      list[n].code = c;
+      n += 1;
+      kptr[c & FMASK] += 1;
+    }
+  return (n);
+}
+
+#endif
+
+static void select_scanner()
+{ Scan_Tuples = scan_tuples;
+#ifdef X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    Scan_Tuples = scan_tuples_avx2;
+  else if (__builtin_cpu_supports("sse4.1"))
+    Scan_Tuples = scan_tuples_sse4;
+#endif
+}
+
 
 static void *tuple_thread(void *arg)
 { Tuple_Arg  *data  = (Tuple_Arg *) arg;
   int         tnum  = data->tnum;
   int64      *kptr  = data->kptr;
   KmerPos    *list  = TA_list;
-  int         i, m, n, x, p;
+  int         i, m, n, p;
   uint64      c;
   char       *s;
 
   c  = TA_block->nreads;
-  i  = (c * tnum) >> NSHIFT;
+  i  = (c * tnum) / NTHREADS;
   n  = TA_block->reads[i].boff;
   s  = ((char *) (TA_block->bases)) + n;
   n -= Kmer*i;
@@ -430,7 +829,7 @@ static void *tuple_thread(void *arg)
       int        q = 0;
 
       f = anno1[i-1];
-      for (m = (c * (tnum+1)) >> NSHIFT; i < m; i++)
+      for (m = (c * (tnum+1)) / NTHREADS; i < m; i++)
         { b = f;
           f = anno1[i];
           for (a = b; a <= f; a += 2)
@@ -443,25 +842,13 @@ static void *tuple_thread(void *arg)
               else
                 q = point[a];
               if (p+Kmer <= q)
-                { c = 0;
-                  for (x = 1; x < Kmer; x++)
-                    c = (c << 2) | s[p++];
-                  while (p < q)
-                    { x = s[p];
-                      c = ((c << 2) | x) & Kmask;
-                      list[n].read = i;
-                      list[n].rpos = p++;
-                      list[n].code = c;
-                      n += 1;
-                      kptr[c & BMASK] += 1;
-                    }
-                }
+                n = Scan_Tuples(list,n,i,s,p,q,kptr);
             }
           s += (q+1);
         }
 
       m = TA_block->reads[m].boff - Kmer*m;
-      kptr[BMASK] += (data->fill = m-n);
+      kptr[FMASK] += (data->fill = m-n);
       while (n < m)
         { list[n].code = 0xffffffffffffffffllu;
           list[n].read = 0xffffffff;
@@ -471,20 +858,15 @@ static void *tuple_thread(void *arg)
     }
 
   else
-    for (m = (c * (tnum+1)) >> NSHIFT; i < m; i++)
-      { c = p = 0;
-        for (x = 1; x < Kmer; x++)
-          c = (c << 2) | s[p++];
-        while ((x = s[p]) != 4)
-          { c = ((c << 2) | x) & Kmask;
-            list[n].read = i;
-            list[n].rpos = p++;
-            list[n].code = c;
-            n += 1;
-            kptr[c & BMASK] += 1;
-          }
-        s += (p+1);
-      }
+    { HITS_READ *reads = TA_block->reads;
+      int        q;
+
+      for (m = (c * (tnum+1)) / NTHREADS; i < m; i++)
+        { q = reads[i].rlen;
+          n = Scan_Tuples(list,n,i,s,0,q,kptr);
+          s += (q+1);
+        }
+    }
 
   return (NULL);
 }
@@ -500,7 +882,7 @@ static void *biased_tuple_thread(void *arg)
   char       *s, *t;
 
   c  = TA_block->nreads;
-  i  = (c * tnum) >> NSHIFT;
+  i  = (c * tnum) / NTHREADS;
   n  = TA_block->reads[i].boff;
   s  = ((char *) (TA_block->bases)) + n;
   n -= Kmer*i;
@@ -513,7 +895,7 @@ static void *biased_tuple_thread(void *arg)
       int        q = 0;
 
       f = anno1[i-1];
-      for (m = (c * (tnum+1)) >> NSHIFT; i < m; i++)
+      for (m = (c * (tnum+1)) / NTHREADS; i < m; i++)
         { b = f;
           f = anno1[i];
           t = s+1;
@@ -554,7 +936,7 @@ static void *biased_tuple_thread(void *arg)
                           list[n].rpos = p;
                           list[n].code = d;
                           n += 1;
-                          kptr[d & BMASK] += 1;
+                          kptr[d & FMASK] += 1;
                         }
                       p += 1;
                       a -= LogBase[(int) s[p-k]];
@@ -566,7 +948,7 @@ static void *biased_tuple_thread(void *arg)
     }
 
   else
-    for (m = (c * (tnum+1)) >> NSHIFT; i < m; i++)
+    for (m = (c * (tnum+1)) / NTHREADS; i < m; i++)
       { t = s+1;
         c = 0;
         p = a = 0;
@@ -593,7 +975,7 @@ static void *biased_tuple_thread(void *arg)
                 list[n].rpos = p;
                 list[n].code = d;
                 n += 1;
-                kptr[d & BMASK] += 1;
+                kptr[d & FMASK] += 1;
               }
             p += 1;
             a -= LogBase[(int) s[p-k]];
@@ -603,7 +985,7 @@ static void *biased_tuple_thread(void *arg)
       }
 
   m = TA_block->reads[m].boff - Kmer*m;
-  kptr[BMASK] += (data->fill = m-n);
+  kptr[FMASK] += (data->fill = m-n);
   while (n < m)
     { list[n].code = 0xffffffffffffffffllu;
       list[n].read = 0xffffffff;
@@ -671,25 +1053,66 @@ static void *compress_thread(void *arg)
   return (NULL);
 }
 
+  //  Set *pack to the layout of the sorted k-mer list of block and return its entry size
+
+static int kmer_packing(HITS_DB *block, Kmer_Pack *pack)
+{ int rbits, pbits;
+
+  for (rbits = 0; (0x1ll << rbits) < block->nreads; rbits += 1)
+    ;
+  for (pbits = 0; (0x1ll << pbits) < block->maxlen; pbits += 1)
+    ;
+  pack->packed = (Kshift + 1 + rbits + pbits <= 64);
+  pack->cshift = 63 - Kshift;
+  pack->rshift = pbits;
+  pack->rmask  = (0x1llu << rbits) - 1;
+  pack->pmask  = (0x1llu << pbits) - 1;
+  if (pack->packed)
+    return (sizeof(uint64));
+  else
+    return (sizeof(KmerPos));
+}
+
+static Kmer_Pack FR_pack;
+static uint64   *FR_word;
+
+static void *pack_thread(void *arg)
+{ Comp_Arg   *data  = (Comp_Arg *) arg;
+  int         end   = data->end;
+  KmerPos    *src   = FR_src;
+  uint64     *trg   = FR_word;
+  int         cs    = FR_pack.cshift;
+  int         rs    = FR_pack.rshift;
+  int         i;
+
+  for (i = data->beg; i < end; i++)
+    trg[i] = (src[i].code << cs) | (((uint64) src[i].read) << rs) | ((uint64) src[i].rpos);
+
+  return (NULL);
+}
+
 void *Sort_Kmers(HITS_DB *block, int *len)
 { THREAD    threads[NTHREADS];
   Tuple_Arg parmt[NTHREADS];
   Comp_Arg  parmf[NTHREADS];
   Lex_Arg   parmx[NTHREADS];
-  int       mersort[16];
+  int       mersort[3];
 
   KmerPos  *src, *trg, *rez;
   int       kmers, nreads;
   int       i, j, x, z;
+  int       esize;
   uint64    h;
 
-  for (i = 0; i < NTHREADS; i++)
-    parmx[i].sptr = (int64 *) alloca(NTHREADS*BPOWR*sizeof(int64));
+  mersort[0] = 0;              //  Sort on the code and one more bit so that the all-1's
+  mersort[1] = 0;              //    padding entries follow all the k-mers
+  if (Kmer < 32)
+    mersort[2] = Kshift+1;
+  else
+    mersort[2] = Kshift;
 
-  for (i = 0; i < 16; i++)
-    mersort[i] = 0;
-  for (i = 0; i < Kshift; i += 8)
-    mersort[i>>3] = 1;
+  if (Scan_Tuples == NULL)
+    select_scanner();
 
   if (NormShift == NULL && BIASED)
     { double scale;
@@ -713,12 +1136,13 @@ void *Sort_Kmers(HITS_DB *block, int *len)
   if (kmers <= 0)
     goto no_mers;
 
+  lex_plan(1,mersort,kmers);
+
   if (VERBOSE)
   {
     printf("\n Kshift=%d", Kshift);
-    printf("\n BSHIFT=%d", BSHIFT);
+    printf("\n Sort digits=%d", LEX_ndigit);
     printf("\n TooFrequent=%d", TooFrequent);
-    printf("\n (Kshift-1)/BSHIFT + (TooFrequent < INT32_MAX)=%d", ((Kshift-1)/BSHIFT + (TooFrequent < INT32_MAX)));
     printf("\n sizeof(KmerPos)=%ld", sizeof(KmerPos));
     printf("\n nreads=%d", nreads);
     printf("\n Kmer=%d", Kmer);
@@ -728,7 +1152,7 @@ void *Sort_Kmers(HITS_DB *block, int *len)
     fflush(stdout);
   }
 
-  if (( (Kshift-1)/BSHIFT + (TooFrequent < INT32_MAX) ) & 0x1)
+  if (( LEX_ndigit + (TooFrequent < INT32_MAX) ) & 0x1)
     { trg = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
       src = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
     }
@@ -754,7 +1178,7 @@ void *Sort_Kmers(HITS_DB *block, int *len)
   for (i = 0; i < NTHREADS; i++)
     { parmt[i].tnum = i;
       parmt[i].kptr = parmx[i].tptr;
-      for (j = 0; j < BPOWR; j++)
+      for (j = 0; j <= (int) FMASK; j++)
         parmt[i].kptr[j] = 0;
     }
 
@@ -771,11 +1195,11 @@ void *Sort_Kmers(HITS_DB *block, int *len)
   x = 0;
   for (i = 0; i < NTHREADS; i++)
     { parmx[i].beg = x;
-      j = (int) ((((int64) nreads) * (i+1)) >> NSHIFT);
+      j = (int) ((((int64) nreads) * (i+1)) / NTHREADS);
       parmx[i].end = x = block->reads[j].boff - j*Kmer;
     }
 
-  rez = (KmerPos *) lex_sort(mersort,(Double *) src,(Double *) trg,parmx);
+  rez = (KmerPos *) lex_sort(src,trg,sizeof(KmerPos),parmx);
   if (BIASED || TA_track != NULL)
     for (i = 0; i < NTHREADS; i++)
       kmers -= parmt[i].fill;
@@ -783,7 +1207,7 @@ void *Sort_Kmers(HITS_DB *block, int *len)
   if (TooFrequent < INT32_MAX && kmers > 0)
     { parmf[0].beg = 0;
       for (i = 1; i < NTHREADS; i++)
-        { x = (((int64) i)*kmers) >> NSHIFT;
+        { x = (((int64) i)*kmers) / NTHREADS;
           h = rez[x-1].code;
           while (rez[x].code == h)
             x += 1;
@@ -828,11 +1252,6 @@ void *Sort_Kmers(HITS_DB *block, int *len)
 
   rez[kmers].code   = 0xffffffffffffffffllu;
   rez[kmers+1].code = 0;
-    
-  if (src != rez)
-    free(src);
-  else
-    free(trg);
 
 #ifdef TEST_KSORT
   { int i;
@@ -846,13 +1265,44 @@ void *Sort_Kmers(HITS_DB *block, int *len)
   }
 #endif
 
+  if (src == rez)
+    src = trg;
+  esize = kmer_packing(block,&FR_pack);
+
+  if (FR_pack.packed && kmers > 0)
+    { FR_src  = rez;
+      FR_word = (uint64 *) src;
+      for (i = 0; i < NTHREADS; i++)
+        { parmf[i].beg = (int) ((((int64) kmers) * i) / NTHREADS);
+          parmf[i].end = (int) ((((int64) kmers) * (i+1)) / NTHREADS);
+        }
+
+      for (i = 0; i < NTHREADS; i++)
+        pthread_create(threads+i,NULL,pack_thread,parmf+i);
+
+      for (i = 0; i < NTHREADS; i++)
+        pthread_join(threads[i],NULL);
+
+      FR_word[kmers]   = 0xffffffffffffffffllu;
+      FR_word[kmers+1] = 0;
+
+      free(rez);
+      rez = (KmerPos *) Realloc(src,sizeof(uint64)*(kmers+2),"Shrinking k-mer index");
+      if (rez == NULL)
+        exit (1);
+    }
+  else
+    { free(src);
+      esize = sizeof(KmerPos);
+    }
+
   if (VERBOSE)
     { if (TooFrequent < INT32_MAX || BIASED || TA_track != NULL)
         { printf("   Revised kmer count = ");
           Print_Number((int64) kmers,0,stdout);
           printf("\n");
         }
-      printf("   Index occupies %.2fGb\n",(1. * kmers) / 67108864);
+      printf("   Index occupies %.2fGb\n",(1. * esize * kmers) / 0x40000000ll);
       fflush(stdout);
     }
 
@@ -861,7 +1311,7 @@ void *Sort_Kmers(HITS_DB *block, int *len)
       goto no_mers;
     }
 
-  if (kmers > (int64) (MEM_LIMIT/(4*sizeof(KmerPos))))
+  if (kmers > (int64) (MEM_LIMIT/(4*esize)))
     { fprintf(stderr,"Warning: Block size too big, index occupies more than 1/4 of");
       if (MEM_LIMIT == MEM_PHYSICAL)
         fprintf(stderr," physical memory (%.1fGb)\n",(1.*MEM_LIMIT)/0x40000000ll);
@@ -879,13 +1329,179 @@ no_mers:
 }
 
 
+/*******************************************************************************************
+ *
+ *  PERSISTENT INDEX
+ *
+ ********************************************************************************************/
+
+#define KDX_MAGIC    0x4b445832     //  "KDX2"
+#define KDX_MASKS    1016           //  Space for the concatenated mask track names
+
+  //  The header is a multiple of sizeof(KmerPos) bytes so that the list that follows
+  //    it is properly aligned when the file is mapped.
+
+typedef struct
+  { int    magic;
+    int    kbytes;                  //  Bytes per entry, 8 if packed (see Kmer_Pack)
+    int    kmer;
+    int    suppress;
+    int    biased;
+    int    nreads;
+    int    rshift;                  //  Layout of a packed entry
+    int    cshift;
+    int64  totlen;
+    int64  bases;                   //  reads[nreads].boff of the indexed block
+    int64  len;                     //  # of k-mers in the list (excl. the 2 sentinels)
+    char   masks[KDX_MASKS];
+  } Kmer_Header;
+
+typedef struct _kmap
+  { struct _kmap *next;
+    void         *base;
+    int64         size;
+    KmerPos      *list;
+  } Kmer_Map;
+
+static Kmer_Map *Kmer_Maps = NULL;   //  Indices currently mapped by Load_Kmer_Index
+
+static void set_kmer_header(Kmer_Header *head, HITS_DB *block, char *masks, int64 len)
+{ Kmer_Pack pack;
+
+  memset(head,0,sizeof(Kmer_Header));
+  head->magic    = KDX_MAGIC;
+  head->kbytes   = kmer_packing(block,&pack);
+  if (pack.packed)
+    { head->rshift = pack.rshift;
+      head->cshift = pack.cshift;
+    }
+  head->kmer     = Kmer;
+  head->suppress = Suppress;
+  head->biased   = BIASED;
+  head->nreads   = block->nreads;
+  head->totlen   = block->totlen;
+  head->bases    = block->reads[block->nreads].boff;
+  head->len      = len;
+  if (masks != NULL)
+    strncpy(head->masks,masks,KDX_MASKS-1);
+}
+
+int Save_Kmer_Index(char *path, HITS_DB *block, char *masks, void *index, int len)
+{ Kmer_Header head;
+  FILE       *output;
+  char       *temp;
+
+  if (len <= 0)
+    return (0);
+
+  temp = Strdup(Numbered_Suffix(path,(int) getpid(),".tmp"),"Allocating index file name");
+  if (temp == NULL)
+    exit (1);
+
+  output = fopen(temp,"w");
+  if (output == NULL)
+    { fprintf(stderr,"%s: Warning: Could not create index file %s\n",Prog_Name,temp);
+      free(temp);
+      return (1);
+    }
+
+  set_kmer_header(&head,block,masks,len);
+  if (fwrite(&head,sizeof(Kmer_Header),1,output) != 1 ||
+      fwrite(index,head.kbytes,len+2,output) != (size_t) (len+2) || fclose(output) != 0)
+    { fprintf(stderr,"%s: Warning: Could not write index file %s\n",Prog_Name,temp);
+      unlink(temp);
+      free(temp);
+      return (1);
+    }
+
+  //  Rename into place so that concurrent jobs never see a partially written index
+
+  if (rename(temp,path) != 0)
+    { unlink(temp);
+      free(temp);
+      return (1);
+    }
+  free(temp);
+  return (0);
+}
+
+void *Load_Kmer_Index(char *path, HITS_DB *block, char *masks, int *len)
+{ Kmer_Header head, want;
+  struct stat info;
+  Kmer_Map   *map;
+  void       *base;
+  int         fd;
+
+  *len = 0;
+  fd = open(path,O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+
+  set_kmer_header(&want,block,masks,0);
+  if (read(fd,&head,sizeof(Kmer_Header)) != sizeof(Kmer_Header) || fstat(fd,&info) != 0)
+    { close(fd);
+      return (NULL);
+    }
+  want.len = head.len;
+  if (memcmp(&head,&want,sizeof(Kmer_Header)) != 0 ||
+      info.st_size != (off_t) (sizeof(Kmer_Header) + head.kbytes*(head.len+2)))
+    { if (VERBOSE)
+        printf("\n   Index %s is stale, rebuilding\n",path);
+      close(fd);
+      return (NULL);
+    }
+
+  base = mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return (NULL);
+
+  map = (Kmer_Map *) Malloc(sizeof(Kmer_Map),"Allocating index map record");
+  if (map == NULL)
+    exit (1);
+  map->base = base;
+  map->size = info.st_size;
+  map->list = (KmerPos *) (((char *) base) + sizeof(Kmer_Header));
+  map->next = Kmer_Maps;
+  Kmer_Maps = map;
+
+  *len = head.len;
+  return (map->list);
+}
+
+static Kmer_Map **kmer_mapping(void *index)
+{ Kmer_Map **m;
+
+  for (m = &Kmer_Maps; *m != NULL; m = &((*m)->next))
+    if ((*m)->list == index)
+      return (m);
+  return (NULL);
+}
+
+void Free_Kmer_Index(void *index)
+{ Kmer_Map **m, *map;
+
+  if (index == NULL)
+    return;
+  m = kmer_mapping(index);
+  if (m == NULL)
+    free(index);
+  else
+    { map = *m;
+      *m  = map->next;
+      munmap(map->base,map->size);
+      free(map);
+    }
+}
+
+
 /*******************************************************************************************
  *
  *  FILTER MATCH
  *
  ********************************************************************************************/
 
-static int find_tuple(uint64 x, KmerPos *a, int n)
+static int find_tuple(uint64 x, Kmer_Pack *k, void *a, int n)
 { int l, r, m;
 
   // smallest k s.t. a[k].code >= x (or n if does not exist)
@@ -894,7 +1510,7 @@ static int find_tuple(uint64 x, KmerPos *a, int n)
   r = n;
   while (l < r)
     { m = ((l+r) >> 1);
-      if (a[m].code < x)
+      if (KCODE(k,a,m) < x)
         l = m+1;
       else
         r = m;
@@ -904,11 +1520,42 @@ static int find_tuple(uint64 x, KmerPos *a, int n)
 
   //  Determine what *will* be the size of the merged list and histogram of sizes for given cutoffs
 
-static KmerPos  *MG_alist;
-static KmerPos  *MG_blist;
-static SeedPair *MG_hits;
-static int       MG_comp;
-static int       MG_self;
+static KmerPos   *MG_alist;
+static KmerPos   *MG_blist;
+static Kmer_Pack  MG_apack;   //  Layouts of alist and blist
+static Kmer_Pack  MG_bpack;
+static SeedPair  *MG_hits;
+static Seed_Pack  MG_spack;   //  Layout of hits
+static int        MG_comp;
+static int        MG_self;
+static int        MG_flip;    //  alist indexes c(A) and blist B, report pairs as A x c(B)
+static HITS_READ *MG_aread;
+static HITS_READ *MG_bread;
+static int        MG_rbeg;    //  merge_thread only produces the hits of A-reads [rbeg,rend)
+static int        MG_rend;
+
+  //  Threads keep copies of the layouts in locals apack, bpack, and spack
+
+#define ACODE(i)  KCODE(&apack,asort,i)
+#define AREAD(i)  KREAD(&apack,asort,i)
+#define ARPOS(i)  KRPOS(&apack,asort,i)
+#define BCODE(i)  KCODE(&bpack,bsort,i)
+#define BREAD(i)  KREAD(&bpack,bsort,i)
+#define BRPOS(i)  KRPOS(&bpack,bsort,i)
+
+static inline void put_seed(SeedPair *hits, int64 n, Seed_Pack *spack,
+                            int bread, int aread, int apos, int diag)
+{ if (spack->packed)
+    ((uint64 *) hits)[n] = (((uint64) bread) << spack->bshift)
+                         | (((uint64) aread) << spack->ashift)
+                         | (((uint64) apos) << spack->pshift) | ((uint64) (diag + spack->doff));
+  else
+    { hits[n].bread = bread;
+      hits[n].aread = aread;
+      hits[n].apos  = apos;
+      hits[n].diag  = diag;
+    }
+}
 
 typedef struct
   { int    abeg, aend;
@@ -916,6 +1563,7 @@ typedef struct
     int64 *kptr;
     int64  nhits;
     int    limit;
+    int64 *acount;    //  If not NULL, count_thread adds the # of hits of each A-read here
     int64  hitgram[MAXGRAM];
   } Merge_Arg;
 
@@ -923,7 +1571,10 @@ static void *count_thread(void *arg)
 { Merge_Arg  *data  = (Merge_Arg *) arg;
   KmerPos    *asort = MG_alist;
   KmerPos    *bsort = MG_blist;
+  Kmer_Pack   apack = MG_apack;
+  Kmer_Pack   bpack = MG_bpack;
   int64      *gram  = data->hitgram;
+  int64      *acnt  = data->acount;
   int64       nhits = 0;
   int         aend  = data->aend;
 
@@ -936,54 +1587,58 @@ static void *count_thread(void *arg)
   int    a, b;
 
   ia = data->abeg;
-  ca = asort[ia].code;
+  ca = ACODE(ia);
   ib = data->bbeg;
-  cb = bsort[ib].code;
+  cb = BCODE(ib);
   if (MG_self)
     { while (1)
         { while (cb < ca)
-            cb = bsort[++ib].code;
+            cb = BCODE(++ib);
           while (cb > ca)
-            ca = asort[++ia].code;
+            ca = ACODE(++ia);
           if (cb == ca)
             { ja = ia++;
-              while ((da = asort[ia].code) == ca)
+              while ((da = ACODE(ia)) == ca)
                 ia += 1;
               jb = ib++;
-              while ((db = bsort[ib].code) == cb)
+              while ((db = BCODE(ib)) == cb)
                 ib += 1;
 
               if (ia > aend)
                 { if (ja >= aend)
                     break;
-                  da = asort[ia = aend].code;
-                  db = bsort[ib = data->bend].code;
+                  da = ACODE(ia = aend);
+                  db = BCODE(ib = data->bend);
                 }
 
               ct = 0;
               b  = jb;
               if (IDENTITY)
                 for (a = ja; a < ia; a++)
-                  { ar = asort[a].read;
+                  { ar = AREAD(a);
                     if (MG_comp)
-                      { while (b < ib && bsort[b].read <= ar)
+                      { while (b < ib && BREAD(b) <= ar)
                           b += 1;
                       }
                     else
-                      { ap = asort[a].rpos;
-                        while (b < ib && bsort[b].read < ar)
+                      { ap = ARPOS(a);
+                        while (b < ib && BREAD(b) < ar)
                           b += 1;
-                        while (b < ib && bsort[b].read == ar && bsort[b].rpos < ap)
+                        while (b < ib && BREAD(b) == ar && BRPOS(b) < ap)
                           b += 1;
                       }
                     ct += (b-jb);
+                    if (acnt != NULL)
+                      acnt[ar] += (b-jb);
                   }
               else
                 for (a = ja; a < ia; a++)
-                  { ar = asort[a].read;
-                    while (b < ib && bsort[b].read < ar)
+                  { ar = AREAD(a);
+                    while (b < ib && BREAD(b) < ar)
                       b += 1;
                     ct += (b-jb);
+                    if (acnt != NULL)
+                      acnt[ar] += (b-jb);
                   }
 
               nhits += ct;
@@ -998,26 +1653,29 @@ static void *count_thread(void *arg)
   else
     { while (1)
         { while (cb < ca)
-            cb = bsort[++ib].code;
+            cb = BCODE(++ib);
           while (cb > ca)
-            ca = asort[++ia].code;
+            ca = ACODE(++ia);
           if (cb == ca)
             { ja = ia++;
-              while ((da = asort[ia].code) == ca)
+              while ((da = ACODE(ia)) == ca)
                 ia += 1;
               jb = ib++;
-              while ((db = bsort[ib].code) == cb)
+              while ((db = BCODE(ib)) == cb)
                 ib += 1;
 
               if (ia > aend)
                 { if (ja >= aend)
                     break;
-                  da = asort[ia = aend].code;
-                  db = bsort[ib = data->bend].code;
+                  da = ACODE(ia = aend);
+                  db = BCODE(ib = data->bend);
                 }
 
               ct  = (ia-ja);
               ct *= (ib-jb);
+              if (acnt != NULL)
+                for (a = ja; a < ia; a++)
+                  acnt[AREAD(a)] += (ib-jb);
 
               nhits += ct;
               ca = da;
@@ -1034,6 +1692,32 @@ static void *count_thread(void *arg)
   return (NULL);
 }
 
+  //  A k-mer ending at q in c(A) matching one ending at p in B is the same as the complement
+  //    of the k-mer, ending at |A|-q+K-2 in A, matching one ending at |B|-p+K-2 in c(B).  Add
+  //    the pairs of c(A)-entry ar,q with B-entries [jb,ib) to hits as seeds of A x c(B).  The
+  //    entries for a given b-read are reversed so that they appear in the same order as they
+  //    would have in an index of c(B).
+
+static int64 flip_pairs(SeedPair *hits, int64 nhits, int64 *kptr, int ar, int q,
+                        KmerPos *bsort, int jb, int ib)
+{ Kmer_Pack bpack = MG_bpack;
+  Seed_Pack spack = MG_spack;
+  int       ap, bp, br;
+  int       c, e, x;
+
+  ap = MG_aread[ar].rlen - q + (Kmer-2);
+  kptr[ap & FMASK] += ib-jb;
+  for (c = jb; c < ib; c = e)
+    { br = BREAD(c);
+      for (e = c+1; e < ib && BREAD(e) == br; e++)
+        ;
+      bp = MG_bread[br].rlen + (Kmer-2);
+      for (x = e-1; x >= c; x--)
+        put_seed(hits,nhits++,&spack,br,ar,ap,ap - (bp - BRPOS(x)));
+    }
+  return (nhits);
+}
+
   //  Produce the merged list now that the list has been allocated and
   //    the appropriate cutoff determined.
 
@@ -1042,10 +1726,15 @@ static void *merge_thread(void *arg)
   int64      *kptr  = data->kptr;
   KmerPos    *asort = MG_alist;
   KmerPos    *bsort = MG_blist;
+  Kmer_Pack   apack = MG_apack;
+  Kmer_Pack   bpack = MG_bpack;
   SeedPair   *hits  = MG_hits;
+  Seed_Pack   spack = MG_spack;
   int64       nhits = data->nhits;
   int         aend  = data->aend;
   int         limit = data->limit;
+  int         rbeg  = MG_rbeg;
+  int         rend  = MG_rend;
 
   int64  ct;
   int    ia, ib;
@@ -1056,52 +1745,52 @@ static void *merge_thread(void *arg)
   int    a, b, c;
 
   ia = data->abeg;
-  ca = asort[ia].code;
+  ca = ACODE(ia);
   ib = data->bbeg;
-  cb = bsort[ib].code;
+  cb = BCODE(ib);
   if (MG_self)
     { while (1)
         { while (cb < ca)
-            cb = bsort[++ib].code;
+            cb = BCODE(++ib);
           while (cb > ca)
-            ca = asort[++ia].code;
+            ca = ACODE(++ia);
           if (cb == ca)
             { ja = ia++;
-              while ((da = asort[ia].code) == ca)
+              while ((da = ACODE(ia)) == ca)
                 ia += 1;
               jb = ib++;
-              while ((db = bsort[ib].code) == cb)
+              while ((db = BCODE(ib)) == cb)
                 ib += 1;
 
               if (ia > aend)
                 { if (ja >= aend)
                     break;
-                  da = asort[ia = aend].code;
-                  db = bsort[ib = data->bend].code;
+                  da = ACODE(ia = aend);
+                  db = BCODE(ib = data->bend);
                 }
 
               ct = 0;
               b  = jb;
               if (IDENTITY)
                 for (a = ja; a < ia; a++)
-                  { ar = asort[a].read;
+                  { ar = AREAD(a);
                     if (MG_comp)
-                      { while (b < ib && bsort[b].read <= ar)
+                      { while (b < ib && BREAD(b) <= ar)
                           b += 1;
                       }
                     else
-                      { ap = asort[a].rpos;
-                        while (b < ib && bsort[b].read < ar)
+                      { ap = ARPOS(a);
+                        while (b < ib && BREAD(b) < ar)
                           b += 1;
-                        while (b < ib && bsort[b].read == ar && bsort[b].rpos < ap)
+                        while (b < ib && BREAD(b) == ar && BRPOS(b) < ap)
                           b += 1;
                       }
                     ct += (b-jb);
                   }
               else
                 for (a = ja; a < ia; a++)
-                  { ar = asort[a].read;
-                    while (b < ib && bsort[b].read < ar)
+                  { ar = AREAD(a);
+                    while (b < ib && BREAD(b) < ar)
                       b += 1;
                     ct += (b-jb);
                   }
@@ -1110,44 +1799,42 @@ static void *merge_thread(void *arg)
                 { b = jb;
                   if (IDENTITY)
                     for (a = ja; a < ia; a++)
-                      { ap = asort[a].rpos;
-                        ar = asort[a].read;
+                      { ap = ARPOS(a);
+                        ar = AREAD(a);
                         if (MG_comp)
-                          { while (b < ib && bsort[b].read <= ar)
+                          { while (b < ib && BREAD(b) <= ar)
                               b += 1;
                           }
                         else
-                          { while (b < ib && bsort[b].read < ar)
+                          { while (b < ib && BREAD(b) < ar)
                               b += 1;
-                            while (b < ib && bsort[b].read == ar && bsort[b].rpos < ap)
+                            while (b < ib && BREAD(b) == ar && BRPOS(b) < ap)
                               b += 1;
                           }
-                        if ((ct = b-jb) > 0)
-                          { kptr[ap & BMASK] += ct;
+                        if (ar < rbeg || ar >= rend)
+                          continue;
+                        if (MG_flip)
+                          nhits = flip_pairs(hits,nhits,kptr,ar,ap,bsort,jb,b);
+                        else if ((ct = b-jb) > 0)
+                          { kptr[ap & FMASK] += ct;
                             for (c = jb; c < b; c++)
-                              { hits[nhits].bread = bsort[c].read;
-                                hits[nhits].aread = ar;
-                                hits[nhits].apos  = ap; 
-                                hits[nhits].diag  = ap - bsort[c].rpos;
-                                nhits += 1;
-                              }
+                              put_seed(hits,nhits++,&spack,BREAD(c),ar,ap,ap - BRPOS(c));
                           }
                       }
                   else
                     for (a = ja; a < ia; a++)
-                      { ap = asort[a].rpos;
-                        ar = asort[a].read;
-                        while (b < ib && bsort[b].read < ar)
+                      { ap = ARPOS(a);
+                        ar = AREAD(a);
+                        while (b < ib && BREAD(b) < ar)
                           b += 1;
-                        if ((ct = b-jb) > 0)
-                          { kptr[ap & BMASK] += ct;
+                        if (ar < rbeg || ar >= rend)
+                          continue;
+                        if (MG_flip)
+                          nhits = flip_pairs(hits,nhits,kptr,ar,ap,bsort,jb,b);
+                        else if ((ct = b-jb) > 0)
+                          { kptr[ap & FMASK] += ct;
                             for (c = jb; c < b; c++)
-                              { hits[nhits].bread = bsort[c].read;
-                                hits[nhits].aread = ar;
-                                hits[nhits].apos  = ap; 
-                                hits[nhits].diag  = ap - bsort[c].rpos;
-                                nhits += 1;
-                              }
+                              put_seed(hits,nhits++,&spack,BREAD(c),ar,ap,ap - BRPOS(c));
                           }
                       }
                 }
@@ -1159,36 +1846,38 @@ static void *merge_thread(void *arg)
   else
     { while (1)
         { while (cb < ca)
-            cb = bsort[++ib].code;
+            cb = BCODE(++ib);
           while (cb > ca)
-            ca = asort[++ia].code;
+            ca = ACODE(++ia);
           if (cb == ca)
             { if (ia >= aend) break;
               ja = ia++;
-              while ((da = asort[ia].code) == ca)
+              while ((da = ACODE(ia)) == ca)
                 ia += 1;
               jb = ib++;
-              while ((db = bsort[ib].code) == cb)
+              while ((db = BCODE(ib)) == cb)
                 ib += 1;
 
               if (ia > aend)
                 { if (ja >= aend)
                     break;
-                  da = asort[ia = aend].code;
-                  db = bsort[ib = data->bend].code;
+                  da = ACODE(ia = aend);
+                  db = BCODE(ib = data->bend);
                 }
 
               ct = ib-jb;
               if ((ia-ja)*ct < limit)
                 { for (a = ja; a < ia; a++)
-                    { ap = asort[a].rpos;
-                      kptr[ap & BMASK] += ct;
-                      for (b = jb; b < ib; b++)
-                        { hits[nhits].bread = bsort[b].read;
-                          hits[nhits].aread = asort[a].read;
-                          hits[nhits].apos  = ap;
-                          hits[nhits].diag  = ap - bsort[b].rpos;
-                          nhits += 1;
+                    { ar = AREAD(a);
+                      if (ar < rbeg || ar >= rend)
+                        continue;
+                      ap = ARPOS(a);
+                      if (MG_flip)
+                        nhits = flip_pairs(hits,nhits,kptr,ar,ap,bsort,jb,ib);
+                      else
+                        { kptr[ap & FMASK] += ct;
+                          for (b = jb; b < ib; b++)
+                            put_seed(hits,nhits++,&spack,BREAD(b),ar,ap,ap - BRPOS(b));
                         }
                     }
                 }
@@ -1201,12 +1890,36 @@ static void *merge_thread(void *arg)
   return (NULL);
 }
 
-  //  Report threads: given a segment of merged list, find all seeds and from them all alignments.
+  //  Widen the n packed seed pairs at the start of hits to SeedPairs in place (back to front)
 
-static HITS_DB    *MR_ablock;
-static HITS_DB    *MR_bblock;
-static SeedPair   *MR_hits;
-static int         MR_two;
+static void widen_seeds(SeedPair *hits, int64 n)
+{ Double    *d     = (Double *) hits;
+  Seed_Pack  spack = MG_spack;
+  uint64     x;
+  int64      i;
+
+  for (i = n-1; i >= 0; i--)
+    { x = ((uint64 *) hits)[i];
+      d[i].p1 = (((x >> spack.pshift) & spack.pmask) << 32)
+              | (uint32) ((int64) (x & spack.dmask) - spack.doff);
+      d[i].p2 = ((x >> spack.bshift) << 32) | ((x >> spack.ashift) & spack.amask);
+    }
+}
+
+  //  Report threads: given the merged list, find all seeds and from them all alignments.
+  //    The threads take chunks of the list from a shared cursor until it is exhausted, so
+  //    that a few very productive pairs of reads do not leave the other threads idle.
+
+#define REPORT_CHUNKS   64     //  Target number of chunks claimed per thread
+#define REPORT_MINCHUNK 1024   //  Minimum # of seeds in a chunk
+
+static HITS_DB    *MR_ablock;
+static HITS_DB    *MR_bblock;
+static SeedPair   *MR_hits;
+static int64       MR_nhits;
+static int64       MR_next;    //  Work queue cursor: index of the first unclaimed seed
+static int64       MR_chunk;
+static int         MR_two;
 static Align_Spec *MR_spec;
 static int         MR_tspace;
 
@@ -1554,16 +2267,266 @@ void Diagonal_Span(Path *path, int *mind, int *maxd)
   *maxd = (hgh >> Binshift)+1;
 }
 
+  //  Place the complement of the len bases at s in t, followed by a terminator
+
+static void complement_read(char *t, char *s, int len)
+{ int i;
+
+  t[len] = 4;
+  for (i = len-1; i >= 0; i--)
+    *t++ = (char) (3-s[i]);
+}
+
+  //  Index of the first seed of a pair of reads at or after x.  Seeds are sorted on p2 so a
+  //    pair that straddles x is skipped by galloping and then bisecting to its end.
+
+static int64 pair_start(Double *hitd, int64 x)
+{ int64  lo, hi, step, m;
+  uint64 pair;
+
+  if (x <= 0 || x >= MR_nhits)
+    return (x);
+  pair = hitd[x-1].p2;
+  if (hitd[x].p2 != pair)
+    return (x);
+
+  lo   = x;                     //  hitd[lo].p2 == pair, the first index of the next pair is in
+  step = 1;                     //    (lo,hi] and hitd[MR_nhits] is the sentinel
+  while (lo+step < MR_nhits && hitd[lo+step].p2 == pair)
+    { lo   += step;
+      step <<= 1;
+    }
+  hi = lo+step;
+  if (hi > MR_nhits)
+    hi = MR_nhits;
+  while (hi-lo > 1)
+    { m = (lo+hi) >> 1;
+      if (hitd[m].p2 == pair)
+        lo = m;
+      else
+        hi = m;
+    }
+  return (hi);
+}
+
+  //  Claim the next chunk of seeds, returning 0 when there are none left.  Chunk k is given
+  //    the pairs of reads whose first seed is in [k*MR_chunk,(k+1)*MR_chunk), so [*beg,*end)
+  //    is empty when one pair covers all of it.
+
+static int next_chunk(Double *hitd, int64 *beg, int64 *end)
+{ int64 b, e;
+
+  b = __sync_fetch_and_add(&MR_next,MR_chunk);
+  if (b >= MR_nhits)
+    return (0);
+  e = b + MR_chunk;
+  if (e > MR_nhits)
+    e = MR_nhits;
+  *beg = pair_start(hitd,b);
+  *end = pair_start(hitd,e);
+  return (1);
+}
+
+  //  Single file output (see Open_Match_Output): the report threads fill batches of overlap
+  //    records in .las format and push them on a lock-free stack from which one writer thread
+  //    takes them all at once and appends them to the file of the batch in FIFO order.
+
+#define LAS_BATCH   0x100000     //  Bytes per batch
+#define LAS_QUEUE   0x4000000    //  Report threads wait while this many bytes are queued
+
+typedef struct Las_Batch
+  { struct Las_Batch *next;
+    int               file;      //  0 = A.B.las, 1 = B.A.las
+    int64             novl;
+    int64             len;
+    int64             max;
+    char             *data;
+  } Las_Batch;
+
+static FILE      *LW_file[2];     //  LW_file[0] != NULL iff the single file output is open
+static int64      LW_novl[2];
+static Las_Batch *LW_queue;
+static int64      LW_bytes;
+static int        LW_done;
+
+static void lw_nap()
+{ struct timespec nap;
+
+  nap.tv_sec  = 0;
+  nap.tv_nsec = 100000;
+  nanosleep(&nap,NULL);
+}
+
+static void lw_push(Las_Batch *b)
+{ int64 len = b->len;
+
+  b->next = __atomic_load_n(&LW_queue,__ATOMIC_RELAXED);
+  while ( ! __atomic_compare_exchange_n(&LW_queue,&b->next,b,1,__ATOMIC_RELEASE,__ATOMIC_RELAXED))
+    ;
+  if (__atomic_add_fetch(&LW_bytes,len,__ATOMIC_RELAXED) > LAS_QUEUE)
+    while (__atomic_load_n(&LW_bytes,__ATOMIC_RELAXED) > LAS_QUEUE)
+      lw_nap();
+}
+
+static void *writer_thread(void *arg)
+{ Las_Batch *b, *n, *r;
+  int        done;
+
+  (void) arg;
+  while (1)
+    { done = __atomic_load_n(&LW_done,__ATOMIC_ACQUIRE);
+      b    = __atomic_exchange_n(&LW_queue,NULL,__ATOMIC_ACQUIRE);
+      if (b == NULL)
+        { if (done)
+            break;
+          lw_nap();
+          continue;
+        }
+
+      for (r = NULL; b != NULL; b = n)     //  Stack order to arrival order
+        { n = b->next;
+          b->next = r;
+          r = b;
+        }
+
+      for (b = r; b != NULL; b = n)
+        { n = b->next;
+          fwrite(b->data,1,b->len,LW_file[b->file]);
+          LW_novl[b->file] += b->novl;
+          __atomic_sub_fetch(&LW_bytes,b->len,__ATOMIC_RELAXED);
+          free(b->data);
+          free(b);
+        }
+    }
+  return (NULL);
+}
+
+  //  Append ovl and its trace to the batch of file f of a report thread, passing the batch
+  //    to the writer when it is full.
+
+static void lw_overlap(Las_Batch **batch, int f, Overlap *ovl, int tbytes)
+{ Las_Batch *b = batch[f];
+  int64      hlen, tlen;
+
+  hlen = sizeof(Overlap) - sizeof(void *);
+  tlen = ovl->path.tlen * tbytes;
+  if (b != NULL && b->len + hlen + tlen > b->max)
+    { lw_push(b);
+      b = NULL;
+    }
+  if (b == NULL)
+    { b = (Las_Batch *) Malloc(sizeof(Las_Batch),"Allocating output batch");
+      if (b == NULL)
+        exit (1);
+      b->file = f;
+      b->novl = 0;
+      b->len  = 0;
+      b->max  = LAS_BATCH;
+      if (hlen + tlen > b->max)
+        b->max = hlen + tlen;
+      b->data = (char *) Malloc(b->max,"Allocating output batch");
+      if (b->data == NULL)
+        exit (1);
+      batch[f] = b;
+    }
+  memcpy(b->data + b->len,((char *) ovl) + sizeof(void *),hlen);
+  memcpy(b->data + (b->len + hlen),ovl->path.trace,tlen);
+  b->len  += hlen + tlen;
+  b->novl += 1;
+}
+
+  //  Sorted output (SORTED): each report thread keeps the overlaps destined for each of its
+  //    files in a run, and at the end of Match_Filter sorts each run into the (aread, bread,
+  //    abpos) order of LAsort/LAmerge and writes it, so that LAsort need not be called.
+
 typedef struct
-  { int64       beg, end;
-    int        *score;
+  { int   aread, bread;
+    int   abpos, len;
+    int64 off;
+  } Las_Key;
+
+typedef struct
+  { char    *data;
+    int64    len, max;
+    Las_Key *keys;
+    int64    novl, kmax;
+  } Las_Run;
+
+static void run_overlap(Las_Run *r, Overlap *ovl, int tbytes)
+{ Las_Key *k;
+  int64    hlen, tlen;
+
+  hlen = sizeof(Overlap) - sizeof(void *);
+  tlen = ovl->path.tlen * tbytes;
+  if (r->len + hlen + tlen > r->max)
+    { r->max  = 1.2*(r->len + hlen + tlen) + LAS_BATCH;
+      r->data = (char *) Realloc(r->data,r->max,"Reallocating sorted output run");
+      if (r->data == NULL)
+        exit (1);
+    }
+  if (r->novl >= r->kmax)
+    { r->kmax = 1.2*r->novl + 1000;
+      r->keys = (Las_Key *) Realloc(r->keys,sizeof(Las_Key)*r->kmax,
+                                    "Reallocating sorted output run");
+      if (r->keys == NULL)
+        exit (1);
+    }
+  k = r->keys + r->novl++;
+  k->aread = ovl->aread;
+  k->bread = ovl->bread;
+  k->abpos = ovl->path.abpos;
+  k->len   = hlen + tlen;
+  k->off   = r->len;
+  memcpy(r->data + r->len,((char *) ovl) + sizeof(void *),hlen);
+  memcpy(r->data + (r->len + hlen),ovl->path.trace,tlen);
+  r->len += hlen + tlen;
+}
+
+static int KEY_ORDER(const void *l, const void *r)
+{ Las_Key *x = (Las_Key *) l;
+  Las_Key *y = (Las_Key *) r;
+
+  if (x->aread != y->aread)
+    return (x->aread - y->aread);
+  if (x->bread != y->bread)
+    return (x->bread - y->bread);
+  if (x->abpos != y->abpos)
+    return (x->abpos - y->abpos);
+  if (x->off < y->off)
+    return (-1);
+  return (x->off > y->off);
+}
+
+  //  Sort run r, write it to output, and release it
+
+static void write_run(Las_Run *r, FILE *output)
+{ int64 i;
+
+  qsort(r->keys,r->novl,sizeof(Las_Key),KEY_ORDER);
+  for (i = 0; i < r->novl; i++)
+    fwrite(r->data + r->keys[i].off,r->keys[i].len,1,output);
+  free(r->keys);
+  free(r->data);
+  r->keys = NULL;
+  r->data = NULL;
+  r->len  = r->max  = 0;
+  r->novl = r->kmax = 0;
+}
+
+typedef struct
+  { int        *score;
     int        *lastp;
     int        *lasta;
     Work_Data  *work;
     FILE       *ofile1;
     FILE       *ofile2;
-    int64       nfilt;
-    int64       ncheck;
+    Las_Batch  *batch[2];     //  Current output batches if the single file output is open
+    Las_Run     run[2];       //  Overlaps for ofile1 and ofile2 if SORTED
+    int64       nfilt;        //  Totals over all calls, the counts of overlaps written to
+    int64       ahits;        //    ofile1 and ofile2 are set in the file headers by the caller
+    int64       bhits;
+    double      busy;         //  Thread CPU seconds and # of chunks processed over all calls
+    int64       chunks;
   } Report_Arg;
 
 static void *report_thread(void *arg)
@@ -1586,6 +2549,8 @@ static void *report_thread(void *arg)
   int          bfirst = MR_bblock->tfirst;
   int          maxdiag = ( MR_ablock->maxlen >> Binshift);
   int          mindiag = (-MR_bblock->maxlen >> Binshift);
+  char        *cseq    = NULL;
+  int          cread   = -1;
 
   Overlap     _ovla, *ovla = &_ovla;
   Overlap     _ovlb, *ovlb = &_ovlb;
@@ -1595,7 +2560,9 @@ static void *report_thread(void *arg)
   int64        nfilt = 0;
   int64        ahits = 0;
   int64        bhits = 0;
+  int64        chunks = 0;
   int          small, tbytes;
+  struct timespec t0, t1;
 
   int    AOmax, BOmax;
   int    novla, novlb;
@@ -1612,6 +2579,8 @@ static void *report_thread(void *arg)
   //  In ovl and align roles of A and B are reversed, as the B sequence must be the
   //    complemented sequence !!
 
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&t0);
+
   align->flags = ovla->flags = ovlb->flags = MG_comp;
   align->path  = apath;
 
@@ -1634,289 +2603,310 @@ static void *report_thread(void *arg)
   if (amatch == NULL || bmatch == NULL || tbuf->trace == NULL)
     exit (1);
 
-  fwrite(&ahits,sizeof(int64),1,ofile1);
-  fwrite(&MR_tspace,sizeof(int),1,ofile1);
-  if (MR_two)
-    { fwrite(&bhits,sizeof(int64),1,ofile2);
-      fwrite(&MR_tspace,sizeof(int),1,ofile2);
+  if (MG_flip)                      //  B-reads are complemented as they are needed
+    { cseq = Malloc(MR_bblock->maxlen+2,"Allocating complement buffer");
+      if (cseq == NULL)
+        exit (1);
+      *cseq++ = 4;
     }
 
   minhit = (Hitmin-1)/Kmer + 1;
   hitc   = hitd + (minhit-1);
-  eidx   = data->end - minhit;
-  nidx   = data->beg;
-  for (cpair = hitd[nidx].p2; nidx < eidx; cpair = npair)
-    if (hitc[nidx].p2 != cpair)
-      { nidx += 1;
-        while ((npair = hitd[nidx].p2) == cpair)
-          nidx += 1;
-      }
-    else
-      { int   ar, br;
-        int   alen, blen;
-        int   doA, doB;
-        int   setaln, amark, amark2;
-        int   apos, bpos, diag;
-        int64 lidx, sidx;
-        int64 f, h2;
-
-        ar = hits[nidx].aread;
-        br = hits[nidx].bread;
-        alen = aread[ar].rlen;
-        blen = bread[br].rlen;
-        if (alen < HGAP_MIN && blen < HGAP_MIN)
+  while (next_chunk(hitd,&nidx,&eidx))
+    { chunks += 1;
+      eidx   -= minhit;
+      for (cpair = hitd[nidx].p2; nidx < eidx; cpair = npair)
+        if (hitc[nidx].p2 != cpair)
           { nidx += 1;
             while ((npair = hitd[nidx].p2) == cpair)
               nidx += 1;
-            continue;
           }
+        else
+          { int   ar, br;
+            int   alen, blen;
+            int   doA, doB;
+            int   setaln, amark, amark2;
+            int   apos, bpos, diag;
+            int64 lidx, sidx;
+            int64 f, h2;
+
+            ar = hits[nidx].aread;
+            br = hits[nidx].bread;
+            alen = aread[ar].rlen;
+            blen = bread[br].rlen;
+            if (alen < HGAP_MIN && blen < HGAP_MIN)
+              { nidx += 1;
+                while ((npair = hitd[nidx].p2) == cpair)
+                  nidx += 1;
+                continue;
+              }
 
 #ifdef TEST_GATHER
-        printf("%5d vs %5d : %5d x %5d\n",br+bfirst,ar+afirst,blen,alen);
+            printf("%5d vs %5d : %5d x %5d\n",br+bfirst,ar+afirst,blen,alen);
 #endif
-        setaln = 1;
-        doA = doB = 0;
-        amark2 = 0;
-        novla  = novlb = 0;
-        tbuf->top = 0;
-        for (sidx = nidx; hitd[nidx].p2 == cpair; nidx = h2)
-          { amark  = amark2 + PANEL_SIZE;
-            amark2 = amark  - PANEL_OVERLAP;
-
-            h2 = lidx = nidx;
-            do
-              { apos  = hits[nidx].apos;
-                npair = hitd[++nidx].p2;
-                if (apos <= amark2)
-                  h2 = nidx;
-              }
-            while (npair == cpair && apos <= amark);
+            setaln = 1;
+            doA = doB = 0;
+            amark2 = 0;
+            novla  = novlb = 0;
+            tbuf->top = 0;
+            for (sidx = nidx; hitd[nidx].p2 == cpair; nidx = h2)
+              { amark  = amark2 + PANEL_SIZE;
+                amark2 = amark  - PANEL_OVERLAP;
+
+                h2 = lidx = nidx;
+                do
+                  { apos  = hits[nidx].apos;
+                    npair = hitd[++nidx].p2;
+                    if (apos <= amark2)
+                      h2 = nidx;
+                  }
+                while (npair == cpair && apos <= amark);
 
-            if (nidx-lidx < minhit) continue;
+                if (nidx-lidx < minhit) continue;
 
-            for (f = lidx; f < nidx; f++)
-              { apos = hits[f].apos;
-                diag = hits[f].diag >> Binshift;
-                if (apos - lastp[diag] >= Kmer)
-                  score[diag] += Kmer;
-                else
-                  score[diag] += apos - lastp[diag];
-                lastp[diag] = apos;
-              }
+                for (f = lidx; f < nidx; f++)
+                  { apos = hits[f].apos;
+                    diag = hits[f].diag >> Binshift;
+                    if (apos - lastp[diag] >= Kmer)
+                      score[diag] += Kmer;
+                    else
+                      score[diag] += apos - lastp[diag];
+                    lastp[diag] = apos;
+                  }
 
 #ifdef TEST_GATHER
-            printf("  %6lld upto %6d",nidx-lidx,amark);
+                printf("  %6lld upto %6d",nidx-lidx,amark);
 #endif
 
-            for (f = lidx; f < nidx; f++)
-              { apos = hits[f].apos;
-                diag = hits[f].diag;
-                bpos = apos - diag;
-                diag = diag >> Binshift;
-                if (apos > lasta[diag] &&
-                     (score[diag] + scorp[diag] >= Hitmin || score[diag] + scorm[diag] >= Hitmin))
-                  { if (setaln)
-                      { setaln = 0;
-                        align->aseq = aseq + aread[ar].boff;
-                        align->bseq = bseq + bread[br].boff;
-                        align->alen = alen;
-                        align->blen = blen;
-                        ovlb->bread = ovla->aread = ar + afirst;
-                        ovlb->aread = ovla->bread = br + bfirst;
-                        doA = (alen >= HGAP_MIN);
-                        doB = (SYMMETRIC && blen >= HGAP_MIN &&
-                                   (ar != br || !MG_self || !MG_comp));
-                      }
+                for (f = lidx; f < nidx; f++)
+                  { apos = hits[f].apos;
+                    diag = hits[f].diag;
+                    bpos = apos - diag;
+                    diag = diag >> Binshift;
+                    if (apos > lasta[diag] &&
+                         (score[diag] + scorp[diag] >= Hitmin || score[diag] + scorm[diag] >= Hitmin))
+                      { if (setaln)
+                          { setaln = 0;
+                            align->aseq = aseq + aread[ar].boff;
+                            if (MG_flip)
+                              { if (br != cread)
+                                  { complement_read(cseq,bseq + bread[br].boff,blen);
+                                    cread = br;
+                                  }
+                                align->bseq = cseq;
+                              }
+                            else
+                              align->bseq = bseq + bread[br].boff;
+                            align->alen = alen;
+                            align->blen = blen;
+                            ovlb->bread = ovla->aread = ar + afirst;
+                            ovlb->aread = ovla->bread = br + bfirst;
+                            doA = (alen >= HGAP_MIN);
+                            doB = (SYMMETRIC && blen >= HGAP_MIN &&
+                                       (ar != br || !MG_self || !MG_comp));
+                          }
 #ifdef TEST_GATHER
-                    else
-                      printf("\n                    ");
+                        else
+                          printf("\n                    ");
 
-                    if (scorm[diag] > scorp[diag])
-                      printf("  %5d.. x %5d.. %5d (%3d)",
-                             bpos,apos,apos-bpos,score[diag]+scorm[diag]);
-                    else
-                      printf("  %5d.. x %5d.. %5d (%3d)",
-                             bpos,apos,apos-bpos,score[diag]+scorp[diag]);
+                        if (scorm[diag] > scorp[diag])
+                          printf("  %5d.. x %5d.. %5d (%3d)",
+                                 bpos,apos,apos-bpos,score[diag]+scorm[diag]);
+                        else
+                          printf("  %5d.. x %5d.. %5d (%3d)",
+                                 bpos,apos,apos-bpos,score[diag]+scorp[diag]);
 #endif
-                    nfilt += 1;
+                        nfilt += 1;
 
-                    bpath = Local_Alignment(align,work,MR_spec,apos-bpos,apos-bpos,apos+bpos,-1,-1);
+                        bpath = Local_Alignment(align,work,MR_spec,apos-bpos,apos-bpos,apos+bpos,-1,-1);
 
-                    { int low, hgh, ae;
+                        { int low, hgh, ae;
 
-                      Diagonal_Span(apath,&low,&hgh);
-                      if (diag < low)
-                        low = diag;
-                      else if (diag > hgh)
-                        hgh = diag;
-                      ae = apath->aepos;
-                      for (diag = low; diag <= hgh; diag++)
-                        if (ae > lasta[diag])
-                          lasta[diag] = ae;
+                          Diagonal_Span(apath,&low,&hgh);
+                          if (diag < low)
+                            low = diag;
+                          else if (diag > hgh)
+                            hgh = diag;
+                          ae = apath->aepos;
+                          for (diag = low; diag <= hgh; diag++)
+                            if (ae > lasta[diag])
+                              lasta[diag] = ae;
 #ifdef TEST_GATHER
-                      printf(" %d - %d @ %d",low,hgh,apath->aepos);
+                          printf(" %d - %d @ %d",low,hgh,apath->aepos);
 #endif
-                    }
+                        }
 
 #ifdef FALCON_DALIGNER_P
-                    if (apath->abpos > 24 && apath->bbpos > 24)
-                      continue;
+                        if (apath->abpos > 24 && apath->bbpos > 24)
+                          continue;
 
-                    if (alen - apath->aepos > 24 && blen - apath->bepos > 24)
-                      continue;
+                        if (alen - apath->aepos > 24 && blen - apath->bepos > 24)
+                          continue;
 
-                    if (alen < 500 || blen < 500)
-                      continue;
+                        if (alen < 500 || blen < 500)
+                          continue;
 #endif  // FALCON_DALIGNER_P
 
-                    if ((apath->aepos-apath->abpos) + (apath->bepos-apath->bbpos) >= MINOVER)
-                      { if (doA)
-                          { if (novla >= AOmax)
-                              { AOmax = 1.2*novla + MATCH_CHUNK;
-                                amatch = Realloc(amatch,sizeof(Path)*AOmax,
-                                                 "Reallocating match vector");
-                                if (amatch == NULL)
-                                  exit (1);
-                              }
-                            if (tbuf->top + apath->tlen > tbuf->max)
-                              { tbuf->max = 1.2*(tbuf->top+apath->tlen) + TRACE_CHUNK;
-                                tbuf->trace = Realloc(tbuf->trace,sizeof(short)*tbuf->max,
-                                                      "Reallocating trace vector");
-                                if (tbuf->trace == NULL)
-                                  exit (1);
-                              }
-                            amatch[novla] = *apath;
-                            amatch[novla].trace = (void *) (tbuf->top);
-                            memcpy(tbuf->trace+tbuf->top,apath->trace,sizeof(short)*apath->tlen);
-                            novla += 1;
-                            tbuf->top += apath->tlen;
-                          }
-                        if (doB)
-                          { if (novlb >= BOmax)
-                              { BOmax = 1.2*novlb + MATCH_CHUNK;
-                                bmatch = Realloc(bmatch,sizeof(Path)*BOmax,
-                                                        "Reallocating match vector");
-                                if (bmatch == NULL)
-                                  exit (1);
+                        if ((apath->aepos-apath->abpos) + (apath->bepos-apath->bbpos) >= MINOVER)
+                          { if (doA)
+                              { if (novla >= AOmax)
+                                  { AOmax = 1.2*novla + MATCH_CHUNK;
+                                    amatch = Realloc(amatch,sizeof(Path)*AOmax,
+                                                     "Reallocating match vector");
+                                    if (amatch == NULL)
+                                      exit (1);
+                                  }
+                                if (tbuf->top + apath->tlen > tbuf->max)
+                                  { tbuf->max = 1.2*(tbuf->top+apath->tlen) + TRACE_CHUNK;
+                                    tbuf->trace = Realloc(tbuf->trace,sizeof(short)*tbuf->max,
+                                                          "Reallocating trace vector");
+                                    if (tbuf->trace == NULL)
+                                      exit (1);
+                                  }
+                                amatch[novla] = *apath;
+                                amatch[novla].trace = (void *) (tbuf->top);
+                                memcpy(tbuf->trace+tbuf->top,apath->trace,sizeof(short)*apath->tlen);
+                                novla += 1;
+                                tbuf->top += apath->tlen;
                               }
-                            if (tbuf->top + bpath->tlen > tbuf->max)
-                              { tbuf->max = 1.2*(tbuf->top+bpath->tlen) + TRACE_CHUNK;
-                                tbuf->trace = Realloc(tbuf->trace,sizeof(short)*tbuf->max,
-                                                      "Reallocating trace vector");
-                                if (tbuf->trace == NULL)
-                                  exit (1);
+                            if (doB)
+                              { if (novlb >= BOmax)
+                                  { BOmax = 1.2*novlb + MATCH_CHUNK;
+                                    bmatch = Realloc(bmatch,sizeof(Path)*BOmax,
+                                                            "Reallocating match vector");
+                                    if (bmatch == NULL)
+                                      exit (1);
+                                  }
+                                if (tbuf->top + bpath->tlen > tbuf->max)
+                                  { tbuf->max = 1.2*(tbuf->top+bpath->tlen) + TRACE_CHUNK;
+                                    tbuf->trace = Realloc(tbuf->trace,sizeof(short)*tbuf->max,
+                                                          "Reallocating trace vector");
+                                    if (tbuf->trace == NULL)
+                                      exit (1);
+                                  }
+                                bmatch[novlb] = *bpath;
+                                bmatch[novlb].trace = (void *) (tbuf->top);
+                                memcpy(tbuf->trace+tbuf->top,bpath->trace,sizeof(short)*bpath->tlen);
+                                novlb += 1;
+                                tbuf->top += bpath->tlen;
                               }
-                            bmatch[novlb] = *bpath;
-                            bmatch[novlb].trace = (void *) (tbuf->top);
-                            memcpy(tbuf->trace+tbuf->top,bpath->trace,sizeof(short)*bpath->tlen);
-                            novlb += 1;
-                            tbuf->top += bpath->tlen;
-                          }
 
 #ifdef TEST_GATHER
-                        printf("  [%5d,%5d] x [%5d,%5d] = %4d",
-                               apath->abpos,apath->aepos,apath->bbpos,apath->bepos,apath->diffs);
+                            printf("  [%5d,%5d] x [%5d,%5d] = %4d",
+                                   apath->abpos,apath->aepos,apath->bbpos,apath->bepos,apath->diffs);
 #endif
 #ifdef SHOW_OVERLAP
-                        printf("\n\n                    %d(%d) vs %d(%d)\n\n",
-                               ovla->aread,ovla->alen,ovla->bread,ovla->blen);
-                        Print_ACartoon(stdout,align,ALIGN_INDENT);
+                            printf("\n\n                    %d(%d) vs %d(%d)\n\n",
+                                   ovla->aread,ovla->alen,ovla->bread,ovla->blen);
+                            Print_ACartoon(stdout,align,ALIGN_INDENT);
 #ifdef SHOW_ALIGNMENT
-                        Compute_Trace_ALL(align,work);
-                        printf("\n                      Diff = %d\n",align->path->diffs);
-                        Print_Alignment(stdout,align,work,
-                                        ALIGN_INDENT,ALIGN_WIDTH,ALIGN_BORDER,0,5);
+                            Compute_Trace_ALL(align,work);
+                            printf("\n                      Diff = %d\n",align->path->diffs);
+                            Print_Alignment(stdout,align,work,
+                                            ALIGN_INDENT,ALIGN_WIDTH,ALIGN_BORDER,0,5);
 #endif
 #endif // SHOW_OVERLAP
 
-                      }
+                          }
 #ifdef TEST_GATHER
-                    else
-                      printf("  No alignment %d",
-                              ((apath->aepos-apath->abpos) + (apath->bepos-apath->bbpos))/2);
+                        else
+                          printf("  No alignment %d",
+                                  ((apath->aepos-apath->abpos) + (apath->bepos-apath->bbpos))/2);
 #endif
+                      }
                   }
-              }
 
-            for (f = lidx; f < nidx; f++)
-              { diag = hits[f].diag >> Binshift;
-                score[diag] = lastp[diag] = 0;
-              }
+                for (f = lidx; f < nidx; f++)
+                  { diag = hits[f].diag >> Binshift;
+                    score[diag] = lastp[diag] = 0;
+                  }
 #ifdef TEST_GATHER
-            printf("\n");
+                printf("\n");
 #endif
-          }
+              }
 
-        for (f = sidx; f < nidx; f++)
-          { int d;
+            for (f = sidx; f < nidx; f++)
+              { int d;
 
-            diag = hits[f].diag >> Binshift;
-            for (d = diag; d <= maxdiag; d++)
-              if (lasta[d] == 0)
-                break;
-              else
-                lasta[d] = 0;
-            for (d = diag-1; d >= mindiag; d--)
-              if (lasta[d] == 0)
-                break;
-              else
-                lasta[d] = 0;
-          }
+                diag = hits[f].diag >> Binshift;
+                for (d = diag; d <= maxdiag; d++)
+                  if (lasta[d] == 0)
+                    break;
+                  else
+                    lasta[d] = 0;
+                for (d = diag-1; d >= mindiag; d--)
+                  if (lasta[d] == 0)
+                    break;
+                  else
+                    lasta[d] = 0;
+              }
 
          
-         { int i;
+             { int i;
 
 #ifdef TEST_CONTAIN
-           if (novla > 1 || novlb > 1)
-             printf("\n%5d vs %5d:\n",ar,br);
+               if (novla > 1 || novlb > 1)
+                 printf("\n%5d vs %5d:\n",ar,br);
 #endif
 
-           if (novla > 1)
-             { if (novlb > 1)
-                 novla = novlb = Handle_Redundancies(amatch,novla,bmatch,tbuf);
-               else
-                 novla = Handle_Redundancies(amatch,novla,NULL,tbuf);
-             }
-           else if (novlb > 1)
-             novlb = Handle_Redundancies(bmatch,novlb,NULL,tbuf);
-
-           for (i = 0; i < novla; i++)
-             { ovla->path = amatch[i];
-               ovla->path.trace = tbuf->trace + (uint64) (ovla->path.trace);
-               if (small)
-                 Compress_TraceTo8(ovla);
-               Write_Overlap(ofile1,ovla,tbytes);
+               if (novla > 1)
+                 { if (novlb > 1)
+                     novla = novlb = Handle_Redundancies(amatch,novla,bmatch,tbuf);
+                   else
+                     novla = Handle_Redundancies(amatch,novla,NULL,tbuf);
+                 }
+               else if (novlb > 1)
+                 novlb = Handle_Redundancies(bmatch,novlb,NULL,tbuf);
+
+               for (i = 0; i < novla; i++)
+                 { ovla->path = amatch[i];
+                   ovla->path.trace = tbuf->trace + (uint64) (ovla->path.trace);
+                   if (small)
+                     Compress_TraceTo8(ovla);
+                   if (SORTED)
+                     run_overlap(data->run,ovla,tbytes);
+                   else if (LW_file[0] != NULL)
+                     lw_overlap(data->batch,0,ovla,tbytes);
+                   else
+                     Write_Overlap(ofile1,ovla,tbytes);
+                 }
+               for (i = 0; i < novlb; i++)
+                 { ovlb->path = bmatch[i];
+                   ovlb->path.trace = tbuf->trace + (uint64) (ovlb->path.trace);
+                   if (small)
+                     Compress_TraceTo8(ovlb);
+                   if (SORTED)
+                     run_overlap(data->run+MR_two,ovlb,tbytes);
+                   else if (LW_file[0] != NULL)
+                     lw_overlap(data->batch,MR_two,ovlb,tbytes);
+                   else
+                     Write_Overlap(ofile2,ovlb,tbytes);
+                 }
+               ahits += novla;
+               bhits += novlb;
              }
-           for (i = 0; i < novlb; i++)
-             { ovlb->path = bmatch[i];
-               ovlb->path.trace = tbuf->trace + (uint64) (ovlb->path.trace);
-               if (small)
-                 Compress_TraceTo8(ovlb);
-               Write_Overlap(ofile2,ovlb,tbytes);
-             }
-           ahits += novla;
-           bhits += novlb;
-         }
-      }
+          }
+    }
+
+  if (data->batch[0] != NULL)
+    lw_push(data->batch[0]);
+  if (data->batch[1] != NULL)
+    lw_push(data->batch[1]);
+  data->batch[0] = data->batch[1] = NULL;
 
+  if (MG_flip)
+    free(cseq-1);
   free(tbuf->trace);
   free(bmatch);
   free(amatch);
 
-  data->nfilt  = nfilt;
-  data->ncheck = ahits + bhits;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&t1);
 
-  if (MR_two)
-    { rewind(ofile2);
-      fwrite(&bhits,sizeof(int64),1,ofile2);
-      fclose(ofile2);
-    }
-  else
-    ahits += bhits;
-
-  rewind(ofile1);
-  fwrite(&ahits,sizeof(int64),1,ofile1);
-  fclose(ofile1);
+  data->nfilt  += nfilt;
+  data->ahits  += ahits;
+  data->bhits  += bhits;
+  data->chunks += chunks;
+  data->busy   += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
 
   return (NULL);
 }
@@ -1928,6 +2918,287 @@ static void *report_thread(void *arg)
  *
  ********************************************************************************************/
 
+  //  Produce the nhits seeds of the A-reads in [MG_rbeg,MG_rend) with parmm[i].nhits the
+  //    offset of thread i's seeds, sort them, and return them as SeedPairs followed by a
+  //    sentinel.  If work is not NULL it has room for nhits+1 pairs (packed if MG_spack is)
+  //    and serves as the second sort vector, it or the returned vector is freed.
+
+static SeedPair *seed_pairs(Merge_Arg *parmm, Lex_Arg *parmx, int *pairsort,
+                            int64 nhits, SeedPair *work)
+{ THREAD    threads[NTHREADS];
+  SeedPair *khit, *hhit;
+  int64     psize, x;
+  int       i, p;
+
+  if (MG_spack.packed)
+    psize = sizeof(uint64);
+  else
+    psize = sizeof(SeedPair);
+
+  if (work == NULL)
+    hhit = (SeedPair *) Malloc(psize*(nhits+1),"Allocating daligner hit vectors");
+  else
+    hhit = work;
+  khit = (SeedPair *) Malloc(psize*(nhits+1),"Allocating daligner hit vectors");
+  if (hhit == NULL || khit == NULL)
+    exit (1);
+
+  MG_hits = khit;
+
+  lex_plan(3,pairsort,nhits);
+
+  for (i = 0; i < NTHREADS; i++)
+    { parmm[i].kptr = parmx[i].tptr;
+      for (p = 0; p <= (int) FMASK; p++)
+        parmm[i].kptr[p] = 0;
+    }
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(threads+i,NULL,merge_thread,parmm+i);
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(threads[i],NULL);
+
+#ifdef TEST_PAIRS
+  printf("\nSETUP SORT:\n");
+  for (i = 0; i < HOW_MANY && i < nhits; i++)
+    if (MG_spack.packed)
+      printf(" %016llx\n",((uint64 *) khit)[i]);
+    else
+      { SeedPair *c = khit+i;
+        printf(" %5d / %5d / %5d /%5d\n",c->aread,c->bread,c->apos,c->apos-c->diag);
+      }
+#endif
+
+  x = 0;
+  for (i = 0; i < NTHREADS-1; i++)
+    { parmx[i].beg = x;
+      parmx[i].end = x = parmm[i+1].nhits;
+    }
+  parmx[NTHREADS-1].beg = x;
+  parmx[NTHREADS-1].end = nhits;
+
+  work = (SeedPair *) lex_sort(khit,hhit,psize,parmx);
+
+  //  Free the other vector and widen packed pairs in the space of the sorted one
+
+  if (work == khit)
+    free(hhit);
+  else
+    free(khit);
+  khit = work;
+
+  if (MG_spack.packed)
+    { khit = (SeedPair *) Realloc(khit,sizeof(SeedPair)*(nhits+1),"Widening daligner hit vector");
+      if (khit == NULL)
+        exit (1);
+      widen_seeds(khit,nhits);
+    }
+
+  khit[nhits].aread = 0x7fffffff;
+  khit[nhits].bread = 0x7fffffff;
+  khit[nhits].diag  = 0x7fffffff;
+  khit[nhits].apos  = 0;
+
+#ifdef TEST_CSORT
+  printf("\nCROSS SORT %lld:\n",nhits);
+  for (i = 0; i < HOW_MANY && i <= nhits; i++)
+    { SeedPair *c = khit+i;
+      printf(" %5d / %5d / %5d /%5d\n",c->aread,c->bread,c->apos,c->apos-c->diag);
+    }
+#endif
+
+  return (khit);
+}
+
+  //  Find and output the alignments of the nhits sorted seeds in khit with the report threads
+
+static void report_seeds(Report_Arg *parmr, SeedPair *khit, int64 nhits)
+{ int   i;
+#ifndef NOTHREAD
+  THREAD threads[NTHREADS];
+#endif
+
+  MR_hits  = khit;
+  MR_nhits = nhits;
+  MR_next  = 0;
+  MR_chunk = nhits / (NTHREADS*REPORT_CHUNKS);
+  if (MR_chunk < REPORT_MINCHUNK)
+    MR_chunk = REPORT_MINCHUNK;
+
+#ifdef NOTHREAD
+
+  for (i = 0; i < NTHREADS; i++)
+    report_thread(parmr+i);
+
+#else
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(threads+i,NULL,report_thread,parmr+i);
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(threads[i],NULL);
+
+#endif
+}
+
+  //  Sort and write the runs of the report threads (SORTED)
+
+static void *sorted_thread(void *arg)
+{ Report_Arg *data = (Report_Arg *) arg;
+
+  write_run(data->run,data->ofile1);
+  if (MR_two)
+    write_run(data->run+1,data->ofile2);
+  return (NULL);
+}
+
+static void write_sorted(Report_Arg *parmr)
+{ int i;
+#ifndef NOTHREAD
+  THREAD threads[NTHREADS];
+#endif
+
+#ifdef NOTHREAD
+
+  for (i = 0; i < NTHREADS; i++)
+    sorted_thread(parmr+i);
+
+#else
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_create(threads+i,NULL,sorted_thread,parmr+i);
+
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join(threads[i],NULL);
+
+#endif
+}
+
+  //  Streaming: the seeds of one A-read range at a time, using the per-thread, per-A-read hit
+  //    counts of the counting pass to place each thread's seeds.
+
+typedef struct
+  { Merge_Arg *parmm;
+    Lex_Arg   *parmx;
+    int       *pairsort;
+    int        rbeg, rend;
+    int64      nhits;
+    SeedPair  *hits;
+  } Stream_Arg;
+
+static void *stream_thread(void *arg)
+{ Stream_Arg *data  = (Stream_Arg *) arg;
+  Merge_Arg  *parmm = data->parmm;
+  int64       x;
+  int         i, r;
+
+  MG_rbeg = data->rbeg;
+  MG_rend = data->rend;
+
+  x = 0;
+  for (i = 0; i < NTHREADS; i++)
+    { parmm[i].nhits = x;
+      for (r = data->rbeg; r < data->rend; r++)
+        x += parmm[i].acount[r];
+    }
+
+  data->nhits = x;
+  if (x > 0)
+    data->hits = seed_pairs(parmm,data->parmx,data->pairsort,x,NULL);
+  else
+    data->hits = NULL;
+
+  return (NULL);
+}
+
+  //  Report the seeds of the nrange A-read ranges [rcut[k],rcut[k+1]) in turn, producing the
+  //    seeds of range k+1 while those of range k are being reported.
+
+static void stream_seeds(Merge_Arg *parmm, Lex_Arg *parmx, int *pairsort,
+                         Report_Arg *parmr, int *rcut, int nrange)
+{ Stream_Arg next;
+  SeedPair  *hits;
+  int64      nhits;
+  int        k;
+#ifndef NOTHREAD
+  THREAD     producer;
+#endif
+
+  next.parmm    = parmm;
+  next.parmx    = parmx;
+  next.pairsort = pairsort;
+  next.rbeg     = rcut[0];
+  next.rend     = rcut[1];
+  stream_thread(&next);
+
+  for (k = 0; k < nrange; k++)
+    { hits  = next.hits;
+      nhits = next.nhits;
+
+#ifndef NOTHREAD
+      if (k+1 < nrange)
+        { next.rbeg = rcut[k+1];
+          next.rend = rcut[k+2];
+          pthread_create(&producer,NULL,stream_thread,&next);
+        }
+#endif
+
+      if (nhits > 0)
+        { report_seeds(parmr,hits,nhits);
+          free(hits);
+        }
+
+      if (k+1 < nrange)
+#ifdef NOTHREAD
+        { next.rbeg = rcut[k+1];
+          next.rend = rcut[k+2];
+          stream_thread(&next);
+        }
+#else
+        pthread_join(producer,NULL);
+#endif
+    }
+}
+
+  //  Open the single output files (see filter.h), their counts are set on closing.
+
+void Open_Match_Output(char *aname, char *bname, Align_Spec *aspec)
+{ int   tspace = Trace_Spacing(aspec);
+  int   i;
+
+  LW_file[0] = Fopen(Catenate(aname,".",bname,".las"),"w");
+  if (LW_file[0] == NULL)
+    exit (1);
+  if (aname != bname && SYMMETRIC)
+    { LW_file[1] = Fopen(Catenate(bname,".",aname,".las"),"w");
+      if (LW_file[1] == NULL)
+        exit (1);
+    }
+  else
+    LW_file[1] = NULL;
+
+  for (i = 0; i < 2; i++)
+    { LW_novl[i] = 0;
+      if (LW_file[i] != NULL)
+        { fwrite(LW_novl+i,sizeof(int64),1,LW_file[i]);
+          fwrite(&tspace,sizeof(int),1,LW_file[i]);
+        }
+    }
+}
+
+void Close_Match_Output()
+{ int i;
+
+  for (i = 0; i < 2; i++)
+    if (LW_file[i] != NULL)
+      { rewind(LW_file[i]);
+        fwrite(LW_novl+i,sizeof(int64),1,LW_file[i]);
+        fclose(LW_file[i]);
+        LW_file[i] = NULL;
+      }
+}
+
 void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
                   void *vasort, int alen, void *vbsort, int blen,
                   int comp, Align_Spec *aspec)
@@ -1935,53 +3206,84 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
   Merge_Arg  parmm[NTHREADS];
   Lex_Arg    parmx[NTHREADS];
   Report_Arg parmr[NTHREADS];
-  int        pairsort[16];
+  int        pairsort[9];
 
-  SeedPair *khit, *hhit;
-  SeedPair *work1, *work2;
+  SeedPair *khit;
   int64     nhits;
   int64     nfilt, ncheck;
+  int       nrange, *rcut;
 
   KmerPos  *asort, *bsort;
   int64     atot, btot;
+  int       bown, bkeep;
+  int       asize, bsize, psize;
 
   asort = (KmerPos *) vasort;
   bsort = (KmerPos *) vbsort;
+  bown  = (comp != 0 && asort != bsort && ! (comp == 2 && aname == bname));
+  bkeep = (! bown || kmer_mapping(bsort) != NULL);   //  Cannot recycle bsort space
 
   atot = ablock->totlen;
   btot = bblock->totlen;
 
-  MR_tspace = Trace_Spacing(aspec);
+  asize = kmer_packing(ablock,&MG_apack);
+  bsize = kmer_packing(bblock,&MG_bpack);
 
-  { int64 powr;
-    int   i, nbyte;
+  MR_tspace = Trace_Spacing(aspec);
 
-    for (i = 0; i < NTHREADS; i++)
-      parmx[i].sptr = (int64 *) alloca(NTHREADS*BPOWR*sizeof(int64));
-
-    for (i = 0; i < 16; i++)
-      pairsort[i] = 0;
-
-    powr = 1;
-    for (nbyte = 0; powr < ablock->maxlen; nbyte += 1)
-      powr <<= 8;
-    for (i = 4; i < 4+nbyte; i++)
-      pairsort[i] = 1;
-
-    powr = 1;
-    for (nbyte = 0; powr < ablock->nreads; nbyte += 1)
-      powr <<= 8;
-    for (i = 8; i < 8+nbyte; i++)
-      pairsort[i] = 1;
-
-    powr = 1;
-    for (nbyte = 0; powr < bblock->nreads; nbyte += 1)
-      powr <<= 8;
-    for (i = 12; i < 12+nbyte; i++)
-      pairsort[i] = 1;
+  { int nbits, abits, bbits, dbits;
+
+    pairsort[0] = 0;             //  Sort on (bread,aread,apos) = (p2>>32,p2,p1>>32)
+    pairsort[1] = 32;
+    for (nbits = 0; (0x1ll << nbits) < ablock->maxlen; nbits += 1)
+      ;
+    pairsort[2] = nbits;
+
+    pairsort[3] = 1;
+    pairsort[4] = 0;
+    for (abits = 0; (0x1ll << abits) < ablock->nreads; abits += 1)
+      ;
+    pairsort[5] = abits;
+
+    pairsort[6] = 1;
+    pairsort[7] = 32;
+    for (bbits = 0; (0x1ll << bbits) < bblock->nreads; bbits += 1)
+      ;
+    pairsort[8] = bbits;
+
+    for (dbits = 0; (0x1ll << dbits) < ablock->maxlen + bblock->maxlen; dbits += 1)
+      ;
+
+    MG_spack.packed = (dbits + nbits + abits + bbits <= 64);
+    if (MG_spack.packed)
+      { MG_spack.pshift = dbits;
+        MG_spack.ashift = dbits + nbits;
+        MG_spack.bshift = dbits + nbits + abits;
+        MG_spack.doff   = bblock->maxlen;
+        MG_spack.dmask  = (0x1llu << dbits) - 1;
+        MG_spack.pmask  = (0x1llu << nbits) - 1;
+        MG_spack.amask  = (0x1llu << abits) - 1;
+
+        pairsort[0] = pairsort[3] = pairsort[6] = 0;     //  Same key, in the packed word
+        pairsort[1] = MG_spack.pshift;
+        pairsort[4] = MG_spack.ashift;
+        pairsort[7] = MG_spack.bshift;
+        psize = sizeof(uint64);
+      }
+    else
+      psize = sizeof(SeedPair);
   }
 
   nfilt = ncheck = nhits = 0;
+  nrange = 0;          //  > 0 if the seeds are streamed over the A-read ranges in rcut
+  rcut   = NULL;
+  khit   = NULL;
+
+  { int i;
+
+    for (i = 0; i < NTHREADS; i++)
+      parmm[i].acount = NULL;
+  }
 
   if (VERBOSE)
     { if (comp)
@@ -2000,18 +3302,24 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
     MG_alist = asort;
     MG_blist = bsort;
     MG_self  = (aname == bname);
-    MG_comp  = comp;
+    MG_comp  = (comp != 0);
+    MG_flip  = (comp == 2);
+    MG_aread = ablock->reads;
+    MG_bread = bblock->reads;
+    MG_rbeg  = 0;
+    MG_rend  = ablock->nreads;
 
     parmm[0].abeg = parmm[0].bbeg = 0;
     for (i = 1; i < NTHREADS; i++)
-      { p = (int) ((((int64) alen) * i) >> NSHIFT);
+      { p = (int) ((((int64) alen) * i) / NTHREADS);
         if (p > 0)
-          { c = asort[p-1].code;
-            while (asort[p].code == c)
+          { c = KCODE(&MG_apack,asort,p-1);
+            while (KCODE(&MG_apack,asort,p) == c)
               p += 1;
           }
         parmm[i].abeg = parmm[i-1].aend = p;
-        parmm[i].bbeg = parmm[i-1].bend = find_tuple(asort[p].code,bsort,blen);
+        parmm[i].bbeg = parmm[i-1].bend =
+                            find_tuple(KCODE(&MG_apack,asort,p),&MG_bpack,bsort,blen);
       }
     parmm[NTHREADS-1].aend = alen;
     parmm[NTHREADS-1].bend = blen;
@@ -2020,6 +3328,16 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
       for (j = 0; j < MAXGRAM; j++)
         parmm[i].hitgram[j] = 0;
 
+    if (STREAM && MEM_LIMIT > 0)
+      for (i = 0; i < NTHREADS; i++)
+        { parmm[i].acount = (int64 *) Malloc(sizeof(int64)*ablock->nreads,
+                                             "Allocating A-read hit counts");
+          if (parmm[i].acount == NULL)
+            exit (1);
+          for (j = 0; j < ablock->nreads; j++)
+            parmm[i].acount[j] = 0;
+        }
+
     for (i = 0; i < NTHREADS; i++)
       pthread_create(threads+i,NULL,count_thread,parmm+i);
 
@@ -2030,7 +3348,8 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
       printf("\n");
     if (MEM_LIMIT > 0)
       { int64 histo[MAXGRAM];
-        int64 tom, avail;
+        int64 tom, avail, total;
+        int64 aspace, bspace;
 
         for (j = 0; j < MAXGRAM; j++)
           histo[j] = parmm[0].hitgram[j];
@@ -2038,20 +3357,82 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
           for (j = 0; j < MAXGRAM; j++)
             histo[j] += parmm[i].hitgram[j];
 
-        avail = (int64) (MEM_LIMIT - (sizeof_DB(ablock) + sizeof_DB(bblock))) / sizeof(Double);
-        if (asort == bsort || avail > alen + 2*blen)
-          avail = (avail - alen) / 2;
+        total = 0;
+        for (i = 0; i < NTHREADS; i++)
+          total += parmm[i].nhits;
+
+        aspace = ((int64) alen) * asize;
+        bspace = ((int64) blen) * bsize;
+        avail  = (int64) (MEM_LIMIT - (sizeof_DB(ablock) + sizeof_DB(bblock)));
+        if (bkeep)
+          avail = (avail - (aspace + (asort == bsort ? 0 : bspace))) / (2*psize);
+        else if (avail > aspace + 2*bspace)
+          avail = (avail - aspace) / (2*psize);
         else
-          avail = avail - (alen + blen);
+          avail = (avail - (aspace + bspace)) / psize;
         avail *= .98;
 
-        tom = 0;
-        for (j = 0; j < MAXGRAM; j++)
-          { tom += j*histo[j];
-            if (tom > avail)
-              break;
+        //  If streaming and not all the hits fit, cut the A-reads into ranges whose hits fit
+        //    twice over (one being reported as the next is generated), keeping all of them.
+
+        if (STREAM && total > avail)
+          { int64 budget, most, x;
+            int   r;
+
+            budget = (int64) (MEM_LIMIT - (sizeof_DB(ablock) + sizeof_DB(bblock)));
+            budget = (budget - (aspace + (asort == bsort ? 0 : bspace)))
+                   / ((int64) (sizeof(SeedPair) + 2*psize));
+            budget *= .98;
+
+            if (budget > 0)
+              { limit = INT32_MAX;
+                rcut  = (int *) Malloc(sizeof(int)*(ablock->nreads+1),
+                                       "Allocating A-read ranges");
+                if (rcut == NULL)
+                  exit (1);
+                rcut[0] = 0;
+                tom  = 0;
+                most = 0;
+                for (r = 0; r < ablock->nreads; r++)
+                  { x = 0;
+                    for (i = 0; i < NTHREADS; i++)
+                      x += parmm[i].acount[r];
+                    if (tom > 0 && tom + x > budget)
+                      { rcut[++nrange] = r;
+                        if (tom > most)
+                          most = tom;
+                        tom = 0;
+                      }
+                    tom += x;
+                  }
+                rcut[++nrange] = ablock->nreads;
+                if (tom > most)
+                  most = tom;
+              }
+            else
+              limit = 0;
+
+            if (VERBOSE && limit > 1)
+              { printf("   Hit count = ");
+                Print_Number(total,0,stdout);
+                printf("\n   Streaming over %d A-read ranges of at most ",nrange);
+                Print_Number(most,0,stdout);
+                printf(" hits\n   Highwater of %.2fGb space\n",
+                       (1. * aspace + (asort == bsort ? 0. : 1. * bspace)
+                        + (sizeof(SeedPair) + 2.*psize) * most) / 0x40000000ll);
+                fflush(stdout);
+              }
+          }
+
+        else
+          { tom = 0;
+            for (j = 0; j < MAXGRAM; j++)
+              { tom += j*histo[j];
+                if (tom > avail)
+                  break;
+              }
+            limit = j;
           }
-        limit = j;
 
         if (limit <= 1)
           { fprintf(stderr,"\nError: Insufficient ");
@@ -2076,134 +3457,84 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
               }
             fflush(stderr);
           }
-        if (VERBOSE)
-          { printf("   Capping mutual k-mer matches over %d (effectively -t%d)\n",
-                   limit,(int) sqrt(1.*limit));
-            fflush(stdout);
+
+        if (nrange > 0)
+          { for (i = 0; i < NTHREADS; i++)
+              parmm[i].limit = limit;
+            nhits = total;
           }
+        else
+          { if (VERBOSE)
+              { printf("   Capping mutual k-mer matches over %d (effectively -t%d)\n",
+                       limit,(int) sqrt(1.*limit));
+                fflush(stdout);
+              }
 
-        for (i = 0; i < NTHREADS; i++)
-          { parmm[i].nhits = 0;
-            for (j = 1; j < limit; j++)
-              parmm[i].nhits += j * parmm[i].hitgram[j];
-            parmm[i].limit = limit;
+            for (i = 0; i < NTHREADS; i++)
+              { parmm[i].nhits = 0;
+                for (j = 1; j < limit; j++)
+                  parmm[i].nhits += j * parmm[i].hitgram[j];
+                parmm[i].limit = limit;
+              }
           }
       }
     else
       for (i = 0; i < NTHREADS; i++)
         parmm[i].limit = INT32_MAX;
 
-    nhits = parmm[0].nhits;
-    for (i = 1; i < NTHREADS; i++)
-      parmm[i].nhits = nhits += parmm[i].nhits;
+    if (nrange == 0)
+      { SeedPair *work;
 
-    if (VERBOSE)
-      { printf("   Hit count = ");
-        Print_Number(nhits,0,stdout);
-        if (asort == bsort || nhits >= blen)
-          printf("\n   Highwater of %.2fGb space\n",
-                       (1. * (alen + 2*nhits)) / 67108864);
-        else
-          printf("\n   Highwater of %.2fGb space\n",
-                       (1. * (alen + blen + nhits)) / 67108864);
-        fflush(stdout);
-      }
-
-    if (nhits == 0)
-      goto zerowork;
-
-    if (asort == bsort)
-      hhit = work1 = (SeedPair *) Malloc(sizeof(SeedPair)*(nhits+1),
-                                         "Allocating daligner hit vectors");
-    else
-      { if (nhits >= blen)
-          bsort = (KmerPos *) Realloc(bsort,sizeof(SeedPair)*(nhits+1),
-                                       "Reallocating daligner sort vectors");
-        hhit = work1 = (SeedPair *) bsort;
-      }
-    khit = work2 = (SeedPair *) Malloc(sizeof(SeedPair)*(nhits+1),
-                                        "Allocating daligner hit vectors");
-    if (hhit == NULL || khit == NULL || bsort == NULL)
-      exit (1);
-
-    MG_blist = bsort;
-    MG_hits  = khit;
-
-    for (i = NTHREADS-1; i > 0; i--)
-      parmm[i].nhits = parmm[i-1].nhits;
-    parmm[0].nhits = 0;
-
-    for (i = 0; i < NTHREADS; i++)
-      { parmm[i].kptr = parmx[i].tptr;
-        for (p = 0; p < BPOWR; p++)
-          parmm[i].kptr[p] = 0;
-      }
-
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,merge_thread,parmm+i);
-
-    for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
-
-#ifdef TEST_PAIRS
-    printf("\nSETUP SORT:\n");
-    for (i = 0; i < HOW_MANY && i < nhits; i++)
-      { SeedPair *c = khit+i;
-        printf(" %5d / %5d / %5d /%5d\n",c->aread,c->bread,c->apos,c->apos-c->diag);
-      }
-#endif
-  }
+        nhits = parmm[0].nhits;
+        for (i = 1; i < NTHREADS; i++)
+          parmm[i].nhits = nhits += parmm[i].nhits;
 
-  { int   i;
-    int64 x;
+        if (VERBOSE)
+          { printf("   Hit count = ");
+            Print_Number(nhits,0,stdout);
+            if (bkeep || psize*nhits >= ((int64) bsize)*blen)
+              printf("\n   Highwater of %.2fGb space\n",
+                           (1. * alen*asize + 2. * psize*nhits) / 0x40000000ll);
+            else
+              printf("\n   Highwater of %.2fGb space\n",
+                           (1. * alen*asize + 1. * blen*bsize + 1. * psize*nhits) / 0x40000000ll);
+            fflush(stdout);
+          }
 
-    x = 0;
-    for (i = 0; i < NTHREADS-1; i++)
-      { parmx[i].beg = x;
-        parmx[i].end = x = parmm[i+1].nhits;
-      }
-    parmx[NTHREADS-1].beg = x;
-    parmx[NTHREADS-1].end = nhits;
+        if (nhits == 0)
+          goto zerowork;
 
-    khit = (SeedPair *) lex_sort(pairsort,(Double *) khit,(Double *) hhit,parmx);
+        if (bkeep)
+          work = NULL;
+        else
+          { if (psize*(nhits+1) > ((int64) bsize)*(blen+2))
+              { bsort = (KmerPos *) Realloc(bsort,psize*(nhits+1),
+                                            "Reallocating daligner sort vectors");
+                if (bsort == NULL)
+                  exit (1);
+              }
+            work = (SeedPair *) bsort;
+            bown = 0;
+          }
+        MG_blist = bsort;
 
-    khit[nhits].aread = 0x7fffffff;
-    khit[nhits].bread = 0x7fffffff;
-    khit[nhits].diag  = 0x7fffffff;
-    khit[nhits].apos  = 0;
+        for (i = NTHREADS-1; i > 0; i--)
+          parmm[i].nhits = parmm[i-1].nhits;
+        parmm[0].nhits = 0;
 
-#ifdef TEST_CSORT
-    printf("\nCROSS SORT %lld:\n",nhits);
-    for (i = 0; i < HOW_MANY && i <= nhits; i++)
-      { SeedPair *c = khit+i;
-        printf(" %5d / %5d / %5d /%5d\n",c->aread,c->bread,c->apos,c->apos-c->diag);
+        khit = seed_pairs(parmm,parmx,pairsort,nhits,work);
       }
-#endif
   }
 
   { int    i, w;
-    int64  p;
-    int    d;
     int   *counters;
+    THREAD writer;
 
     MR_ablock = ablock;
     MR_bblock = bblock;
-    MR_hits   = khit;
     MR_two    = ! MG_self && SYMMETRIC;
     MR_spec   = aspec;
 
-    parmr[0].beg = 0;
-    for (i = 1; i < NTHREADS; i++)
-      { p = (nhits * i) >> NSHIFT;
-        if (p > 0)
-          { d = khit[p-1].bread;
-            while ((khit[p].bread) == d)
-              p += 1;
-          }
-        parmr[i].beg = parmr[i-1].end = p;
-      }
-    parmr[NTHREADS-1].end = nhits;
-
     w = ((ablock->maxlen >> Binshift) - ((-bblock->maxlen) >> Binshift)) + 1;
     counters = (int *) Malloc(NTHREADS*3*w*sizeof(int),"Allocating diagonal buckets");
     if (counters == NULL)
@@ -2219,11 +3550,25 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
         parmr[i].lastp = parmr[i].score + w;
         parmr[i].lasta = parmr[i].lastp + w;
         parmr[i].work  = New_Work_Data();
+        parmr[i].nfilt = 0;
+        parmr[i].ahits = 0;
+        parmr[i].bhits = 0;
+        parmr[i].busy   = 0.;
+        parmr[i].chunks = 0;
+
+        parmr[i].batch[0] = parmr[i].batch[1] = NULL;
+        memset(parmr[i].run,0,sizeof(parmr[i].run));
+        if (LW_file[0] != NULL)
+          { parmr[i].ofile1 = parmr[i].ofile2 = NULL;
+            continue;
+          }
 
         parmr[i].ofile1 =
              Fopen(Catenate(aname,".",bname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
         if (parmr[i].ofile1 == NULL)
           exit (1);
+        fwrite(&parmr[i].ahits,sizeof(int64),1,parmr[i].ofile1);
+        fwrite(&MR_tspace,sizeof(int),1,parmr[i].ofile1);
         if (MG_self)
           parmr[i].ofile2 = parmr[i].ofile1;
         else if (SYMMETRIC)
@@ -2231,37 +3576,68 @@ void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
                 Fopen(Catenate(bname,".",aname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
             if (parmr[i].ofile2 == NULL)
               exit (1);
+            fwrite(&parmr[i].bhits,sizeof(int64),1,parmr[i].ofile2);
+            fwrite(&MR_tspace,sizeof(int),1,parmr[i].ofile2);
           }
       }
 
-#ifdef NOTHREAD
+    if (LW_file[0] != NULL)
+      { LW_done = 0;
+        pthread_create(&writer,NULL,writer_thread,NULL);
+      }
 
-    for (i = 0; i < NTHREADS; i++)
-      report_thread(parmr+i);
+    if (nrange > 0)
+      stream_seeds(parmm,parmx,pairsort,parmr,rcut,nrange);
+    else
+      { report_seeds(parmr,khit,nhits);
+        free(khit);
+      }
 
-#else
+    if (LW_file[0] != NULL)
+      { __atomic_store_n(&LW_done,1,__ATOMIC_RELEASE);
+        pthread_join(writer,NULL);
+      }
+    if (SORTED)
+      write_sorted(parmr);
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,report_thread,parmr+i);
+    //  Set the overlap counts in the headers of the thread files
 
     for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
+      { nfilt  += parmr[i].nfilt;
+        ncheck += parmr[i].ahits + parmr[i].bhits;
 
-#endif
+        if (LW_file[0] != NULL)
+          continue;
+
+        if (MR_two)
+          { rewind(parmr[i].ofile2);
+            fwrite(&parmr[i].bhits,sizeof(int64),1,parmr[i].ofile2);
+            fclose(parmr[i].ofile2);
+          }
+        else
+          parmr[i].ahits += parmr[i].bhits;
+
+        rewind(parmr[i].ofile1);
+        fwrite(&parmr[i].ahits,sizeof(int64),1,parmr[i].ofile1);
+        fclose(parmr[i].ofile1);
+      }
 
     if (VERBOSE)
-      for (i = 0; i < NTHREADS; i++)
-        { nfilt  += parmr[i].nfilt;
-          ncheck += parmr[i].ncheck;
-        }
+      { printf("\n     Report threads busy (CPU sec / chunks):");
+        for (i = 0; i < NTHREADS; i++)
+          { if (i % 4 == 0)
+              printf("\n       ");
+            printf(" %7.2f /%6lld",parmr[i].busy,parmr[i].chunks);
+          }
+        printf("\n");
+        fflush(stdout);
+      }
 
     for (i = 0; i < NTHREADS; i++)
       Free_Work_Data(parmr[i].work);
     free(counters);
   }
 
-  free(work2);
-  free(work1);
   goto epilogue;
 
 zerowork:
@@ -2269,22 +3645,33 @@ zerowork:
     int   i;
 
     nhits  = 0;
-    for (i = 0; i < NTHREADS; i++)
-      { ofile = Fopen(Catenate(aname,".",bname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
-        fwrite(&nhits,sizeof(int64),1,ofile);
-        fwrite(&MR_tspace,sizeof(int),1,ofile);
-        fclose(ofile);
-        if (! MG_self && SYMMETRIC)
-          { ofile = Fopen(Catenate(bname,".",aname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
-            fwrite(&nhits,sizeof(int64),1,ofile);
-            fwrite(&MR_tspace,sizeof(int),1,ofile);
-            fclose(ofile);
-          }
-      }
+    if (LW_file[0] == NULL)
+      for (i = 0; i < NTHREADS; i++)
+        { ofile = Fopen(Catenate(aname,".",bname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
+          fwrite(&nhits,sizeof(int64),1,ofile);
+          fwrite(&MR_tspace,sizeof(int),1,ofile);
+          fclose(ofile);
+          if (! MG_self && SYMMETRIC)
+            { ofile = Fopen(Catenate(bname,".",aname,Numbered_Suffix((comp?".C":".N"),i,".las")),"w");
+              fwrite(&nhits,sizeof(int64),1,ofile);
+              fwrite(&MR_tspace,sizeof(int),1,ofile);
+              fclose(ofile);
+            }
+        }
   }
 
 epilogue:
 
+  if (bown)
+    Free_Kmer_Index(bsort);
+
+  { int i;
+
+    for (i = 0; i < NTHREADS; i++)
+      free(parmm[i].acount);
+    free(rcut);
+  }
+
   if (VERBOSE)
     { int width;
 
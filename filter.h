@@ -20,6 +20,8 @@ extern int    MINOVER;
 extern int    HGAP_MIN;
 extern int    SYMMETRIC;
 extern int    IDENTITY;
+extern int    STREAM;
+extern int    SORTED;
 
 extern uint64 MEM_LIMIT;
 extern uint64 MEM_PHYSICAL;
@@ -28,8 +30,32 @@ int Set_Filter_Params(int kmer, int binshift, int suppress, int hitmin, int nthr
 
 void *Sort_Kmers(HITS_DB *block, int *len);
 
+  //  A sorted k-mer list can be saved to 'path' and later mapped back read-only, provided
+  //    the block, mask tracks, and filter parameters are the same.  Load_Kmer_Index returns
+  //    NULL if there is no such up-to-date index.  Free_Kmer_Index releases an index whether
+  //    sorted or mapped.
+
+int   Save_Kmer_Index(char *path, HITS_DB *block, char *masks, void *index, int len);
+void *Load_Kmer_Index(char *path, HITS_DB *block, char *masks, int *len);
+void  Free_Kmer_Index(void *index);
+
+  //  Compare A to B (comp = 0) or to c(B) (comp != 0), where the tables index:
+  //      comp = 0:  A and B
+  //      comp = 1:  A and c(B), bblock having been complemented
+  //      comp = 2:  c(A) and B, bblock is *not* complemented and the seeds are mapped to A x c(B)
+  //    Match_Filter frees btable when comp != 0, unless it is also an index of A.  In the
+  //    unbiased case comp = 2 gives exactly the same result as comp = 1.
+
 void Match_Filter(char *aname, HITS_DB *ablock, char *bname, HITS_DB *bblock,
                   void *atable, int alen, void *btable, int blen,
                   int comp, Align_Spec *asettings);
 
+  //  Between Open_Match_Output and Close_Match_Output, the overlaps of all calls to Match_Filter
+  //    with the same aname and bname go to the single file aname.bname.las (and bname.aname.las
+  //    when the blocks differ and SYMMETRIC) through a writer thread, instead of to the
+  //    per-thread, per-orientation files aname.bname.[CN]<thread>.las.
+
+void Open_Match_Output(char *aname, char *bname, Align_Spec *asettings);
+void Close_Match_Output();
+
 #endif
@@ -0,0 +1,886 @@
+/*******************************************************************************************
+ *
+ *  Reader for .las files shared by the LA-tools, see las.h for the interface.
+ *
+ ********************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "DB.h"
+#include "align.h"
+#include "las.h"
+
+#define LAS_BUFFER   64000000ll   //  Size of the stream buffer when a file cannot be mapped
+#define LAS_RELEASE 256000000ll   //  Release the pages behind the cursor in chunks of this size
+
+  //  The records are visited once in order, and the # of bytes a record occupies in memory
+
+#define ONE_PASS(mode)   ((mode) == LAS_SEQUENTIAL || (mode) == LAS_HEADERS)
+#define STRIDE(las,rec)  ((las)->compact ? LAS_RECORD : LAS_SPAN(rec,(las)->tbytes))
+
+/*******************************************************************************************
+ *
+ *  VERSION 2 CODEC
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { int   aread;              //  aread of the first record of a block,
+    int64 recno;              //    its ordinal in the file,
+    int64 offset;             //    and the file offset of the block header
+  } Las2_Index;
+
+#define ZIG(x)  ((((uint64) (x)) << 1) ^ ((uint64) (((int64) (x)) >> 63)))
+#define ZAG(u)  ((int64) (((u) >> 1) ^ (-((u) & 0x1))))
+
+static inline uint8 *put_varint(uint8 *p, uint64 v)
+{ while (v >= 0x80)
+    { *p++ = (uint8) (v | 0x80);
+      v >>= 7;
+    }
+  *p++ = (uint8) v;
+  return (p);
+}
+
+  //  Decode the varint at p into *v, returning the byte after it or NULL if it runs past e
+
+static inline uint8 *get_varint(uint8 *p, uint8 *e, uint64 *v)
+{ uint64 x;
+  int    s;
+
+  x = 0;
+  for (s = 0; p < e && s < 64; s += 7)
+    { x |= ((uint64) (*p & 0x7f)) << s;
+      if ((*p++ & 0x80) == 0)
+        { *v = x;
+          return (p);
+        }
+    }
+  return (NULL);
+}
+
+#define GET(v)                            \
+  if ((p = get_varint(p,e,&(v))) == NULL) \
+    return (1);
+
+  //  Decode the nrec records of the block in las->cbuf[0..size) to the raw bytes at las->top,
+  //    return 1 if the block is not well-formed.  If las->compact only the record headers
+  //    are output, the trace values are stepped over without being decoded.
+
+static int decode_las2(Las_File *las, int nrec, int64 raw, int64 size)
+{ uint8      *p, *e, *o, *oe;
+  Las_Record *r;
+  uint64      u, v;
+  int64       alast, blast, x, tleft;
+  int         tspace, tbytes;
+  int         n, k, tmax;
+
+  p  = las->cbuf;
+  e  = p + size;
+  o  = las->top;
+  if (las->compact)
+    oe = o + nrec*LAS_RECORD;
+  else
+    oe = o + raw;
+  tleft = raw - nrec*LAS_RECORD;
+
+  tspace = las->tspace;
+  tbytes = las->tbytes;
+  if (tbytes == 1)
+    tmax = 0xff;
+  else
+    tmax = 0xffff;
+
+  alast = blast = 0;
+  for (n = 0; n < nrec; n++)
+    { if (o + LAS_RECORD > oe)
+        return (1);
+      r = (Las_Record *) o;
+      memset(o,0,LAS_RECORD);
+
+      GET(u)
+      r->aread = (int) (alast + ZAG(u));
+      GET(u)
+      if (r->aread == alast)
+        r->bread = (int) (blast + ZAG(u));
+      else
+        r->bread = (int) ZAG(u);
+      GET(u)
+      r->flags = (uint32) u;
+      GET(u)
+      r->abpos = (int) ZAG(u);
+      GET(u)
+      r->aepos = (int) (r->abpos + ZAG(u));
+      GET(u)
+      r->bbpos = (int) ZAG(u);
+      GET(u)
+      r->bepos = (int) (r->bbpos + ZAG(u));
+      GET(u)
+      r->diffs = (int) ZAG(u);
+      GET(u)
+      if (u > (uint64) tleft / tbytes)
+        return (1);
+      r->tlen = (int) u;
+      tleft  -= r->tlen * (int64) tbytes;
+
+      o += LAS_RECORD;
+      if (las->compact)
+        { for (k = 0; k < r->tlen; k++)
+            { while (p < e && (*p & 0x80) != 0)
+                p += 1;
+              if (p++ >= e)
+                return (1);
+            }
+          alast = r->aread;
+          blast = r->bread;
+          continue;
+        }
+      for (k = 0; k < r->tlen; k++)
+        { GET(v)
+          if (k & 0x1)
+            x = tspace + ZAG(v);
+          else
+            x = (int64) v;
+          if (x < 0 || x > tmax)
+            return (1);
+          if (tbytes == 1)
+            *o++ = (uint8) x;
+          else
+            { *((uint16 *) o) = (uint16) x;
+              o += sizeof(uint16);
+            }
+        }
+
+      alast = r->aread;
+      blast = r->bread;
+    }
+
+  return (p != e || o != oe || tleft != 0);
+}
+
+  //  Decode the next block of a version 2 file after the bytes not yet delivered, growing
+  //    the buffer if need be.  Return 0 if there are no more blocks.
+
+static int refill_las2(Las_File *las)
+{ int    nrec;
+  int64  raw, out, size, remains;
+
+  if (las->stream == NULL || las->ndec >= las->novl)
+    return (0);
+
+  if (fread(&nrec,sizeof(int),1,las->stream) != 1 ||
+      fread(&raw,sizeof(int64),1,las->stream) != 1 ||
+      fread(&size,sizeof(int64),1,las->stream) != 1)
+    return (0);
+  if (nrec <= 0 || raw < nrec*LAS_RECORD || size < 0)
+    goto corrupt;
+  if (las->compact)
+    out = nrec*LAS_RECORD;
+  else
+    out = raw;
+
+  remains = las->top - las->ptr;
+  if (remains + out > las->bsize)
+    { uint8 *buf;
+      int64  bsize;
+
+      bsize = 2*las->bsize;
+      if (bsize < remains + out)
+        bsize = remains + out;
+      buf = (uint8 *) Malloc(bsize,"Enlarging .las decode buffer");
+      if (buf == NULL)
+        EXIT(0);
+      if (remains > 0)
+        memcpy(buf,las->ptr,remains);
+      free(las->data);
+      las->data  = buf;
+      las->bsize = bsize;
+    }
+  else if (remains > 0 && las->ptr > las->data)
+    memmove(las->data,las->ptr,remains);
+  las->ptr = las->data;
+  las->top = las->data + remains;
+
+  if (size > las->csize)
+    { las->csize = 1.2*size + 4096;
+      las->cbuf  = (uint8 *) Realloc(las->cbuf,las->csize,"Enlarging .las block buffer");
+      if (las->cbuf == NULL)
+        EXIT(0);
+    }
+  if (fread(las->cbuf,1,size,las->stream) != (size_t) size)
+    return (0);
+
+  if (decode_las2(las,nrec,raw,size))
+    goto corrupt;
+  las->top  += out;
+  las->ndec += nrec;
+  return (1);
+
+corrupt:
+  EPRINTF(EPLACE,"%s: Block %lld.. of %s is corrupted\n",Prog_Name,las->ndec+1,las->name);
+  EXIT(0);
+}
+
+  //  Move the unread bytes to the front of the stream buffer and fill the rest of it, making
+  //    the buffer bigger if a record of 'need' bytes does not fit.
+
+static int refill_las(Las_File *las, int64 need)
+{ int64 remains;
+
+  if (las->version == 2)
+    return (refill_las2(las));
+  if (las->mapped || las->stream == NULL || feof(las->stream))
+    return (0);
+
+  remains = las->top - las->ptr;
+  if (need > las->bsize)
+    { uint8 *buf;
+
+      buf = (uint8 *) Malloc(need,"Enlarging .las stream buffer");
+      if (buf == NULL)
+        EXIT(1);
+      if (remains > 0)
+        memcpy(buf,las->ptr,remains);
+      free(las->data);
+      las->data  = buf;
+      las->bsize = need;
+    }
+  else if (remains > 0)
+    memmove(las->data,las->ptr,remains);
+  las->ptr  = las->data;
+  las->top  = las->data + remains;
+  las->top += fread(las->top,1,las->bsize-remains,las->stream);
+  if (ferror(las->stream))
+    { EPRINTF(EPLACE,"%s: System error, read of %s failed!\n",Prog_Name,las->name);
+      EXIT(1);
+    }
+  return (1);
+}
+
+  //  Once all the records are in memory the file need not stay open
+
+static void release_stream(Las_File *las)
+{ if (las->stream != stdin)
+    { fclose(las->stream);
+      las->stream = NULL;
+    }
+}
+
+  //  The index of the version 1 file "<dir>/<root>.las" is "<dir>/.<root>.las.idx", open
+  //    it if it exists and is no older than the file
+
+static FILE *open_index(Las_File *las)
+{ struct stat info, iinfo;
+  char       *name, *s;
+  FILE       *index;
+
+  name = (char *) Malloc(strlen(las->name)+6,"Allocating .las index name");
+  if (name == NULL)
+    return (NULL);
+  s = rindex(las->name,'/');
+  if (s == NULL)
+    sprintf(name,".%s.idx",las->name);
+  else
+    sprintf(name,"%.*s/.%s.idx",(int) (s-las->name),las->name,s+1);
+
+  index = NULL;
+  if (stat(las->name,&info) == 0 && stat(name,&iinfo) == 0 && iinfo.st_mtime >= info.st_mtime)
+    index = fopen(name,"r");
+  free(name);
+  return (index);
+}
+
+  //  Read the statistics at the head of the index of a version 1 file, provided the offset
+  //    of the end of its last pile is the size of the file
+
+static void read_stats(Las_File *las)
+{ FILE       *index;
+  struct stat info;
+  int64       stats[4], last;
+
+  las->omax = las->ttot = las->smax = las->tmax = -1;
+  if (las->version != 1 || las->stream == stdin)
+    return;
+  index = open_index(las);
+  if (index == NULL)
+    return;
+  if (fread(stats,sizeof(int64),4,index) == 4 &&
+      fseeko(index,-((off_t) sizeof(int64)),SEEK_END) == 0 &&
+      fread(&last,sizeof(int64),1,index) == 1 &&
+      fstat(fileno(las->stream),&info) == 0 && last == (int64) info.st_size)
+    { las->omax = stats[0];
+      las->ttot = stats[1];
+      las->smax = stats[2];
+      las->tmax = stats[3];
+    }
+  fclose(index);
+}
+
+Las_File *Open_Las(char *path, int mode)
+{ Las_File   *las;
+  FILE       *input;
+  struct stat info;
+  off_t       start;
+
+  las = (Las_File *) Malloc(sizeof(Las_File),"Allocating .las file record");
+  if (las == NULL)
+    EXIT(NULL);
+  if (path == NULL)
+    { las->name = Strdup("stdin","Allocating .las file record");
+      input     = stdin;
+    }
+  else
+    { las->name = Strdup(path,"Allocating .las file record");
+      input     = Fopen(path,"r");
+    }
+  if (las->name == NULL || input == NULL)
+    goto error;
+
+  start = ftello(input);
+  if (fread(&las->novl,sizeof(int64),1,input) != 1 ||
+      fread(&las->tspace,sizeof(int),1,input) != 1)
+    { EPRINTF(EPLACE,"%s: %s does not have a .las header\n",Prog_Name,las->name);
+      goto error;
+    }
+  if (las->novl == LAS2_MARKER)
+    { las->version = 2;
+      if (fread(&las->novl,sizeof(int64),1,input) != 1)
+        { EPRINTF(EPLACE,"%s: %s does not have a .las header\n",Prog_Name,las->name);
+          goto error;
+        }
+    }
+  else
+    las->version = 1;
+  if (las->tspace <= TRACE_XOVR)
+    las->tbytes = sizeof(uint8);
+  else
+    las->tbytes = sizeof(uint16);
+
+  las->stream = input;
+  las->mode   = mode;
+  las->nread  = 0;
+  las->rec    = NULL;
+  las->span   = 0;
+  las->mapped = 0;
+  las->base   = NULL;
+  las->size   = 0;
+  las->ndec   = 0;
+  las->cbuf   = NULL;
+  las->csize  = 0;
+  las->istate = 0;
+  las->nidx   = 0;
+  las->index  = NULL;
+  read_stats(las);
+
+  las->compact = (las->version == 2 && mode == LAS_HEADERS);
+
+  //  Map the file if it is a regular file, the records start after the header that was
+  //    just read, which need not be at the start of the file if it is the standard input
+
+  if (las->version == 1 && start >= 0 && fstat(fileno(input),&info) == 0
+                        && S_ISREG(info.st_mode)
+                 && info.st_size > start + LAS_HEADER)
+    { void *map;
+
+      map = mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fileno(input),0);
+      if (map != MAP_FAILED)
+        { las->base   = (uint8 *) map;
+          las->size   = info.st_size;
+          las->mapped = 1;
+          las->data   = las->base + (start + LAS_HEADER);
+          las->ptr    = las->data;
+          las->top    = las->base + las->size;
+          las->freed  = las->base;
+
+          if (mode == LAS_RANDOM)
+            madvise(map,las->size,MADV_WILLNEED);
+          else
+            madvise(map,las->size,MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+          madvise(map,las->size,MADV_HUGEPAGE);
+#endif
+          release_stream(las);
+          return (las);
+        }
+    }
+
+  //  Otherwise stream the records through a buffer, or if all are needed at once,
+  //    read them into a buffer that grows until it holds them all.  The blocks of a
+  //    compressed file are decoded into the buffer in the same way.
+
+  las->bsize = LAS_BUFFER;
+  las->data  = (uint8 *) Malloc(las->bsize,"Allocating .las stream buffer");
+  if (las->data == NULL)
+    goto error;
+  las->ptr = las->top = las->data;
+  if (ONE_PASS(mode))
+    refill_las(las,0);
+  else if (las->version == 2)
+    while (refill_las(las,0))
+      ;
+  else
+    while (refill_las(las,0) && las->top - las->data == las->bsize)
+      { int64 full = las->top - las->data;
+
+        las->bsize *= 2;
+        las->data   = (uint8 *) Realloc(las->data,las->bsize,"Enlarging .las buffer");
+        if (las->data == NULL)
+          EXIT(NULL);
+        las->ptr = las->data;
+        las->top = las->data + full;
+      }
+  if (!ONE_PASS(mode))
+    release_stream(las);
+  return (las);
+
+error:
+  if (input != NULL && input != stdin)
+    fclose(input);
+  free(las->name);
+  free(las);
+  EXIT(NULL);
+}
+
+  //  Make sure the whole of the next record is in memory and return it, or NULL if there is none
+
+static Las_Record *peek_las(Las_File *las)
+{ int64 span;
+
+  if (las->ptr + LAS_RECORD > las->top)
+    { refill_las(las,LAS_RECORD);
+      if (las->ptr + LAS_RECORD > las->top)
+        return (NULL);
+    }
+  span = STRIDE(las,las->ptr);
+  if (las->ptr + span > las->top)
+    { refill_las(las,span);
+      if (las->ptr + span > las->top)
+        return (NULL);
+    }
+  return ((Las_Record *) las->ptr);
+}
+
+Overlap *Next_Las(Las_File *las)
+{ Las_Record *r;
+  Overlap    *ovl;
+  uint8      *rec;
+  int64       span;
+
+  r = peek_las(las);
+  if (r == NULL)
+    return (NULL);
+  span = LAS_SPAN(r,las->tbytes);
+
+  ovl = &las->ovl;
+  if (las->mode == LAS_HEADERS)
+    ovl->path.trace = NULL;
+  else
+    ovl->path.trace = (void *) (las->ptr + LAS_RECORD);
+  ovl->path.tlen  = r->tlen;
+  ovl->path.diffs = r->diffs;
+  ovl->path.abpos = r->abpos;
+  ovl->path.bbpos = r->bbpos;
+  ovl->path.aepos = r->aepos;
+  ovl->path.bepos = r->bepos;
+  ovl->flags      = r->flags;
+  ovl->aread      = r->aread;
+  ovl->bread      = r->bread;
+
+  rec = las->ptr;
+  if (las->mode == LAS_HEADERS)
+    las->rec = NULL;
+  else
+    las->rec = rec;
+  las->span   = span;
+  las->ptr   += STRIDE(las,r);
+  las->nread += 1;
+
+  //  Release the pages of a sequential scan well behind the cursor
+
+  if (las->mapped && ONE_PASS(las->mode) && rec - las->freed >= LAS_RELEASE)
+    { uint8 *edge;
+      int64  page;
+
+      page = sysconf(_SC_PAGESIZE);
+      edge = las->base + (((rec - las->base) / page) * page);
+      madvise(las->freed,edge-las->freed,MADV_DONTNEED);
+      las->freed = edge;
+    }
+
+  return (ovl);
+}
+
+  //  Read the pile offsets of the .las.idx of a version 1 file, or the block index at the end
+  //    of a version 2 file.  Either is ignored if it is not consistent with the file.
+
+static void load_index(Las_File *las)
+{ las->istate = -1;
+  if (las->stream == stdin)
+    return;
+
+  if (las->version == 1)
+    { FILE       *index;
+      struct stat info;
+      Las_Record  first;
+      int64      *off, n;
+
+      index = open_index(las);
+      if (index == NULL)
+        return;
+      if (stat(las->name,&info) != 0)
+        { fclose(index);
+          return;
+        }
+      fseeko(index,0,SEEK_END);
+      n = ftello(index)/sizeof(int64) - 4;
+      if (n < 2 || fseeko(index,4*sizeof(int64),SEEK_SET) != 0)
+        { fclose(index);
+          return;
+        }
+      off = (int64 *) Malloc(sizeof(int64)*n,"Allocating .las index");
+      if (off == NULL)
+        exit (1);
+      if (fread(off,sizeof(int64),n,index) != (size_t) n ||
+          off[0] != LAS_HEADER || off[n-1] != (int64) info.st_size)
+        { fclose(index);
+          free(off);
+          return;
+        }
+      fclose(index);
+
+      if (las->stream == NULL)
+        first = *((Las_Record *) las->data);
+      else if (pread(fileno(las->stream),&first,sizeof(Las_Record),LAS_HEADER)
+                   != (ssize_t) sizeof(Las_Record))
+        { free(off);
+          return;
+        }
+      las->afirst = first.aread;
+      las->nidx   = n;
+      las->index  = off;
+    }
+
+  else
+    { Las2_Index *idx;
+      FILE       *input = las->stream;
+      off_t       here;
+      int64       trail[3];
+      int         i, ok;
+
+      if (input == NULL || (here = ftello(input)) < 0)
+        return;
+      ok = (fseeko(input,-3*((off_t) sizeof(int64)),SEEK_END) == 0 &&
+            fread(trail,sizeof(int64),3,input) == 3 && trail[2] == LAS2_MARKER &&
+            trail[0] > 0 && fseeko(input,trail[1],SEEK_SET) == 0);
+      idx = NULL;
+      if (ok)
+        { idx = (Las2_Index *) Malloc(sizeof(Las2_Index)*trail[0],"Allocating .las block index");
+          if (idx == NULL)
+            exit (1);
+          for (i = 0; ok && i < trail[0]; i++)
+            ok = (fread(&(idx[i].aread),sizeof(int),1,input) == 1 &&
+                  fread(&(idx[i].recno),sizeof(int64),1,input) == 1 &&
+                  fread(&(idx[i].offset),sizeof(int64),1,input) == 1);
+        }
+      if (fseeko(input,here,SEEK_SET) != 0)
+        { EPRINTF(EPLACE,"%s: System error, seek in %s failed!\n",Prog_Name,las->name);
+          exit (1);
+        }
+      if (!ok)
+        { free(idx);
+          return;
+        }
+      las->nidx  = trail[0];
+      las->index = idx;
+    }
+
+  las->istate = 1;
+}
+
+void Seek_Las(Las_File *las, int aread)
+{ Las_Record *r;
+
+  if (las->istate == 0)
+    load_index(las);
+
+  //  Jump to the pile of aread, or the first after it, if it is ahead of the cursor
+
+  if (las->istate > 0 && las->version == 1)
+    { int64 *off = (int64 *) las->index;
+      int64  k, o;
+
+      k = ((int64) aread) - las->afirst;
+      if (k > 0)
+        { if (k >= las->nidx)
+            k = las->nidx-1;
+          o = off[k];
+          if (las->stream == NULL)
+            { uint8 *p = las->data + (o - LAS_HEADER);
+
+              if (p > las->ptr && p <= las->top)
+                las->ptr = p;
+            }
+          else
+            { off_t here = ftello(las->stream);
+
+              if (here >= 0 && o > here - (las->top - las->ptr) &&
+                  fseeko(las->stream,o,SEEK_SET) == 0)
+                { las->ptr = las->top = las->data;
+                  refill_las(las,0);
+                }
+            }
+        }
+    }
+
+  //  Jump to the last block whose first aread is less than aread if it is yet to be decoded,
+  //    the records before it in the buffer all precede aread
+
+  else if (las->istate > 0 && las->stream != NULL)
+    { Las2_Index *idx = (Las2_Index *) las->index;
+      int64       l, h, m;
+
+      l = -1;
+      h = las->nidx;
+      while (h - l > 1)
+        { m = (l+h)/2;
+          if (idx[m].aread < aread)
+            l = m;
+          else
+            h = m;
+        }
+      if (l >= 0 && idx[l].recno >= las->ndec && fseeko(las->stream,idx[l].offset,SEEK_SET) == 0)
+        { las->ptr  = las->top = las->data;
+          las->ndec = idx[l].recno;
+          refill_las(las,0);
+        }
+    }
+
+  //  Skip the records before aread in the pile or block reached
+
+  while ((r = peek_las(las)) != NULL && r->aread < aread)
+    las->ptr += STRIDE(las,r);
+}
+
+int At_End_Las(Las_File *las)
+{ if (las->ptr < las->top)
+    return (0);
+  refill_las(las,0);
+  return (las->ptr >= las->top);
+}
+
+void Close_Las(Las_File *las)
+{ if (las->mapped)
+    munmap(las->base,las->size);
+  else
+    free(las->data);
+  free(las->cbuf);
+  free(las->index);
+  if (las->stream != NULL && las->stream != stdin)
+    fclose(las->stream);
+  free(las->name);
+  free(las);
+}
+
+
+/*******************************************************************************************
+ *
+ *  VERSION 2 WRITER
+ *
+ ********************************************************************************************/
+
+static int write_las2(Las2_File *out, void *ptr, int64 len)
+{ if (fwrite(ptr,1,len,out->file) != (size_t) len)
+    { EPRINTF(EPLACE,"%s: System error, write to %s failed!\n",Prog_Name,out->name);
+      EXIT(1);
+    }
+  return (0);
+}
+
+  //  Write the block being built and note its offset in its index entry
+
+static int flush_las2(Las2_File *out)
+{ Las2_Index *idx;
+
+  if (out->nrec == 0)
+    return (0);
+
+  idx = ((Las2_Index *) out->index) + (out->nidx-1);
+  idx->offset = ftello(out->file);
+  if (write_las2(out,&out->nrec,sizeof(int)) || write_las2(out,&out->raw,sizeof(int64)) ||
+      write_las2(out,&out->csize,sizeof(int64)) || write_las2(out,out->cbuf,out->csize))
+    EXIT(1);
+
+  out->nrec  = 0;
+  out->raw   = 0;
+  out->csize = 0;
+  out->alast = 0;
+  out->blast = 0;
+  return (0);
+}
+
+Las2_File *Create_Las2(char *path, int tspace, int64 novl)
+{ Las2_File *out;
+  int64      marker = LAS2_MARKER;
+
+  out = (Las2_File *) Malloc(sizeof(Las2_File),"Allocating .las file record");
+  if (out == NULL)
+    EXIT(NULL);
+  out->name  = Strdup(path,"Allocating .las file record");
+  out->cmax  = 1000000;
+  out->cbuf  = (uint8 *) Malloc(out->cmax,"Allocating .las block buffer");
+  out->midx  = 1024;
+  out->index = Malloc(sizeof(Las2_Index)*out->midx,"Allocating .las block index");
+  if (out->name == NULL || out->cbuf == NULL || out->index == NULL)
+    goto error;
+
+  out->file = Fopen(path,"w");
+  if (out->file == NULL)
+    goto error;
+
+  out->tspace = tspace;
+  if (tspace <= TRACE_XOVR)
+    out->tbytes = sizeof(uint8);
+  else
+    out->tbytes = sizeof(uint16);
+  out->novl  = 0;
+  out->hnovl = novl;
+  out->nrec  = 0;
+  out->raw   = 0;
+  out->csize = 0;
+  out->alast = 0;
+  out->blast = 0;
+  out->nidx  = 0;
+
+  if (write_las2(out,&marker,sizeof(int64)) || write_las2(out,&tspace,sizeof(int)) ||
+      write_las2(out,&novl,sizeof(int64)))
+    { fclose(out->file);
+      goto error;
+    }
+  return (out);
+
+error:
+  free(out->index);
+  free(out->cbuf);
+  free(out->name);
+  free(out);
+  EXIT(NULL);
+}
+
+int Write_Las2(Las2_File *out, Overlap *ovl)
+{ Path   *path = &(ovl->path);
+  uint8  *p;
+  int64   need;
+  int     k;
+
+  need = 10*10 + 3*((int64) path->tlen);
+  if (out->csize + need > out->cmax)
+    { out->cmax = 1.2*(out->csize + need) + 1000000;
+      out->cbuf = (uint8 *) Realloc(out->cbuf,out->cmax,"Enlarging .las block buffer");
+      if (out->cbuf == NULL)
+        EXIT(1);
+    }
+
+  if (out->nrec == 0)
+    { Las2_Index *idx;
+
+      if (out->nidx >= out->midx)
+        { out->midx  = 1.2*out->nidx + 1024;
+          out->index = Realloc(out->index,sizeof(Las2_Index)*out->midx,
+                               "Enlarging .las block index");
+          if (out->index == NULL)
+            EXIT(1);
+        }
+      idx = ((Las2_Index *) out->index) + out->nidx;
+      idx->aread = ovl->aread;
+      idx->recno = out->novl;
+      out->nidx += 1;
+    }
+
+  p = out->cbuf + out->csize;
+  p = put_varint(p,ZIG(((int64) ovl->aread) - out->alast));
+  if (ovl->aread == out->alast)
+    p = put_varint(p,ZIG(((int64) ovl->bread) - out->blast));
+  else
+    p = put_varint(p,ZIG(ovl->bread));
+  p = put_varint(p,ovl->flags);
+  p = put_varint(p,ZIG(path->abpos));
+  p = put_varint(p,ZIG(((int64) path->aepos) - path->abpos));
+  p = put_varint(p,ZIG(path->bbpos));
+  p = put_varint(p,ZIG(((int64) path->bepos) - path->bbpos));
+  p = put_varint(p,ZIG(path->diffs));
+  p = put_varint(p,path->tlen);
+  if (out->tbytes == 1)
+    { uint8 *t = (uint8 *) path->trace;
+
+      for (k = 0; k < path->tlen; k++)
+        if (k & 0x1)
+          p = put_varint(p,ZIG(((int64) t[k]) - out->tspace));
+        else
+          p = put_varint(p,t[k]);
+    }
+  else
+    { uint16 *t = (uint16 *) path->trace;
+
+      for (k = 0; k < path->tlen; k++)
+        if (k & 0x1)
+          p = put_varint(p,ZIG(((int64) t[k]) - out->tspace));
+        else
+          p = put_varint(p,t[k]);
+    }
+  out->csize  = p - out->cbuf;
+  out->raw   += LAS_RECORD + path->tlen * (int64) out->tbytes;
+  out->alast  = ovl->aread;
+  out->blast  = ovl->bread;
+  out->nrec  += 1;
+  out->novl  += 1;
+
+  if (out->nrec >= LAS2_BLOCK)
+    return (flush_las2(out));
+  return (0);
+}
+
+int Close_Las2(Las2_File *out)
+{ Las2_Index *idx;
+  int64       nblock, ioff, marker = LAS2_MARKER;
+  int         i;
+
+  if (flush_las2(out))
+    EXIT(1);
+
+  ioff   = ftello(out->file);
+  nblock = out->nidx;
+  idx    = (Las2_Index *) out->index;
+  for (i = 0; i < out->nidx; i++)
+    if (write_las2(out,&(idx[i].aread),sizeof(int)) ||
+        write_las2(out,&(idx[i].recno),sizeof(int64)) ||
+        write_las2(out,&(idx[i].offset),sizeof(int64)))
+      EXIT(1);
+  if (write_las2(out,&nblock,sizeof(int64)) || write_las2(out,&ioff,sizeof(int64)) ||
+      write_las2(out,&marker,sizeof(int64)))
+    EXIT(1);
+
+  if (out->novl != out->hnovl)
+    { if (fseeko(out->file,sizeof(int64)+sizeof(int),SEEK_SET) != 0 ||
+          write_las2(out,&(out->novl),sizeof(int64)))
+        { EPRINTF(EPLACE,"%s: Could not correct the header of %s\n",Prog_Name,out->name);
+          EXIT(1);
+        }
+    }
+
+  if (fclose(out->file) != 0)
+    { EPRINTF(EPLACE,"%s: System error, close of %s failed!\n",Prog_Name,out->name);
+      EXIT(1);
+    }
+
+  free(out->index);
+  free(out->cbuf);
+  free(out->name);
+  free(out);
+  return (0);
+}
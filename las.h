@@ -0,0 +1,188 @@
+/*******************************************************************************************
+ *
+ *  Reader for .las files shared by the LA-tools.  A .las file is mapped into memory and its
+ *    records are delivered in order as Overlap views whose trace points directly into the
+ *    mapping, so that a trace is never copied or staged through a read buffer.  When the
+ *    file cannot be mapped (e.g. the standard input is a pipe) the records are streamed
+ *    through a buffer and the same interface applies.  Compressed (version 2) .las files are
+ *    decoded on the fly, so every tool reads either kind of file.
+ *
+ ********************************************************************************************/
+
+#ifndef _LAS_MODULE
+
+#define _LAS_MODULE
+
+#include "DB.h"
+#include "align.h"
+
+/*** LAS FILE ABSTRACTION:
+
+     A .las file consists of an int64 count 'novl' of the overlap records it contains and the
+     int trace spacing 'tspace', followed by the records.  Each record is an Overlap without
+     its leading trace pointer (LAS_RECORD bytes), followed by its trace of 'tlen' values each
+     occupying 'tbytes' bytes, 1 if 'tspace' <= TRACE_XOVR and 2 otherwise.  A Las_Record
+     gives typed access to the fields of a record in place.
+***/
+
+#define LAS_HEADER  ((int64) (sizeof(int64) + sizeof(int)))
+#define LAS_RECORD  ((int64) (sizeof(Overlap) - sizeof(void *)))
+
+typedef struct
+  { int     tlen;         /* The fields of an Overlap after its trace pointer */
+    int     diffs;
+    int     abpos, bbpos;
+    int     aepos, bepos;
+    uint32  flags;
+    int     aread;
+    int     bread;
+  } Las_Record;
+
+#define LAS_SPAN(rec,tbytes)  (LAS_RECORD + ((Las_Record *) (rec))->tlen * (int64) (tbytes))
+
+/*** COMPRESSED LAS FILES (VERSION 2):
+
+     A version 2 .las file begins with the int64 LAS2_MARKER, which is negative so that it
+     cannot be mistaken for the record count of a version 1 file, followed by the int 'tspace'
+     and the int64 'novl'.  The records follow in blocks of at most LAS2_BLOCK records, each
+     a block header of the int 'nrec', the int64 # of bytes the records occupy in version 1
+     form, and the int64 # of bytes 'size' of the encoded records that follow.  A record is
+     encoded as a sequence of variable length integers (7 bits per byte, the high bit set on
+     all but the last byte), signed values being zig-zag encoded, as follows:
+
+       aread - the aread of the previous record of the block (or 0)
+       bread - the bread of the previous record if it has the same aread (or 0)
+       flags, abpos, aepos-abpos, bbpos, bepos-bbpos, diffs, tlen
+       trace[0], trace[1]-tspace, trace[2], trace[3]-tspace, ...
+
+     After the blocks is an index with an entry per block giving the aread of its first record,
+     the ordinal of its first record, and the offset of its block header in the file, as an
+     int and two int64's.  The file ends with a trailer of three int64's: the # of blocks, the
+     offset of the index, and LAS2_MARKER.
+***/
+
+#define LAS2_MARKER  (-0x3253414cll)   //  "LAS2" negated
+#define LAS2_HEADER  ((int64) (2*sizeof(int64) + sizeof(int)))
+#define LAS2_BLOCK   4096
+
+#define LAS_SEQUENTIAL 0   //  Records are visited once in order, pages behind are released
+#define LAS_RANDOM     1   //  All the records are needed in memory at once (e.g. to sort them)
+#define LAS_SWEEP      2   //  All the records are needed at once but will be read in a few
+                           //    sequential sweeps (e.g. to partition and merge them)
+#define LAS_HEADERS    3   //  As LAS_SEQUENTIAL but only the record headers are needed, the
+                           //    traces are not delivered (nor decoded if the file is compressed)
+
+typedef struct
+  { char    *name;        /* Path name of the file ("stdin" if the standard input)        */
+    int      version;     /* 1 for a plain .las file, 2 for a compressed one              */
+    int64    novl;        /* # of records according to the header                         */
+    int      tspace;      /* Trace point spacing                                          */
+    int      tbytes;      /* Bytes per trace value                                        */
+    int64    nread;       /* # of records delivered so far by Next_Las                    */
+    uint8   *data;        /* First record in memory (mapped, loaded, or buffered)         */
+    uint8   *ptr;         /* Next record to be delivered                                  */
+    uint8   *top;         /* End of the records in memory                                 */
+    uint8   *rec;         /* Last record delivered, it occupies 'span' bytes              */
+    int64    span;
+    Overlap  ovl;         /* Its header, with 'ovl.path.trace' pointing into the record   */
+    int64    omax;        /* Statistics from the file's .las.idx if it has an up to date    */
+    int64    ttot;        /*   one (otherwise -1): the max # of records of a pile, the total */
+    int64    smax;        /*   # of trace points, the max # of trace points of a pile, and   */
+    int64    tmax;        /*   the max # of trace points of a record                         */
+
+    int      mapped;      /* Private: how the records are held in memory                  */
+    int      mode;
+    int      compact;     /* Version 2 in LAS_HEADERS mode: only headers are in memory     */
+    FILE    *stream;
+    uint8   *base;
+    int64    size;
+    uint8   *freed;
+    int64    bsize;
+    int64    ndec;        /* Version 2: # of records decoded, and the encoded block buffer */
+    uint8   *cbuf;
+    int64    csize;
+    int      istate;      /* Seek_Las: 0 if the index is yet to be read, 1 if read, -1 if none */
+    int      afirst;      /*   Version 1: aread of the first pile, and the offset of each pile */
+    int64    nidx;        /*   Version 2: the block index                                      */
+    void    *index;
+  } Las_File;
+
+  /* Open_Las opens the .las file 'path', or the standard input if 'path' is NULL, reads its
+     header, and maps it into memory.  If 'mode' is LAS_SEQUENTIAL or LAS_HEADERS the mapping is
+     advised for sequential access and pages are released behind the read cursor as it advances,
+     so that a pass over a file larger than memory does not compete with the rest of the
+     machine.  If 'mode' is LAS_RANDOM or LAS_SWEEP all of the file's records from 'data' to
+     'top' are available after the call, the mapping being advised for random or sequential
+     access respectively.  If the file cannot be mapped it is streamed through a buffer
+     (LAS_SEQUENTIAL or LAS_HEADERS), or read into memory in its entirety (otherwise).  A file
+     that is mapped or read in its entirety does not hold a file descriptor, so any number of
+     them may be open at once.  An error message is output and NULL returned if the file cannot
+     be opened or its header is not well-formed.  If the file has a .<root>.las.idx that is no
+     older than it, the statistics of the index are in 'omax', 'ttot', 'smax', and 'tmax' so
+     that a tool can size its buffers up front, otherwise they are -1.
+
+     Next_Las delivers the next record of 'las', or NULL if there are no more, or if fewer bytes
+     remain than the record requires.  The record is described by the Overlap 'las->ovl' that
+     is returned, its trace pointer is into the file's records, and 'las->rec' and 'las->span'
+     give its location and extent for the purpose of copying it to another file verbatim.
+     If the file is mapped or loaded the record stays valid until Close_Las, otherwise only
+     until the next call to Next_Las.  The trace is never copied so it must be copied by the
+     caller before being modified, e.g. by Decompress_TraceTo16.  If 'mode' is LAS_HEADERS
+     the trace pointer and 'las->rec' are NULL, but 'ovl.path.tlen' and 'las->span' still give
+     the trace length and the extent of the record in version 1 form.
+
+     Seek_Las advances 'las' so that the next record delivered is the first at or after the
+     current position whose A-read is 'aread' or greater, assuming the file is sorted.  The
+     cursor jumps straight there when the file has an index, i.e. the .<root>.las.idx built by
+     LAindex for a version 1 file, or the block index of a version 2 file, and otherwise skips
+     forward a record at a time without delivering them.  The cursor never moves back.
+
+     At_End_Las returns 1 if all the bytes of 'las' have been delivered, 0 otherwise.
+
+     Close_Las unmaps or frees the memory of 'las', closes it, and frees the record.
+
+     The records of a compressed file are delivered in version 1 form, i.e. 'las->data' to
+     'las->top' and 'las->rec' are always the bytes of version 1 records.  So a tool that copies
+     records verbatim writes a version 1 .las file whatever the version of its input.  The
+     exception is LAS_HEADERS mode, where the records of a compressed file are decoded to their
+     headers alone, which is why 'las->rec' is then not available.
+  */
+
+  Las_File *Open_Las(char *path, int mode);
+  Overlap  *Next_Las(Las_File *las);
+  void      Seek_Las(Las_File *las, int aread);
+  int       At_End_Las(Las_File *las);
+  void      Close_Las(Las_File *las);
+
+typedef struct
+  { char    *name;
+    FILE    *file;
+    int      tspace;
+    int      tbytes;
+    int64    novl;        /* # of records written so far, and the # the header states     */
+    int64    hnovl;
+    int      nrec;        /* The block being built: # of records, version 1 size,         */
+    int64    raw;         /*   encoded bytes, and the state of the delta encoding         */
+    uint8   *cbuf;
+    int64    csize;
+    int64    cmax;
+    int      alast;
+    int      blast;
+    int      nidx;        /* Index entries so far and the size of the index array         */
+    int      midx;
+    void    *index;
+  } Las2_File;
+
+  /* Create_Las2 creates the compressed .las file 'path' and writes its header for a file of
+     'novl' records with trace spacing 'tspace'.  Write_Las2 appends 'ovl', whose trace is
+     in the 'tbytes' form of a version 1 file, and Close_Las2 writes the last block, the index,
+     and the trailer (correcting the header should the # of records written differ from 'novl')
+     and closes the file.  On an error a message is output and Create_Las2 returns NULL and
+     the others return 1, otherwise they return 0.
+  */
+
+  Las2_File *Create_Las2(char *path, int tspace, int64 novl);
+  int        Write_Las2(Las2_File *out, Overlap *ovl);
+  int        Close_Las2(Las2_File *out);
+
+#endif // _LAS_MODULE
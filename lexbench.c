@@ -0,0 +1,320 @@
+/*******************************************************************************************
+ *
+ *  Micro-benchmark of the threaded radix sort of filter.c.  For each requested size it
+ *    sorts synthetic k-mer records (a random 2k-bit code), seed-pair records (random bread,
+ *    aread, apos), and packed 8-byte seed pairs with byte and wide digits, with and without
+ *    the cache-line write buffers.  Byte digits without the buffers is the sort as it was before these were
+ *    introduced.  The results of all configurations are checked to be sorted and identical.
+ *    With -S the sort as daligner configures it is instead timed with 1 thread up to -T
+ *    threads (counts that are not powers of 2 included) to show how it scales.
+ *
+ ********************************************************************************************/
+
+#include <sys/time.h>
+
+#include "filter.c"
+
+int     VERBOSE;   //   Globals declared in filter.h, normally supplied by daligner.c
+int     BIASED;
+int     MINOVER;
+int     HGAP_MIN;
+int     SYMMETRIC;
+int     IDENTITY;
+int     STREAM;
+int     SORTED;
+uint64  MEM_LIMIT;
+uint64  MEM_PHYSICAL;
+
+static char *Usage = "[-vS] [-k<int(14)>] [-T<int(4)>] <records:int> ...";
+
+static struct
+  { char *name;
+    int   bits;
+    int   wc;
+  } Config[] =
+  { { "byte digits, direct",      8, 0 },
+    { "byte digits, buffered",    8, 1 },
+    { "wide digits, direct",      LEX_BITS, 0 },
+    { "wide digits, buffered",    LEX_BITS, 1 },
+  };
+
+#define NCONFIG  (sizeof(Config)/sizeof(Config[0]))
+
+static int Sweep[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128 };
+
+#define NSWEEP  (sizeof(Sweep)/sizeof(Sweep[0]))
+
+static uint64 mix(uint64 x)
+{ x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdllu;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53llu;
+  x ^= x >> 33;
+  return (x);
+}
+
+static char *Record[3] = { "K-mer", "Seed pair", "Packed seed pair" };
+
+#define PACK_SHIFT  20     //  Low bit of the key of a packed pair, diag is below it
+
+static void fill(Double *src, int64 len, int pairs)
+{ int64  i;
+  uint64 r;
+
+  for (i = 0; i < len; i++)
+    { r = mix(i+1);
+      if (pairs == 2)
+        ((uint64 *) src)[i] = r;
+      else if (pairs)
+        { src[i].p1 = ((r & 0x7fff) << 32) | ((r >> 15) & 0xffff);
+          src[i].p2 = (((r >> 31) & 0xfffff) << 32) | ((r >> 51) & 0x1fff);
+        }
+      else
+        { src[i].p1 = r & Kmask;
+          src[i].p2 = i;
+        }
+    }
+}
+
+static double now()
+{ struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+  return (tv.tv_sec + tv.tv_usec/1e6);
+}
+
+static int kfield[3], pfield[9], wfield[3];
+
+  //  Sort len fresh records of the given kind with the current NTHREADS, LEX_bits, and LEX_wc,
+  //    setting *time to the time of the sort and returning a hash of the result.  Exits if
+  //    the result is not sorted.
+
+static uint64 bench(Double *src, Double *trg, int64 len, int pairs, Lex_Arg *parmx,
+                    char *name, double *time)
+{ Double *rez;
+  uint64  hash;
+  int64   x, j;
+  int     i;
+  double  t;
+
+  if (pairs == 2)
+    lex_plan(1,wfield,len);
+  else if (pairs)
+    lex_plan(3,pfield,len);
+  else
+    lex_plan(1,kfield,len);
+
+  if (VERBOSE)
+    { printf("  Digits:");
+      for (i = 0; i < LEX_ndigit; i++)
+        printf(" p%d[%d..%d]",LEX_digit[i].word+1,LEX_digit[i].shift,
+               LEX_digit[i].shift + (int) log2(LEX_digit[i].mask+1.) - 1);
+      printf("\n");
+    }
+
+  fill(src,len,pairs);
+
+  x = 0;
+  for (i = 0; i < NTHREADS; i++)
+    { parmx[i].beg = x;
+      parmx[i].end = x = (len * (i+1)) / NTHREADS;
+      for (j = 0; j <= (int64) FMASK; j++)
+        parmx[i].tptr[j] = 0;
+      for (j = parmx[i].beg; j < x; j++)
+        if (pairs == 2)
+          parmx[i].tptr[DIGIT(LEX_digit,((uint64 *) src)+j)] += 1;
+        else
+          parmx[i].tptr[DIGIT(LEX_digit,src+j)] += 1;
+    }
+
+  t   = now();
+  if (pairs == 2)
+    rez = lex_sort(src,trg,sizeof(uint64),parmx);
+  else
+    rez = lex_sort(src,trg,sizeof(Double),parmx);
+  *time = now() - t;
+
+  hash = 0;
+  if (pairs == 2)
+    { uint64 *w = (uint64 *) rez;
+
+      for (j = 0; j < len; j++)
+        { if (j > 0 && (w[j] >> PACK_SHIFT) < (w[j-1] >> PACK_SHIFT))
+            break;
+          hash = mix(hash ^ w[j]);
+        }
+    }
+  else
+    for (j = 0; j < len; j++)
+      { if (j > 0)
+          { if (pairs)
+              { if (rez[j].p2 < rez[j-1].p2 || (rez[j].p2 == rez[j-1].p2
+                      && (rez[j].p1 >> 32) < (rez[j-1].p1 >> 32)))
+                  break;
+              }
+            else if (rez[j].p1 < rez[j-1].p1)
+              break;
+          }
+        hash = mix(hash ^ rez[j].p1) ^ rez[j].p2;
+      }
+  if (j < len)
+    { fprintf(stderr,"%s: %s sort is out of order at %lld\n",Prog_Name,name,j);
+      exit (1);
+    }
+
+  return (hash);
+}
+
+int main(int argc, char *argv[])
+{ int    KMER_LEN;
+  int    NTHREADS_ARG;
+  int    SCALE;
+
+  { int    i, j, k;
+    int    flags[128];
+    char  *eptr;
+
+    ARG_INIT("lexbench")
+
+    KMER_LEN     = 14;
+    NTHREADS_ARG = 4;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("vS")
+            break;
+          case 'k':
+            ARG_POSITIVE(KMER_LEN,"K-mer length")
+            if (KMER_LEN > 31)
+              { fprintf(stderr,"%s: K-mer length must be 31 or less\n",Prog_Name);
+                exit (1);
+              }
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS_ARG,"Number of threads")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+    SCALE   = flags['S'];
+
+    if (argc < 2)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        exit (1);
+      }
+  }
+
+  Set_Filter_Params(KMER_LEN,6,0,35,NTHREADS_ARG);
+  LEX_big = 0;
+
+  { int     a, c, s, pairs;
+    int64   len;
+    Double *src, *trg;
+    Lex_Arg *parmx;
+    int     count[NSWEEP+1], ncount;
+    uint64  hash, href;
+    double  t, t1;
+
+    parmx = (Lex_Arg *) Malloc(sizeof(Lex_Arg)*NTHREADS_ARG,"Allocating sort arguments");
+    if (parmx == NULL)
+      exit (1);
+
+    kfield[0] = 0;
+    kfield[1] = 0;
+    kfield[2] = 2*KMER_LEN;
+
+    pfield[0] = 0;  pfield[1] = 32;  pfield[2] = 15;
+    pfield[3] = 1;  pfield[4] = 0;   pfield[5] = 13;
+    pfield[6] = 1;  pfield[7] = 32;  pfield[8] = 20;
+
+    wfield[0] = 0;
+    wfield[1] = PACK_SHIFT;
+    wfield[2] = 64-PACK_SHIFT;
+
+    ncount = 0;                 //  Thread counts of the sweep: those of Sweep upto -T, and -T
+    for (s = 0; s < (int) NSWEEP && Sweep[s] < NTHREADS_ARG; s++)
+      count[ncount++] = Sweep[s];
+    count[ncount++] = NTHREADS_ARG;
+
+    for (a = 1; a < argc; a++)
+      { len = strtoll(argv[a],NULL,10);
+        if (len <= 0)
+          { fprintf(stderr,"%s: Size '%s' is not a positive integer\n",Prog_Name,argv[a]);
+            exit (1);
+          }
+        src = (Double *) Malloc(sizeof(Double)*len,"Allocating sort arrays");
+        trg = (Double *) Malloc(sizeof(Double)*len,"Allocating sort arrays");
+        if (src == NULL || trg == NULL)
+          exit (1);
+
+        for (pairs = 0; pairs < 3; pairs++)
+          if (SCALE)
+            { printf("\n%s sort of ",Record[pairs]);
+              Print_Number(len,0,stdout);
+              printf(" records\n");
+              printf("  Threads      Time   M records/s  Speedup  Efficiency\n");
+
+              LEX_bits = LEX_BITS;
+              LEX_wc   = 1;
+              href = 0;
+              t1   = 0.;
+              for (s = 0; s < ncount; s++)
+                { Set_Filter_Params(KMER_LEN,6,0,35,count[s]);
+
+                  hash = bench(src,trg,len,pairs,parmx,"threaded",&t);
+                  if (NTHREADS == 1)
+                    { href = hash;
+                      t1   = t;
+                    }
+                  else if (hash != href)
+                    { fprintf(stderr,"%s: %d thread sort differs from 1 thread sort\n",
+                                     Prog_Name,NTHREADS);
+                      exit (1);
+                    }
+
+                  printf("  %7d %8.3fs  %12.1f  %7.2f  %9.0f%%\n",NTHREADS,t,(len/1e6)/t,
+                         t1/t,(100.*t1/t)/NTHREADS);
+                  fflush(stdout);
+                }
+            }
+
+          else
+            { printf("\n%s sort of ",Record[pairs]);
+              Print_Number(len,0,stdout);
+              printf(" records with %d threads\n",NTHREADS);
+
+              href = 0;
+              for (c = 0; c < (int) NCONFIG; c++)
+                { LEX_bits = Config[c].bits;
+                  LEX_wc   = Config[c].wc;
+
+                  hash = bench(src,trg,len,pairs,parmx,Config[c].name,&t);
+                  if (c == 0)
+                    href = hash;
+                  else if (hash != href)
+                    { fprintf(stderr,"%s: %s sort differs from byte sort\n",
+                                     Prog_Name,Config[c].name);
+                      exit (1);
+                    }
+
+                  printf("  %-24s %2d digits %8.3fs  %7.1fM records/s\n",Config[c].name,
+                         LEX_ndigit,t,(len/1e6)/t);
+                  fflush(stdout);
+                }
+            }
+
+        free(trg);
+        free(src);
+      }
+
+    free(parmx);
+  }
+
+  exit (0);
+}